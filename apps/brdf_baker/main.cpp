@@ -0,0 +1,91 @@
+#include <iostream>
+#include <chrono>
+#include <lt/lt.h>
+
+void usage()
+{
+    std::cout << "usage : brdf_baker <scene.json> <brdf name> <output file> [options]\n"
+              << "  --anisotropic                  also tabulate phi_h\n"
+              << "  --resolution th td pd [ph]     grid resolution (theta_h, theta_d, phi_d, phi_h)\n"
+              << "  --samples n                    evaluations averaged per node\n";
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 4) {
+        usage();
+        return 1;
+    }
+
+    std::string scene_path = argv[1];
+    std::string brdf_name = argv[2];
+    std::string output_path = argv[3];
+
+    lt::TabulatedBrdf tabulated;
+    for (int a = 4; a < argc; a++) {
+        std::string option = argv[a];
+        if (option == "--anisotropic") {
+            tabulated.anisotropic = true;
+        } else if (option == "--resolution" && a + 3 < argc) {
+            tabulated.res_theta_h = std::stoi(argv[++a]);
+            tabulated.res_theta_d = std::stoi(argv[++a]);
+            tabulated.res_phi_d = std::stoi(argv[++a]);
+            if (a + 1 < argc && argv[a + 1][0] != '-')
+                tabulated.res_phi_h = std::stoi(argv[++a]);
+        } else if (option == "--samples" && a + 1 < argc) {
+            tabulated.samples = std::stoi(argv[++a]);
+        } else {
+            usage();
+            return 1;
+        }
+    }
+
+    // Load the BRDFs of the scene, nested BRDFs are referenced by name
+    std::ifstream file(scene_path);
+    if (!file) {
+        std::cout << "cannot open " << scene_path << std::endl;
+        return 1;
+    }
+
+    lt::json json_scn;
+    try {
+        json_scn = lt::json::parse(file);
+    } catch (const lt::json::exception& e) {
+        std::cout << e.what() << std::endl;
+        return 1;
+    }
+
+    std::filesystem::path std_path(scene_path);
+    const std::string dir = std_path.parent_path().string() + "/";
+    std::map<std::string, std::shared_ptr<lt::Brdf>> brdf_ref;
+
+    if (json_scn.contains("brdf")) {
+        for (const auto& json_brdf : json_scn["brdf"]) {
+            std::shared_ptr<lt::Brdf> brdf = lt::Factory<lt::Brdf>::create(json_brdf["type"]);
+            if (!brdf)
+                continue;
+            brdf_ref[json_brdf["name"]] = brdf;
+            lt::set_params(json_brdf, brdf->params, dir, brdf_ref);
+            brdf->init();
+        }
+    }
+
+    if (!brdf_ref.count(brdf_name)) {
+        std::cout << "no brdf named " << brdf_name << " in " << scene_path << std::endl;
+        return 1;
+    }
+
+    auto start = std::chrono::high_resolution_clock::now();
+    tabulated.bake(*brdf_ref[brdf_name], tabulated.samples);
+    auto end = std::chrono::high_resolution_clock::now();
+
+    if (!tabulated.save(output_path)) {
+        std::cout << "cannot write " << output_path << std::endl;
+        return 1;
+    }
+
+    std::cout << brdf_name << " baked in " << std::chrono::duration<float, std::milli>(end - start).count() << " (ms) : "
+              << tabulated.table.size() << " nodes written to " << output_path << std::endl;
+
+    return 0;
+}
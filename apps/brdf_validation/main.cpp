@@ -0,0 +1,179 @@
+#include <iostream>
+#include <chrono>
+#include <lt/lt.h>
+
+void usage()
+{
+    std::cout << "usage : brdf_validation [report.json] [options]\n"
+              << "  --brdf name        only validate this type, can be repeated\n"
+              << "  --grid file.json   parameter sets per type, { \"RoughGGX\" : [ { \"rough_x\" : 0.1 }, ... ] }\n"
+              << "  --samples n        BRDF samples per incident angle\n"
+              << "  --thetas n         incident angles\n"
+              << "  --threads n        validation threads, all the hardware threads by default\n"
+              << "  --significance a   probability that a correct sweep fails, 0.01 by default\n"
+              << "  --verbose          print the library logs\n"
+              << "Without a grid, every type is validated with its default parameters, then with\n"
+              << "each float parameter set to 0.05, 0.3 and 0.8 and each bool parameter flipped.\n"
+              << "The exit code is 1 when a parameter set fails.\n";
+}
+
+/**
+ * @brief Default parameter sets: the defaults, then one parameter changed at a time.
+ */
+std::vector<lt::json> default_grid(lt::Brdf& brdf)
+{
+    std::vector<lt::json> grid = { lt::json::object() };
+    for (int i = 0; i < brdf.params.count; i++) {
+        const std::string& name = brdf.params.names[i];
+        if (brdf.params.types[i] == lt::Params::Type::FLOAT) {
+            for (double v : { 0.05, 0.3, 0.8 })
+                grid.push_back({ { name, v } });
+        } else if (brdf.params.types[i] == lt::Params::Type::BOOL) {
+            grid.push_back({ { name, !*(bool*)brdf.params.ptrs[i] } });
+        }
+    }
+    return grid;
+}
+
+int main(int argc, char* argv[])
+{
+    std::string output_path;
+    std::string grid_path;
+    std::vector<std::string> types;
+    int n_threads = 0;
+    float significance = 0.01;
+    bool verbose = false;
+
+    // Sweeps use a coarser incident grid than the viewer, with more samples per angle
+    lt::BrdfValidation::number_of_theta = 16;
+    lt::BrdfValidation::number_of_sample = 100000;
+
+    for (int a = 1; a < argc; a++) {
+        std::string option = argv[a];
+        if (option == "--brdf" && a + 1 < argc) {
+            types.push_back(argv[++a]);
+        } else if (option == "--grid" && a + 1 < argc) {
+            grid_path = argv[++a];
+        } else if (option == "--samples" && a + 1 < argc) {
+            lt::BrdfValidation::number_of_sample = std::stoi(argv[++a]);
+        } else if (option == "--thetas" && a + 1 < argc) {
+            lt::BrdfValidation::number_of_theta = std::stoi(argv[++a]);
+        } else if (option == "--threads" && a + 1 < argc) {
+            n_threads = std::stoi(argv[++a]);
+        } else if (option == "--significance" && a + 1 < argc) {
+            significance = std::stof(argv[++a]);
+        } else if (option == "--verbose") {
+            verbose = true;
+        } else if (option[0] != '-' && output_path.empty()) {
+            output_path = option;
+        } else {
+            usage();
+            return 1;
+        }
+    }
+
+    if (!verbose)
+        lt::Log::level = lt::logWarning;
+
+    lt::json grid_json;
+    if (!grid_path.empty()) {
+        std::ifstream file(grid_path);
+        if (!file) {
+            std::cout << "cannot open " << grid_path << std::endl;
+            return 1;
+        }
+        try {
+            grid_json = lt::json::parse(file);
+        } catch (const lt::json::exception& e) {
+            std::cout << e.what() << std::endl;
+            return 1;
+        }
+    }
+
+    if (types.empty()) {
+        for (const auto& [name, creator] : lt::Factory<lt::Brdf>::registry())
+            if (grid_path.empty() || grid_json.contains(name))
+                types.push_back(name);
+    }
+
+    // Nested BRDFs of the grid are referenced by type, with their default parameters
+    std::map<std::string, std::shared_ptr<lt::Brdf>> brdf_ref;
+    for (const auto& [name, creator] : lt::Factory<lt::Brdf>::registry()) {
+        brdf_ref[name] = creator();
+        brdf_ref[name]->init();
+    }
+
+    // Parameter sets of every type
+    std::vector<std::pair<std::string, lt::json>> sweep;
+    for (const std::string& type : types) {
+        std::shared_ptr<lt::Brdf> brdf = lt::Factory<lt::Brdf>::create(type);
+        if (!brdf) {
+            std::cout << "unknown brdf " << type << std::endl;
+            return 1;
+        }
+
+        if (grid_json.contains(type)) {
+            for (const auto& params : grid_json[type])
+                sweep.push_back({ type, params });
+        } else {
+            for (const auto& params : default_grid(*brdf))
+                sweep.push_back({ type, params });
+        }
+    }
+
+    // Bonferroni correction, a correct sweep fails with probability significance
+    lt::BrdfValidation::significance = significance / std::max<int>(sweep.size(), 1);
+
+    lt::json report;
+    report["number_of_sample"] = lt::BrdfValidation::number_of_sample;
+    report["number_of_theta"] = lt::BrdfValidation::number_of_theta;
+    report["significance"] = significance;
+    report["reciprocity_tolerance"] = lt::BrdfValidation::reciprocity_tolerance;
+    report["validations"] = lt::json::array();
+
+    int n_failed = 0;
+    auto start = std::chrono::high_resolution_clock::now();
+
+    for (const auto& [type, params] : sweep) {
+        std::shared_ptr<lt::Brdf> brdf = lt::Factory<lt::Brdf>::create(type);
+        lt::set_params(params, brdf->params, "", brdf_ref);
+        brdf->init();
+
+        auto t0 = std::chrono::high_resolution_clock::now();
+        lt::BrdfValidation validation = lt::BrdfValidation::validate(*brdf, n_threads);
+        auto t1 = std::chrono::high_resolution_clock::now();
+
+        lt::json entry = validation.to_json();
+        entry["params"] = params;
+        entry["time"] = std::chrono::duration<float, std::milli>(t1 - t0).count();
+        report["validations"].push_back(entry);
+
+        if (!validation.passed())
+            n_failed++;
+
+        std::cout << (validation.passed() ? "[pass] " : "[FAIL] ") << type << " " << params.dump()
+                  << " min p-value " << validation.min_p_value
+                  << " max reciprocity error " << validation.max_reciprocity_error
+                  << (validation.energy_conservative ? "" : " not energy conservative")
+                  << (validation.found_nan ? " NaN" : "")
+                  << (validation.negative_value ? " negative" : "") << std::endl;
+    }
+
+    auto end = std::chrono::high_resolution_clock::now();
+    report["time"] = std::chrono::duration<float, std::milli>(end - start).count();
+    report["failed"] = n_failed;
+
+    if (!output_path.empty()) {
+        std::ofstream file(output_path);
+        if (!file) {
+            std::cout << "cannot write " << output_path << std::endl;
+            return 1;
+        }
+        file << report.dump(2);
+    }
+
+    std::cout << report["validations"].size() << " validations in " << report["time"].get<float>() << " (ms), "
+              << n_failed << " failed" << std::endl;
+
+    return n_failed > 0 ? 1 : 0;
+}
@@ -1,4 +1,5 @@
 #include <iostream>
+#include <future>
 #include <lt/lt.h>
 
 #include <glm/glm.hpp>
@@ -30,6 +31,9 @@ struct RenderSensor {
 
     std::shared_ptr<lt::Sensor> sensor = nullptr;
     bool initialized = false;
+    bool denoise = false; /**< Show the sensor denoised by denoiser. */
+    lt::AtrousDenoiser denoiser;
+    std::vector<lt::Spectrum> denoised;
 
     enum Type
     {
@@ -56,7 +60,13 @@ struct RenderSensor {
         }
         // Push sensor data in opengl sensor texture
         glBindTexture(GL_TEXTURE_2D, sensor_id);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, sensor->w, sensor->h, 0, GL_RGB, GL_FLOAT, sensor->value.data());
+        sensor->resolve();
+        const lt::Spectrum* data = sensor->value.data();
+        if (denoise) {
+            denoiser.apply(*sensor, denoised);
+            data = denoised.data();
+        }
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, sensor->w, sensor->h, 0, GL_RGB, GL_FLOAT, data);
 
         // Process sensor
         // Apply tonemapping
@@ -222,6 +232,7 @@ struct AppData {
     lt::Sampler sampler;
 
     lt::BrdfValidation validation;
+    std::future<lt::BrdfValidation> validation_task; /**< Validation running in the background. */
 };
 
 void AppInit(AppData& app_data) {
@@ -232,12 +243,16 @@ void AppInit(AppData& app_data) {
 
     lt::dir_light(app_data.scn_dir_light, app_data.ren_dir_light);
     app_data.rsen_dir_light.sensor = app_data.ren_dir_light.sensor;
+    app_data.ren_dir_light.integrator->aovs = { "albedo", "normal", "depth" };
+    app_data.ren_dir_light.integrator->init_aovs(*app_data.ren_dir_light.sensor, app_data.scn_dir_light);
     app_data.rsen_dir_light.initialize();
     app_data.rsen_dir_light.type = RenderSensor::Type::Spectrum;
     app_data.scn_dir_light.geometries[0]->brdf = app_data.brdfs[app_data.current_brdf_idx];
 
     lt::generate_from_path("../../../data/lte-orb/lte-orb.json", app_data.scn_glo_ill, app_data.ren_glo_ill);
     app_data.rsen_glo_ill.sensor = app_data.ren_glo_ill.sensor;
+    app_data.ren_glo_ill.integrator->aovs = { "albedo", "normal", "depth" };
+    app_data.ren_glo_ill.integrator->init_aovs(*app_data.ren_glo_ill.sensor, app_data.scn_glo_ill);
     app_data.rsen_glo_ill.initialize();
     app_data.rsen_glo_ill.type = RenderSensor::Type::Spectrum;
     app_data.scn_glo_ill.geometries[1]->brdf = app_data.brdfs[app_data.current_brdf_idx];
@@ -276,7 +291,7 @@ void AppInit(AppData& app_data) {
 
 }
 
-void render_overlay(lt::RendererAsync& ren, const ImVec2& work_pos) {
+void render_overlay(lt::RendererAsync& ren, RenderSensor& rsen, const ImVec2& work_pos) {
     bool p_open = true;
     ImGuiWindowFlags window_flags = ImGuiWindowFlags_NoDecoration | ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoSavedSettings | ImGuiWindowFlags_NoFocusOnAppearing | ImGuiWindowFlags_NoNav;
 
@@ -287,6 +302,7 @@ void render_overlay(lt::RendererAsync& ren, const ImVec2& work_pos) {
         if (ImGui::Button("Save")) {
             lt::save_sensor_exr(*ren.sensor, "save.exr");
         }
+        ImGui::Checkbox("Denoise", &rsen.denoise);
         ImGui::Text("%.0f ms/frame", ren.delta_time_ms);
 
     }
@@ -326,12 +342,14 @@ void brdf_slice(std::shared_ptr<lt::Brdf> brdf, float th_i, float ph_i, std::sha
     std::vector<float> ph = lt::linspace<float>(0, 2. * lt::pi, sensor->w);
 
     lt::vec3 wi = lt::polar_to_card(th_i, ph_i);
+    std::vector<lt::vec3> wo(sensor->w * sensor->h);
     for (int x = 0; x < sensor->w; x++) {
         for (int y = 0; y < sensor->h; y++) {
-            lt::vec3 wo = lt::polar_to_card(th[y], ph[x]);
-            sensor->value[y * sensor->w + x] = brdf->eval(wi, wo, sampler);
+            wo[y * sensor->w + x] = lt::polar_to_card(th[y], ph[x]);
         }
     }
+    sensor->resolve();
+    brdf->eval_n(wi, wo, sensor->value, sampler);
 #endif
 #if 0
     std::vector<float> th_d = lt::linspace<float>(0.5 * lt::pi, 0., sensor->h);
@@ -377,6 +395,12 @@ static void draw_param_gui(const std::shared_ptr<lt::Brdf>& brdf,std::string pre
         case lt::Params::Type::FLOAT:
             NEED_RESET(ImGui::DragFloat(param_name.c_str(), (float*)brdf->params.ptrs[i], 0.01, 0.001, 3.));
             break;
+        case lt::Params::Type::FLOATS: {
+            std::vector<float>* values = (std::vector<float>*)brdf->params.ptrs[i];
+            for (int j = 0; j < values->size(); j++)
+                NEED_RESET(ImGui::DragFloat((brdf->params.names[i] + std::to_string(j) + "##" + prev).c_str(), &values->at(j), 0.01, 0., 1.));
+            break;
+        }
         case lt::Params::Type::VEC3:
             NEED_RESET(ImGui::ColorEdit3(param_name.c_str(), (float*)brdf->params.ptrs[i]));
             break;
@@ -407,6 +431,14 @@ static void draw_param_gui(const std::shared_ptr<lt::Brdf>& brdf,std::string pre
             draw_param_gui(*((std::shared_ptr<lt::Brdf>*)brdf->params.ptrs[i]),param_name);
             ImGui::Separator();
             break;
+        case lt::Params::Type::BRDFS:
+            for (const auto& lobe : *((std::vector<std::shared_ptr<lt::Brdf>>*)brdf->params.ptrs[i])) {
+                ImGui::Separator();
+                ImGui::Text(brdf->params.names[i].c_str());
+                draw_param_gui(lobe, param_name + lobe->type);
+                ImGui::Separator();
+            }
+            break;
         default:
             break;
         }
@@ -529,9 +561,14 @@ static void AppLayout(GLFWwindow* window, AppData& app_data)
 
                                         static float xs[1001];
                                         static float ys[1001];
+                                        static lt::vec3 wos[1001];
+                                        static lt::vec3 rgbs[1001];
+                                        for (int x = 0; x < 1001; x++)
+                                            wos[x] = lt::polar_to_card(th[x], 0.);
+                                        brdf->eval_n(wi, wos, rgbs, app_data.sampler);
                                         for (int x = 0; x < 1001; x++) {
-                                            lt::vec3 wo = lt::polar_to_card(th[x], 0.);
-                                            lt::vec3 rgb = brdf->eval(wi, wo, app_data.sampler);
+                                            lt::vec3 wo = wos[x];
+                                            lt::vec3 rgb = rgbs[x];
                                             float l = (rgb.x + rgb.y + rgb.z) / 3.;
                                             xs[x] =-wo.x * l;
                                             ys[x] = wo.z * l;
@@ -549,10 +586,10 @@ static void AppLayout(GLFWwindow* window, AppData& app_data)
                                     render_polar_bg(wi);
 
                                     lt::vec3 rgb[1001];
-                                    for (int x = 0; x < 1001; x++) {
-                                        lt::vec3 wo = lt::polar_to_card(th[x], 0.);
-                                        rgb[x] = app_data.brdfs[app_data.current_brdf_idx]->eval(wi, wo, app_data.sampler);
-                                    }
+                                    lt::vec3 wos[1001];
+                                    for (int x = 0; x < 1001; x++)
+                                        wos[x] = lt::polar_to_card(th[x], 0.);
+                                    app_data.brdfs[app_data.current_brdf_idx]->eval_n(wi, wos, rgb, app_data.sampler);
 
                                     const char* col_name[3] = { "r", "g", "b" };
                                     const ImVec4 col[3] = { ImVec4(1., 0., 0., 1.), ImVec4(0., 1., 0., 1.), ImVec4(0., 0., 1., 1.) };
@@ -592,10 +629,14 @@ static void AppLayout(GLFWwindow* window, AppData& app_data)
                                         std::shared_ptr<lt::Brdf> brdf = app_data.brdfs[i];
 
                                         static float xs[1001];
+                                        static lt::vec3 wos[1001];
+                                        static lt::vec3 rgbs[1001];
+                                        lt::vec3 wi = lt::polar_to_card(app_data.theta_i, app_data.phi_i);
+                                        for (int x = 0; x < 1001; x++)
+                                            wos[x] = lt::polar_to_card(th[x], 0.);
+                                        brdf->eval_n(wi, wos, rgbs, app_data.sampler);
                                         for (int x = 0; x < 1001; x++) {
-                                            lt::vec3 wi = lt::polar_to_card(app_data.theta_i, app_data.phi_i);
-                                            lt::vec3 wo = lt::polar_to_card(th[x], 0.);
-                                            lt::vec3 rgb = brdf->eval(wi, wo, app_data.sampler);
+                                            lt::vec3 rgb = rgbs[x];
                                             xs[x] = (rgb.x + rgb.y + rgb.z) / 3.;
 
                                         }
@@ -612,10 +653,14 @@ static void AppLayout(GLFWwindow* window, AppData& app_data)
                                     static float r[1001];
                                     static float g[1001];
                                     static float b[1001];
+                                    static lt::vec3 wos[1001];
+                                    static lt::vec3 rgbs[1001];
+                                    lt::vec3 wi = lt::polar_to_card(app_data.theta_i, app_data.phi_i);
+                                    for (int x = 0; x < 1001; x++)
+                                        wos[x] = lt::polar_to_card(th[x], 0.);
+                                    app_data.brdfs[app_data.current_brdf_idx]->eval_n(wi, wos, rgbs, app_data.sampler);
                                     for (int x = 0; x < 1001; x++) {
-                                        lt::vec3 wi = lt::polar_to_card(app_data.theta_i, app_data.phi_i);
-                                        lt::vec3 wo = lt::polar_to_card(th[x], 0.);
-                                        lt::vec3 rgb = app_data.brdfs[app_data.current_brdf_idx]->eval(wi, wo, app_data.sampler);
+                                        lt::vec3 rgb = rgbs[x];
                                         r[x] = rgb.x;
                                         g[x] = rgb.y;
                                         b[x] = rgb.z;
@@ -646,8 +691,10 @@ static void AppLayout(GLFWwindow* window, AppData& app_data)
                     lt::vec3 wi = lt::polar_to_card(app_data.theta_i, app_data.phi_i);
 
 
+                    static lt::Brdf::Sample samples[10000];
+                    app_data.brdfs[app_data.current_brdf_idx]->sample_n(wi, samples, app_data.sampler);
                     for (int i = 0; i < 10000; i++) {
-                        lt::vec3 wo = app_data.brdfs[app_data.current_brdf_idx]->sample(wi, app_data.sampler).wo;
+                        lt::vec3 wo = samples[i].wo;
                         float phi = std::atan2(wo.y, wo.x);
                         phi = phi < 0 ? 2 * lt::pi + phi : phi;
                         float x = phi / (2. * lt::pi) * (float)app_data.s_brdf_sampling->w;
@@ -673,15 +720,21 @@ static void AppLayout(GLFWwindow* window, AppData& app_data)
                     //}
 
 
+                    static lt::vec3 wos[10000];
+                    static float pdfs[10000];
+                    for (int i = 0; i < 10000; i++)
+                        wos[i] = lt::square_to_cosine_hemisphere(app_data.sampler.next_float(), app_data.sampler.next_float());
+                    app_data.brdfs[app_data.current_brdf_idx]->pdf_n(wi, wos, pdfs);
+
                     for (int i = 0; i < 10000; i++) {
-                        lt::vec3 wo = lt::square_to_cosine_hemisphere(app_data.sampler.next_float(), app_data.sampler.next_float());
+                        lt::vec3 wo = wos[i];
                         float phi = std::atan2(wo.y, wo.x);
                         phi = phi < 0 ? 2 * lt::pi + phi : phi;
                         int x = int(phi / (2. * lt::pi) * (float)app_data.s_brdf_sampling->w);
                         int y = int(std::acos(wo.z) / (0.5 * lt::pi) * (float)app_data.s_brdf_sampling->h);
 
                         if (y < app_data.s_brdf_sampling->h) {
-                            app_data.s_brdf_sampling_pdf->add(x, y, lt::Spectrum(app_data.brdfs[app_data.current_brdf_idx]->pdf(wi, wo)));
+                            app_data.s_brdf_sampling_pdf->add(x, y, lt::Spectrum(pdfs[i]));
                             app_data.s_brdf_sampling_diff->set(x, y, (app_data.s_brdf_sampling_pdf->get(x, y) - app_data.s_brdf_sampling->get(x, y)));
                         }
                         else {
@@ -735,7 +788,7 @@ static void AppLayout(GLFWwindow* window, AppData& app_data)
                         ImPlot::EndPlot();
                     }
 
-                    render_overlay(app_data.ren_dir_light, work_pos);
+                    render_overlay(app_data.ren_dir_light, app_data.rsen_dir_light, work_pos);
 
                     ImGui::EndTabItem();
                 }
@@ -755,7 +808,7 @@ static void AppLayout(GLFWwindow* window, AppData& app_data)
                         ImPlot::EndPlot();
                     }
 
-                    render_overlay(app_data.ren_glo_ill, work_pos);
+                    render_overlay(app_data.ren_glo_ill, app_data.rsen_glo_ill, work_pos);
 
                     ImGui::EndTabItem();
                 }
@@ -763,8 +816,16 @@ static void AppLayout(GLFWwindow* window, AppData& app_data)
                 if (ImGui::BeginTabItem("Validation"))
                 {
 
-                    if (ImGui::Button("Run validation of current brdf model")) {
-                        app_data.validation = lt::BrdfValidation::validate(*app_data.brdfs[app_data.current_brdf_idx]);
+                    // The validation runs in the background, the result is picked up once ready
+                    if (app_data.validation_task.valid()) {
+                        if (app_data.validation_task.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+                            app_data.validation = app_data.validation_task.get();
+                        else
+                            ImGui::Text("Validation running...");
+                    }
+                    else if (ImGui::Button("Run validation of current brdf model")) {
+                        std::shared_ptr<lt::Brdf> brdf = app_data.brdfs[app_data.current_brdf_idx];
+                        app_data.validation_task = std::async(std::launch::async, [brdf]() { return lt::BrdfValidation::validate(*brdf); });
                     }
 
                     ImGui::SameLine();
@@ -780,11 +841,11 @@ static void AppLayout(GLFWwindow* window, AppData& app_data)
                     ImGui::Text("Correct sampling");
                     ImGui::PopStyleColor();
 
-                    ImGui::PushStyleColor(ImGuiCol_Text, app_data.validation.found_nan ? IM_COL32(0, 255, 0, 255) : IM_COL32(255, 0, 0, 255));
+                    ImGui::PushStyleColor(ImGuiCol_Text, app_data.validation.found_nan ? IM_COL32(255, 0, 0, 255) : IM_COL32(0, 255, 0, 255));
                     ImGui::Text("NaN");
                     ImGui::PopStyleColor();
 
-                    ImGui::PushStyleColor(ImGuiCol_Text, app_data.validation.negative_value ? IM_COL32(0, 255, 0, 255) : IM_COL32(255, 0, 0, 255));
+                    ImGui::PushStyleColor(ImGuiCol_Text, app_data.validation.negative_value ? IM_COL32(255, 0, 0, 255) : IM_COL32(0, 255, 0, 255));
                     ImGui::Text("Negative values");
                     ImGui::PopStyleColor();
 
@@ -803,12 +864,19 @@ static void AppLayout(GLFWwindow* window, AppData& app_data)
                         ImPlot::EndPlot();
                     }
 
-                    if (ImPlot::BeginPlot("Sampling difference", "theta", "mean signed difference", ImVec2(-1, 0), 0, ImPlotAxisFlags_Lock, ImPlotAxisFlags_AutoFit)) {
+                    if (ImPlot::BeginPlot("Sampling difference", "theta", "total variation distance", ImVec2(-1, 0), 0, ImPlotAxisFlags_Lock, ImPlotAxisFlags_AutoFit)) {
                         ImPlot::SetupAxisLimits(ImAxis_X1, 0, lt::pi / 2.);
                         ImPlot::PlotStems("", app_data.validation.thetas.data(), app_data.validation.sampling_difference.data(), app_data.validation.thetas.size(), 0.);
                         ImPlot::EndPlot();
                     }
 
+                    if (ImPlot::BeginPlot("Chi-square test", "theta", "p-value", ImVec2(-1, 0), 0, ImPlotAxisFlags_Lock, ImPlotAxisFlags_Lock)) {
+                        ImPlot::SetupAxisLimits(ImAxis_Y1, -0.1, 1.1);
+                        ImPlot::SetupAxisLimits(ImAxis_X1, 0, lt::pi / 2.);
+                        ImPlot::PlotStems("", app_data.validation.thetas.data(), app_data.validation.p_values.data(), app_data.validation.thetas.size(), 0.);
+                        ImPlot::EndPlot();
+                    }
+
 
                     ImGui::EndTabItem();
                 }
@@ -22,6 +22,7 @@ void generate(lt::Renderer& ren, lt::Scene& scn,const std::vector<glm::ivec2>& p
     int max_sample = 1024;
     float time = 0.;
     int next_sample = 1;
+    lt::ExrWriter writer;
 
     // init csv
     std::stringstream csv_stream;
@@ -45,18 +46,18 @@ void generate(lt::Renderer& ren, lt::Scene& scn,const std::vector<glm::ivec2>& p
         csv_stream << t << "\t";
         for (const auto& p : pix) {
             csv_stream << var_sensor->get(p.x, p.y).r << "\t";
-            csv_stream << var_sensor->acculumator[p.y * var_sensor->w + p.x].r << "\t";
+            csv_stream << var_sensor->pixels[p.y * var_sensor->w + p.x].sum.r << "\t";
         }
         csv_stream << "\n";
 
         // save sensor
         if (s == next_sample - 1) {
             std::string output_path = base_path + "_var_" + std::to_string(next_sample) + ".exr";
-            lt::save_sensor_exr(*ren.sensor, output_path);
+            writer.write(*ren.sensor, output_path);
 
             var_sensor->use_variance(false);
             output_path = base_path + "_" + std::to_string(next_sample) + ".exr";
-            lt::save_sensor_exr(*ren.sensor, output_path);
+            writer.write(*ren.sensor, output_path);
 
             next_sample = next_sample << 1;
         }
@@ -0,0 +1,184 @@
+#include <iostream>
+#include <lt/lt.h>
+
+void usage()
+{
+    std::cout << "usage : fastmath_validation [option]\n"
+              << "  --functions        compare each lt::fastmath function to the std one over its domain\n"
+              << "  --render ref.exr   render the reference scene and write it\n"
+              << "  --compare ref.exr  render the reference scene and compare it to ref.exr\n"
+              << "The approximations are used when the library is built with LT_FASTMATH, so --compare\n"
+              << "is run by the fastmath build against the image of the precise one.\n"
+              << "The exit code is 1 when an error is above its bound.\n";
+}
+
+/**
+ * @brief Prints the max error of a function and whether it is under its documented bound.
+ */
+bool report(const std::string& name, const double& max_error, const double& bound)
+{
+    bool passed = max_error <= bound;
+    std::cout << (passed ? "[passed] " : "[failed] ") << name << " : max error " << max_error << " (bound " << bound << ")" << std::endl;
+    return passed;
+}
+
+/**
+ * @brief Max errors of the approximations over a dense grid of their domain, against double precision.
+ */
+bool validate_functions()
+{
+    const int n = 1 << 21;
+    bool passed = true;
+
+    // Absolute error, |x| < 1e4
+    double e_sin = 0.;
+    double e_cos = 0.;
+    for (int i = 0; i <= n; i++) {
+        float x = -1e4f + 2e4f * float(i) / float(n);
+        float s, c;
+        lt::fastmath::sincos(x, s, c);
+        e_sin = std::max(e_sin, std::abs(s - std::sin(double(x))));
+        e_cos = std::max(e_cos, std::abs(c - std::cos(double(x))));
+    }
+    passed &= report("sin", e_sin, 1e-7);
+    passed &= report("cos", e_cos, 1e-7);
+
+    // Absolute error, over the directions of the unit circle and radii from 1e-3 to 1e3
+    double e_atan2 = 0.;
+    for (int i = 0; i < n; i++) {
+        double phi = 2. * lt::pi * i / double(n);
+        double r = std::pow(10., 6. * ((i * 7919) % 1024) / 1023. - 3.);
+        float y = float(r * std::sin(phi));
+        float x = float(r * std::cos(phi));
+        e_atan2 = std::max(e_atan2, std::abs(lt::fastmath::atan2(y, x) - std::atan2(double(y), double(x))));
+    }
+    passed &= report("atan2", e_atan2, 2e-6);
+
+    // Absolute error, [-1, 1]
+    double e_acos = 0.;
+    for (int i = 0; i <= n; i++) {
+        float x = -1.f + 2.f * float(i) / float(n);
+        e_acos = std::max(e_acos, std::abs(lt::fastmath::acos(x) - std::acos(double(x))));
+    }
+    passed &= report("acos", e_acos, 7e-5);
+
+    // Relative error, [-86, 88]
+    double e_exp = 0.;
+    for (int i = 0; i <= n; i++) {
+        float x = -86.f + 174.f * float(i) / float(n);
+        double ref = std::exp(double(x));
+        e_exp = std::max(e_exp, std::abs(lt::fastmath::exp(x) - ref) / ref);
+    }
+    passed &= report("exp", e_exp, 1e-5);
+
+    return passed;
+}
+
+/**
+ * @brief Renders a glossy and a diffuse sphere under an environment and a directional light.
+ *
+ * The environment is generated, so the scene only needs the working directory. The
+ * samplers are seeded from the pass and the block, both builds trace the same camera rays.
+ */
+bool render_reference(lt::Renderer& ren, lt::Scene& scn)
+{
+    lt::Sensor env(64, 32);
+    env.init();
+    for (uint32_t y = 0; y < env.h; y++)
+        for (uint32_t x = 0; x < env.w; x++) {
+            float u = (x + 0.5f) / env.w;
+            float v = (y + 0.5f) / env.h;
+            float sun = std::exp(-((u - 0.3f) * (u - 0.3f) + (v - 0.25f) * (v - 0.25f)) * 200.f) * 20.f;
+            env.set(x, y, lt::Spectrum(0.2f + 0.8f * u, 0.5f + 0.5f * std::cos(6.f * v), 1.f - v) + lt::Spectrum(sun));
+        }
+    if (lt::save_sensor_exr(env, "fastmath_env.exr") != 0)
+        return false;
+
+    bool loaded = lt::generate_from_json("./fastmath_validation.json", R"(
+        {
+            "integrator": { "type": "DirectIntegrator" },
+            "max_sample": 32,
+            "brdf": [
+                { "type": "RoughGGX", "name": "glossy", "rough_x": 0.2, "rough_y": 0.2 },
+                { "type": "Diffuse", "name": "diffuse", "albedo": [ 0.7, 0.5, 0.3 ] }
+            ],
+            "geometries": [
+                { "type": "Sphere", "brdf": "glossy", "pos": [ -0.6, 0.0, 0.0 ], "rad": 0.5 },
+                { "type": "Sphere", "brdf": "diffuse", "pos": [ 0.6, 0.0, 0.0 ], "rad": 0.5 }
+            ],
+            "light": [
+                { "type": "DirectionnalLight", "intensity": 1.0, "dir": [ -1.0, -1.0, -1.0 ] }
+            ],
+            "background": { "type": "EnvironmentLight", "texture": "fastmath_env.exr", "intensity": 1.0 },
+            "sensor": { "type": "Sensor", "width": 128, "height": 96 },
+            "camera": { "type": "PerspectiveCamera", "fov": 40, "aspect": 1.333, "center": [ 0.0, 0.0, 0.0 ], "pos": [ 0.0, 0.5, 3.0 ] }
+        }
+    )", scn, ren);
+    if (!loaded)
+        return false;
+
+    for (int s = 0; s < ren.max_sample; s++)
+        ren.render(scn);
+    ren.sensor->resolve();
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    lt::Log::level = lt::logWarning;
+
+    if (argc != 2 && argc != 3) {
+        usage();
+        return 1;
+    }
+
+    std::string option = argv[1];
+    if (option == "--functions" && argc == 2) {
+        std::cout << "fastmath " << (lt::fastmath::enabled ? "enabled" : "disabled") << " in the library" << std::endl;
+        return validate_functions() ? 0 : 1;
+    }
+
+    if ((option == "--render" || option == "--compare") && argc == 3) {
+        lt::Renderer ren;
+        lt::Scene scn;
+        if (!render_reference(ren, scn)) {
+            std::cerr << "Could not render the reference scene" << std::endl;
+            return 1;
+        }
+
+        if (option == "--render")
+            return lt::save_sensor_exr(*ren.sensor, argv[2]) == 0 ? 0 : 1;
+
+        float* ref;
+        int w;
+        int h;
+        const char* err = nullptr;
+        if (LoadEXR(&ref, &w, &h, argv[2], &err) != TINYEXR_SUCCESS) {
+            std::cerr << "Could not load " << argv[2] << " : " << err << std::endl;
+            FreeEXRErrorMessage(err);
+            return 1;
+        }
+
+        // Relative L1 error of the image, the fastmath tier is meant to stay under 1e-4
+        double diff = 0.;
+        double sum = 0.;
+        const lt::Sensor& image = *ren.sensor;
+        bool same_size = w == int(image.w) && h == int(image.h);
+        for (int i = 0; same_size && i < w * h; i++)
+            for (int c = 0; c < 3; c++) {
+                diff += std::abs(double(image.value[i][c]) - ref[4 * i + c]);
+                sum += std::abs(ref[4 * i + c]);
+            }
+        free(ref);
+
+        if (!same_size) {
+            std::cerr << argv[2] << " is not the image of the reference scene" << std::endl;
+            return 1;
+        }
+        std::cout << "fastmath " << (lt::fastmath::enabled ? "enabled" : "disabled") << " in the library" << std::endl;
+        return report("image", sum > 0. ? diff / sum : 0., 1e-4) ? 0 : 1;
+    }
+
+    usage();
+    return 1;
+}
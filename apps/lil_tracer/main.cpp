@@ -1,4 +1,6 @@
 #include <iostream>
+#include <chrono>
+#include <filesystem>
 #include <lt/lt.h>
 
 #define PBSTR "||||||||||||||||||||||||||||||||||||||||||||||||||||||||||||"
@@ -16,7 +18,50 @@ void printProgress(double percentage, float t) {
 int main(int argc, char* argv[])
 {
     lt::Log::level = lt::logWarning;
+
+    // Options apply to the scenes that follow them:
+    //   --resume         continue from the checkpoints
+    //   --part k/n dir   render the k-th of n ranges of passes, and write its sensor in dir
+    //   --merge dir      write the image of the parts found in dir instead of rendering
+    //   --crop x0,y0,x1,y1 / --crop-ndc x0,y0,x1,y1
+    //                    only render a window of the image, in pixels or in [0, 1]
+    bool resume = false;
+    bool crop = false;
+    bool crop_ndc = false;
+    float crop_window[4];
+    int part_index = 0;
+    int part_count = 1;
+    std::string part_dir;
+    std::string merge_dir;
     for (int a = 1; a < argc; a++) {
+        std::string arg = argv[a];
+        if (arg == "--resume") {
+            resume = true;
+            continue;
+        }
+        if (arg == "--part" && a + 2 < argc) {
+            if (std::sscanf(argv[a + 1], "%d/%d", &part_index, &part_count) != 2 || part_index < 0 || part_index >= part_count) {
+                std::cerr << "--part expects k/n with 0 <= k < n" << std::endl;
+                return 1;
+            }
+            part_dir = argv[a + 2];
+            a += 2;
+            continue;
+        }
+        if ((arg == "--crop" || arg == "--crop-ndc") && a + 1 < argc) {
+            if (std::sscanf(argv[a + 1], "%f,%f,%f,%f", &crop_window[0], &crop_window[1], &crop_window[2], &crop_window[3]) != 4) {
+                std::cerr << arg << " expects x0,y0,x1,y1" << std::endl;
+                return 1;
+            }
+            crop = true;
+            crop_ndc = arg == "--crop-ndc";
+            a++;
+            continue;
+        }
+        if (arg == "--merge" && a + 1 < argc) {
+            merge_dir = argv[++a];
+            continue;
+        }
 
         lt::Renderer ren;
         lt::Scene scn;
@@ -24,23 +69,112 @@ int main(int argc, char* argv[])
 
         lt::generate_from_path(argv[a], scn, ren);
 
+        // The crop window of the command line replaces the one of the scene
+        if (crop) {
+            if (crop_ndc)
+                ren.sensor->set_crop_ndc(crop_window[0], crop_window[1], crop_window[2], crop_window[3]);
+            else
+                ren.sensor->set_crop(int(crop_window[0]), int(crop_window[1]), int(crop_window[2]), int(crop_window[3]));
+            if (ren.stream_tile_size <= 0)
+                ren.sensor->init();
+        }
+
         float time = 0.;
+        std::string name = std::filesystem::path(argv[a]).filename().string();
+        std::string output_path = std::string(argv[a]) + ".exr";
+
+        // Streamed renders write their tiles as they complete, without progressive outputs, checkpoints or denoising
+        if (ren.stream_tile_size > 0) {
+            if (!part_dir.empty() || !merge_dir.empty()) {
+                std::cerr << "Streamed renders cannot be split in parts, " << argv[a] << " is skipped" << std::endl;
+                continue;
+            }
+            if (ren.denoiser)
+                std::cerr << "The denoiser needs the whole image, it is not applied to the streamed render of " << argv[a] << std::endl;
+
+            std::vector<lt::ExrAttribute> attributes = {
+                lt::ExrAttribute::from_int("passes", ren.max_sample),
+                lt::ExrAttribute::from_string("integrator", ren.integrator->type)
+            };
+            if (!lt::render_streamed(ren, scn, output_path, attributes, time, printProgress))
+                std::cerr << "\nCould not write " << output_path << std::endl;
+            std::cout << "\nTime elapsed : " << time << " (ms) " << std::endl;
+            continue;
+        }
 
-        for (int s = 0; s < ren.max_sample;  s++) {
+        // Without --part the whole render is the single part
+        lt::RenderPart part = lt::RenderPart::split(part_index, part_count, ren.max_sample);
+        std::string checkpoint_path = std::string(argv[a]) + (part_dir.empty() ? "" : "." + std::to_string(part.index) + "-" + std::to_string(part.count)) + ".ckpt";
+        int first_sample = part.first_pass;
+        int last_sample = part.first_pass + part.n_pass;
+        int passes = ren.max_sample;
+        ren.integrator->n_sample = first_sample + 1;
+
+        if (!merge_dir.empty()) {
+            passes = lt::merge_sensor_parts(ren, merge_dir, name, time);
+            if (passes < 0)
+                continue;
+            std::cout << "Merged " << passes << " passes of " << argv[a] << std::endl;
+            first_sample = last_sample;
+        } else if (resume) {
+            first_sample = std::max(lt::load_checkpoint(ren, checkpoint_path, time), first_sample);
+            if (first_sample > part.first_pass)
+                std::cout << "Resumed " << argv[a] << " after " << first_sample << " passes" << std::endl;
+        }
+
+        auto header = [&](const int& passes) {
+            return std::vector<lt::ExrAttribute> {
+                lt::ExrAttribute::from_int("passes", passes),
+                lt::ExrAttribute::from_float("renderTime", time),
+                lt::ExrAttribute::from_string("integrator", ren.integrator->type)
+            };
+        };
+
+        // Progressive outputs are compressed and written while the next passes render
+        lt::ExrWriter writer;
+
+        for (int s = first_sample; s < last_sample; s++) {
             float t = ren.render(scn);
 
             time += t;
 
-            printProgress(double(s) / double(ren.max_sample - 1.0), t);
+            printProgress(double(s - part.first_pass) / double(std::max(part.n_pass - 1, 1)), t);
+
+            if (part_dir.empty() && ren.output_interval > 0 && (s + 1) % ren.output_interval == 0 && s + 1 < last_sample)
+                writer.write(*ren.sensor, output_path, header(s + 1));
+
+            if (ren.checkpoint_interval > 0 && (s + 1) % ren.checkpoint_interval == 0 && s + 1 < last_sample
+                && !lt::save_checkpoint(ren, checkpoint_path, time))
+                std::cerr << "\nCould not write the checkpoint " << checkpoint_path << std::endl;
         }
 
         std::cout << "\nTime elapsed : " << time << " (ms) " << std::endl;
 
-        if (lt::save_sensor_exr(*ren.sensor, std::string(argv[a]) + ".exr") == 0) {
-            
+        if (!part_dir.empty()) {
+            if (!lt::save_sensor_part(ren, part_dir, name, part, time)) {
+                std::cerr << "Could not write the part " << part.path(part_dir, name) << std::endl;
+                continue;
+            }
+        } else {
+            if (ren.denoiser) {
+                auto start = std::chrono::high_resolution_clock::now();
+                ren.denoiser->apply(*ren.sensor, ren.sensor->value);
+                auto end = std::chrono::high_resolution_clock::now();
+                std::cout << "Denoised in " << std::chrono::duration<float, std::milli>(end - start).count() << " (ms) " << std::endl;
+            }
+
+            // The image must be on disk before its checkpoint is removed
+            writer.write(*ren.sensor, output_path, header(passes));
+            if (!writer.wait()) {
+                std::cerr << "Could not write " << output_path << ", the checkpoint is kept" << std::endl;
+                continue;
+            }
         }
-        
+
+        // The render is complete, its checkpoint would only resume to the same image
+        if (ren.checkpoint_interval > 0)
+            std::filesystem::remove(checkpoint_path);
     }
 
     return 0;
-}
\ No newline at end of file
+}
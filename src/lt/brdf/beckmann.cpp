@@ -8,14 +8,12 @@ namespace LT_NAMESPACE {
 ///////////////////
 
 Float BeckmannMicrosurface::D(const vec3& wh_u) {
-    Float cos_theta_h_sqr = wh_u.z * wh_u.z;
-    Float tan_theta_h_sqr = (1 - cos_theta_h_sqr) / cos_theta_h_sqr;
-    return std::exp(-tan_theta_h_sqr) / (cos_theta_h_sqr* cos_theta_h_sqr * pi);
+    return D_cos(wh_u.z);
 }
 
 Float BeckmannMicrosurface::pdf(const vec3& wh_u)
 {
-    return D(wh_u) * wh_u.z;
+    return pdf_cos(wh_u.z);
 }
 
 vec3 BeckmannMicrosurface::sample_D(Sampler& sampler)
@@ -26,20 +24,15 @@ vec3 BeckmannMicrosurface::sample_D(Sampler& sampler)
     Float phi = sampler.next_float() * 2 * pi;
     Float cos_theta = 1 / std::sqrt(1 + tan_theta_sqr);
     Float sin_theta = std::sqrt(std::max((Float)0, 1 - cos_theta * cos_theta));
-    vec3 wh_u = vec3(sin_theta * std::cos(phi), sin_theta * std::sin(phi), cos_theta);
+    Float sin_phi, cos_phi;
+    math::sincos(phi, sin_phi, cos_phi);
+    vec3 wh_u = vec3(sin_theta * cos_phi, sin_theta * sin_phi, cos_theta);
     return wh_u;
 }
 
 Float BeckmannMicrosurface::lambda(const vec3& wi_u)
 {
-    Float tan_theta_i_sqr = (1 - wi_u.z * wi_u.z) / (wi_u.z * wi_u.z);
-    Float abs_tan_theta = std::abs(std::sqrt(tan_theta_i_sqr));
-    if (std::isinf(abs_tan_theta)) return 0.;
-
-    Float a = 1 / (abs_tan_theta);
-    if (a >= 1.6f)
-        return 0;
-    return (1 - 1.259f * a + 0.396f * a * a) / (3.535f * a + 2.181f * a * a);
+    return lambda_cos(wi_u.z);
 }
 
 Float BeckmannMicrosurface::G1(const vec3& wh_u, const vec3& wi_u) {
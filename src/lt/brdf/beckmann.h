@@ -7,6 +7,27 @@ namespace LT_NAMESPACE {
 
 class BeckmannMicrosurface {
 public:
+    /** No analytic sampling of the visible normals, see ShapeInvariantMicrosurface::init. */
+    static constexpr bool analytic_visible_sampling = false;
+    static constexpr bool batched_kernels = true;
+
+    /**
+     * @brief D, pdf and lambda from the cosine of the direction, inlined in the batched kernels.
+     */
+    static Float D_cos(const Float& cos_theta_h)
+    {
+        Float cos_theta_h_sqr = cos_theta_h * cos_theta_h;
+        Float tan_theta_h_sqr = (1 - cos_theta_h_sqr) / cos_theta_h_sqr;
+        return std::exp(-tan_theta_h_sqr) / (cos_theta_h_sqr * cos_theta_h_sqr * pi);
+    }
+    static Float pdf_cos(const Float& cos_theta_h) { return D_cos(cos_theta_h) * cos_theta_h; }
+    static Float lambda_cos(const Float& cos_theta)
+    {
+        // a = 1 / tan(theta), lambda = 0 at the normal and, as before, at grazing angle
+        Float a = std::abs(cos_theta) / std::sqrt(std::max(1 - cos_theta * cos_theta, 0.f));
+        return a >= 1.6f || a == 0.f ? 0.f : (1 - 1.259f * a + 0.396f * a * a) / (3.535f * a + 2.181f * a * a);
+    }
+
     Float D(const vec3& wh_u);
     Float D(const vec3& wh_u, const vec3& wi_u);
 
@@ -43,6 +64,7 @@ protected:
         params.add("rough_y", Params::Type::FLOAT, &scale[1]);
         params.add("eta", Params::Type::IOR, &eta);
         params.add("kappa", Params::Type::IOR, &kappa);
+        params.add("sample_visible_distribution", Params::Type::BOOL, &sample_visible_distribution);
     }
 };
 
@@ -15,7 +15,9 @@ Brdf::Sample Brdf::sample(const vec3& wi, Sampler& sampler)
 { 
     Sample bs;
     bs.wo = square_to_cosine_hemisphere(sampler.next_float(), sampler.next_float());
-    bs.value = eval(wi, bs.wo, sampler) / pdf(wi, bs.wo);
+    Eval e = evaluate(wi, bs.wo, sampler);
+    bs.pdf = e.pdf;
+    bs.value = e.value / e.pdf;
     return bs;
 }
 
@@ -24,6 +26,86 @@ float Brdf::pdf(const vec3& wi, const vec3& wo)
     return square_to_cosine_hemisphere_pdf(wo); 
 }
 
+Brdf::Eval Brdf::evaluate(const vec3& wi, const vec3& wo, Sampler& sampler)
+{
+    return { eval(wi, wo, sampler), pdf(wi, wo) };
+}
+
+void Brdf::eval_n(const vec3& wi, std::span<const vec3> wo, std::span<Spectrum> out, Sampler& sampler)
+{
+    for (size_t i = 0; i < wo.size(); i++)
+        out[i] = eval(wi, wo[i], sampler);
+}
+
+void Brdf::pdf_n(const vec3& wi, std::span<const vec3> wo, std::span<Float> out)
+{
+    for (size_t i = 0; i < wo.size(); i++)
+        out[i] = pdf(wi, wo[i]);
+}
+
+void Brdf::sample_n(const vec3& wi, std::span<Sample> out, Sampler& sampler)
+{
+    for (size_t i = 0; i < out.size(); i++)
+        out[i] = sample(wi, sampler);
+}
+
+void Brdf::init_albedo_table()
+{
+    albedo_table = tabulate_directional_albedo([this](const vec3& wi, Sampler& sampler) { return sample(wi, sampler); });
+}
+
+Float Brdf::directional_albedo(const vec3& wi) const
+{
+    return channel_average(lookup_directional_albedo(albedo_table, wi));
+}
+
+Spectrum Brdf::directional_albedo_spectrum(const vec3& wi) const
+{
+    return lookup_directional_albedo(albedo_table, wi);
+}
+
+std::vector<Spectrum> tabulate_directional_albedo(const std::function<Brdf::Sample(const vec3&, Sampler&)>& sample)
+{
+    const int res = Brdf::albedo_table_res;
+    std::vector<Spectrum> table(res, Spectrum(0.));
+
+    auto tabulate_node = [&](const int& k, Sampler& sampler) {
+        Float cos_theta = (k + 0.5) / Float(res);
+        vec3 wi(std::sqrt(1.f - cos_theta * cos_theta), 0., cos_theta);
+
+        Spectrum sum(0.);
+        for (int i = 0; i < Brdf::albedo_table_samples; i++) {
+            Brdf::Sample bs = sample(wi, sampler);
+            if (bs.wo.z <= 0. || !(bs.pdf > 0.))
+                continue;
+            if (std::isfinite(channel_average(bs.value)))
+                sum += bs.value;
+        }
+        table[k] = sum / Float(Brdf::albedo_table_samples);
+    };
+
+    // Every node has its own seed, the table does not depend on the number of threads
+#pragma omp parallel for schedule(dynamic)
+    for (int k = 0; k < res; k++) {
+        Sampler sampler;
+        sampler.seed(k + 1);
+        tabulate_node(k, sampler);
+    }
+
+    return table;
+}
+
+Spectrum lookup_directional_albedo(const std::vector<Spectrum>& table, const vec3& wi)
+{
+    if (table.empty())
+        return Spectrum(1.);
+
+    Float x = glm::clamp(wi.z, 0.f, 1.f) * table.size() - 0.5f;
+    int k = glm::clamp(int(std::floor(x)), 0, int(table.size()) - 2);
+    Float t = glm::clamp(x - k, 0.f, 1.f);
+    return table.size() == 1 ? table[0] : (1.f - t) * table[k] + t * table[k + 1];
+}
+
 Spectrum Brdf::emission() 
 {
     return Spectrum(0.); 
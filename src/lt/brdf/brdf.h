@@ -10,6 +10,9 @@
 #include <lt/sampler.h>
 #include <lt/serialize.h>
 
+#include <functional>
+#include <span>
+
 namespace LT_NAMESPACE {
 #define PARAMETER(type, name, default_values) type name = type(default_values)
 
@@ -36,9 +39,15 @@ public:
     struct Sample {
         vec3 wo;
         Spectrum value; // brdf / pdf
+        Float pdf; // density of wo
         Flags flags;
     };
 
+    struct Eval {
+        Spectrum value; // brdf * cos_theta_o
+        Float pdf; // density of wo
+    };
+
     /**
      * @brief Constructor.
      * @param type The type of the BRDF.
@@ -59,7 +68,7 @@ public:
      * @brief Samples the BRDF.
      * @param wi Incident direction.
      * @param sampler The sampler object used for sampling.
-     * @return The sampled direction.
+     * @return The sampled direction, its density and brdf * cos_theta_o / pdf.
      */
     virtual Sample sample(const vec3& wi, Sampler& sampler);
 
@@ -69,6 +78,60 @@ public:
      * @return The density value.
      */
     virtual float pdf(const vec3& wi, const vec3& wo);
+
+    /**
+     * @brief Evaluates the BRDF * cos_theta_o and the density of wo at once.
+     * Override it when both share computations, the default calls eval and pdf.
+     * @param wi Incident direction.
+     * @param wo Outgoing direction.
+     * @param sampler The sampler object used for stochastic evaluations.
+     * @return The value of \ref eval and \ref pdf.
+     */
+    virtual Eval evaluate(const vec3& wi, const vec3& wo, Sampler& sampler);
+
+    /**
+     * @brief Batched \ref eval for a fixed wi, out[i] = eval(wi, wo[i]).
+     * The default loops over \ref eval, models with a vectorized kernel override it.
+     * @param wi Incident direction.
+     * @param wo Outgoing directions.
+     * @param out Evaluations, same size as wo.
+     * @param sampler The sampler object used for stochastic evaluations.
+     */
+    virtual void eval_n(const vec3& wi, std::span<const vec3> wo, std::span<Spectrum> out, Sampler& sampler);
+
+    /**
+     * @brief Batched \ref pdf for a fixed wi, out[i] = pdf(wi, wo[i]).
+     */
+    virtual void pdf_n(const vec3& wi, std::span<const vec3> wo, std::span<Float> out);
+
+    /**
+     * @brief Batched \ref sample for a fixed wi, fills every element of out.
+     */
+    virtual void sample_n(const vec3& wi, std::span<Sample> out, Sampler& sampler);
+
+    /**
+     * @brief Tabulate the directional albedo over cos(theta_i) with \ref sample.
+     * Lobe selections (see Mix) use it to pick lobes in proportion to their reflected energy.
+     */
+    void init_albedo_table();
+
+    /**
+     * @brief Directional albedo averaged over the channels, interpolated from the table.
+     * @param wi Incident direction.
+     * @return 1 when the table was not built.
+     */
+    Float directional_albedo(const vec3& wi) const;
+
+    /**
+     * @brief Directional albedo per channel, interpolated from the table, written in the albedo AOV.
+     * @param wi Incident direction.
+     * @return 1 when the table was not built.
+     */
+    Spectrum directional_albedo_spectrum(const vec3& wi) const;
+
+    std::vector<Spectrum> albedo_table; /**< Directional albedo, at the center of regular intervals of cos(theta_i). */
+    static constexpr int albedo_table_res = 32;
+    static constexpr int albedo_table_samples = 1024; /**< Samples per incident angle. */
     
     Flags flags;
     inline bool is_emissive() {
@@ -80,6 +143,27 @@ public:
 };
 
 
+/**
+ * @brief Monte Carlo directional albedo over cos(theta_i), the incident angles are processed in parallel.
+ * @param sample Sampling routine, the mean weight of its samples is the albedo.
+ * @return Brdf::albedo_table_res values, see Brdf::albedo_table.
+ */
+std::vector<Spectrum> tabulate_directional_albedo(const std::function<Brdf::Sample(const vec3&, Sampler&)>& sample);
+
+/**
+ * @brief Linear interpolation of a table built by \ref tabulate_directional_albedo.
+ * @return 1 for an empty table.
+ */
+Spectrum lookup_directional_albedo(const std::vector<Spectrum>& table, const vec3& wi);
+
+/**
+ * @brief Average of the channels, the albedo used to select lobes.
+ */
+inline Float channel_average(const Spectrum& s)
+{
+    return (s.x + s.y + s.z) / 3.f;
+}
+
 inline Brdf::Flags operator|(const Brdf::Flags& lhs, const Brdf::Flags& rhs)
 {
     return (Brdf::Flags)(static_cast<uint16_t>(lhs) | static_cast<uint16_t>(rhs));
@@ -8,9 +8,7 @@ namespace LT_NAMESPACE {
 
 Float SphereMicrosurface::lambda(const vec3& wi_u)
 {
-    Float cos_sqr = glm::clamp(wi_u.z * wi_u.z, 0.0001f, 0.9999f);
-    Float tan_sqr = (1. - cos_sqr) / cos_sqr;
-    return (-1. + std::sqrt(1. + tan_sqr)) / 2.;
+    return lambda_cos(wi_u.z);
 }
 
 Float SphereMicrosurface::G1(const vec3& wh_u, const vec3& wi_u) {
@@ -23,12 +21,12 @@ Float SphereMicrosurface::G2(const vec3& wh_u, const vec3& wi_u, const vec3& wo_
 }
 
 Float SphereMicrosurface::D(const vec3& wh_u) {
-    return 1. / pi; 
+    return D_cos(wh_u.z);
 }
 
 Float SphereMicrosurface::pdf(const vec3& wh_u)
 {
-    return square_to_cosine_hemisphere_pdf(wh_u);
+    return pdf_cos(wh_u.z);
 }
 vec3 SphereMicrosurface::sample_D(Sampler& sampler)
 {
@@ -51,8 +49,10 @@ vec3 SphereMicrosurface::sample_D(const vec3& wi_u, Sampler& sampler)
     float phi = 2. * pi * sampler.next_float();
     float z = std::fma(1. - sampler.next_float(), 1 + wi_u.z, -wi_u.z);
     float sin_theta = std::sqrt(std::clamp(1. - z * z, 0., 1.));
-    float x = sin_theta * std::cos(phi);
-    float y = sin_theta * std::sin(phi);
+    float sin_phi, cos_phi;
+    math::sincos(phi, sin_phi, cos_phi);
+    float x = sin_theta * cos_phi;
+    float y = sin_theta * sin_phi;
     return glm::normalize(wi_u + vec3(x, y, z));
 }
 
@@ -7,6 +7,21 @@ namespace LT_NAMESPACE {
 
 class SphereMicrosurface {
 public:
+    static constexpr bool analytic_visible_sampling = true;
+    static constexpr bool batched_kernels = true;
+
+    /**
+     * @brief D, pdf and lambda from the cosine of the direction, inlined in the batched kernels.
+     */
+    static Float D_cos(const Float& cos_theta_h) { return 1. / pi; }
+    static Float pdf_cos(const Float& cos_theta_h) { return glm::clamp(cos_theta_h, 0.f, 1.f) / pi; }
+    static Float lambda_cos(const Float& cos_theta)
+    {
+        Float cos_sqr = glm::clamp(cos_theta * cos_theta, 0.0001f, 0.9999f);
+        Float tan_sqr = (1. - cos_sqr) / cos_sqr;
+        return (-1. + std::sqrt(1. + tan_sqr)) / 2.;
+    }
+
     Float D(const vec3& wh_u);
     Float D(const vec3& wh_u, const vec3& wi_u);
 
@@ -71,6 +86,8 @@ protected:
         params.add("rough_y", Params::Type::FLOAT, &scale[1]);
         params.add("albedo", Params::Type::VEC3, &albedo);
         params.add("sample_visible_distribution", Params::Type::BOOL, &sample_visible_distribution);
+        params.add("deterministic", Params::Type::BOOL, &deterministic);
+        params.add("eval_table_tolerance", Params::Type::FLOAT, &eval_table_tolerance);
     }
 };
 
@@ -15,6 +15,7 @@ Brdf::Sample Diffuse::sample(const vec3& wi, Sampler& sampler)
     Sample bs;
     bs.wo = square_to_cosine_hemisphere(sampler.next_float(), sampler.next_float());
     bs.value = albedo;
+    bs.pdf = square_to_cosine_hemisphere_pdf(bs.wo);
     return bs;
 }
 
@@ -23,5 +24,38 @@ float Diffuse::pdf(const vec3& wi, const vec3& wo)
     return square_to_cosine_hemisphere_pdf(wo);
 }
 
+Brdf::Eval Diffuse::evaluate(const vec3& wi, const vec3& wo, Sampler& sampler)
+{
+    Float cos_theta_o = glm::clamp(wo[2], 0.f, 1.f);
+    return { albedo / pi * cos_theta_o, cos_theta_o / pi };
+}
+
+void Diffuse::eval_n(const vec3& wi, std::span<const vec3> wo, std::span<Spectrum> out, Sampler& sampler)
+{
+    const Spectrum albedo_pi = albedo / pi;
+    for (size_t i = 0; i < wo.size(); i++)
+        out[i] = albedo_pi * glm::clamp(wo[i][2], 0.f, 1.f);
+}
+
+void Diffuse::pdf_n(const vec3& wi, std::span<const vec3> wo, std::span<Float> out)
+{
+    for (size_t i = 0; i < wo.size(); i++)
+        out[i] = glm::clamp(wo[i][2], 0.f, 1.f) / pi;
+}
+
+void Diffuse::sample_n(const vec3& wi, std::span<Sample> out, Sampler& sampler)
+{
+    // Random numbers first, then the mapping
+    for (size_t i = 0; i < out.size(); i++) {
+        out[i].wo.x = sampler.next_float();
+        out[i].wo.y = sampler.next_float();
+    }
+    for (size_t i = 0; i < out.size(); i++) {
+        out[i].wo = square_to_cosine_hemisphere(out[i].wo.x, out[i].wo.y);
+        out[i].value = albedo;
+        out[i].pdf = square_to_cosine_hemisphere_pdf(out[i].wo);
+    }
+}
+
 
 } // namespace LT_NAMESPACE
\ No newline at end of file
@@ -29,6 +29,11 @@ public:
     Spectrum eval(vec3 wi, vec3 wo, Sampler& sampler);
     Sample sample(const vec3& wi, Sampler& sampler);
     float pdf(const vec3& wi, const vec3& wo);
+    Eval evaluate(const vec3& wi, const vec3& wo, Sampler& sampler);
+
+    void eval_n(const vec3& wi, std::span<const vec3> wo, std::span<Spectrum> out, Sampler& sampler);
+    void pdf_n(const vec3& wi, std::span<const vec3> wo, std::span<Float> out);
+    void sample_n(const vec3& wi, std::span<Sample> out, Sampler& sampler);
 
 protected:
     void link_params() { params.add("albedo", Params::Type::VEC3, &albedo); }
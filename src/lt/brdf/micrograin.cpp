@@ -3,9 +3,53 @@
 
 namespace LT_NAMESPACE {
 
+    // Table bounds, same clamp as lambda_analytic
+    static constexpr Float lambda_table_cos_min = 0.00001;
+    static constexpr Float lambda_table_cos_max = 0.99999;
+    static constexpr int lambda_table_max_size = 1 << 16;
+
+    void MicrograinMicrosurface::init()
+    {
+        table_tau_0 = tau_0;
+        table_rho = -std::log(1 - tau_0) / pi;
+        lambda_table.clear();
+
+        if (!tabulated)
+            return;
+
+        auto lambda_cos = [&](const Float& cos_theta) {
+            return lambda_analytic(vec3(std::sqrt(1.f - cos_theta * cos_theta), 0., cos_theta)) * cos_theta;
+        };
+
+        // Double the resolution until the error at the middle of the cells is small enough
+        int n = 64;
+        Float error = 0.;
+        do {
+            n *= 2;
+            lambda_table.resize(n);
+            for (int i = 0; i < n; i++)
+                lambda_table[i] = lambda_cos(lambda_table_cos_min + (lambda_table_cos_max - lambda_table_cos_min) * i / Float(n - 1));
+
+            error = 0.;
+            for (int i = 0; i < n - 1; i++) {
+                Float cos_theta = lambda_table_cos_min + (lambda_table_cos_max - lambda_table_cos_min) * (i + 0.5f) / Float(n - 1);
+                Float g1 = 1. / (1. + lambda_cos(cos_theta) / cos_theta);
+                Float g1_table = 1. / (1. + 0.5f * (lambda_table[i] + lambda_table[i + 1]) / cos_theta);
+                error = std::max(error, std::abs(g1 - g1_table));
+            }
+        } while (error > table_tolerance && n < lambda_table_max_size);
+
+        if (error > table_tolerance)
+            Log(logWarning) << "MicrograinMicrosurface : lambda table error " << error << " above tolerance " << table_tolerance;
+    }
+
+    Float MicrograinMicrosurface::rho()
+    {
+        return tau_0 == table_tau_0 ? table_rho : -std::log(1 - tau_0) / pi;
+    }
+
     Float MicrograinMicrosurface::one_to_many(const Float& sigma_) {
-        Float rho = -std::log(1 - tau_0) / pi;
-        return  std::exp(-rho * sigma_);
+        return  std::exp(-rho() * sigma_);
     }
 
     Float MicrograinMicrosurface::tau_v(const vec3& wi_u) {
@@ -13,8 +57,7 @@ namespace LT_NAMESPACE {
     }
 
     Float MicrograinMicrosurface::D(const vec3& wh_u) {
-        Float rho = -std::log(1 - tau_0) / pi;
-        float D_ = rho * one_to_many(sigma_base(wh_u)) / (tau_0);
+        float D_ = rho() * one_to_many(sigma_base(wh_u)) / (tau_0);
         return D_;
     }
 
@@ -47,6 +90,18 @@ namespace LT_NAMESPACE {
     }
 
     Float MicrograinMicrosurface::lambda(const vec3& wi_u)
+    {
+        if (!tabulated || tau_0 != table_tau_0 || lambda_table.empty())
+            return lambda_analytic(wi_u);
+
+        Float cos_theta = glm::clamp(wi_u.z, lambda_table_cos_min, lambda_table_cos_max);
+        Float x = (cos_theta - lambda_table_cos_min) / (lambda_table_cos_max - lambda_table_cos_min) * (lambda_table.size() - 1);
+        int i = std::min(int(x), int(lambda_table.size()) - 2);
+        Float t = x - i;
+        return ((1.f - t) * lambda_table[i] + t * lambda_table[i + 1]) / cos_theta;
+    }
+
+    Float MicrograinMicrosurface::lambda_analytic(const vec3& wi_u)
     {
         constexpr Float beta = 1.;
         constexpr Float beta2 = 1.;
@@ -96,7 +151,7 @@ namespace LT_NAMESPACE {
     
     Float MicrograinMicrosurface::w_plus(const vec3& wi_u, const vec3& wo_u) {
         Float si_plus_so_minus_sn = pi * 0.5 * (1 / glm::clamp(wi_u.z, 0.00001f, 0.99999f) + 1 / glm::clamp(wo_u.z, 0.00001f, 0.99999f));
-        return 1 - std::exp(std::log(1. - tau_0) / pi  * si_plus_so_minus_sn);
+        return 1 - std::exp(-rho() * si_plus_so_minus_sn);
     }
 
     Float MicrograinMicrosurface::sigma_base(const vec3& wh_u) 
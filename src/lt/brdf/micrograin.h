@@ -7,11 +7,26 @@ namespace LT_NAMESPACE {
 
     class MicrograinMicrosurface {
     public:
+        /** No analytic sampling of the visible normals, see ShapeInvariantMicrosurface::init. */
+        static constexpr bool analytic_visible_sampling = false;
+        static constexpr bool batched_kernels = false;
+
         MicrograinMicrosurface() 
             : tau_0(0.1)
             , use_smith(false)
             , sig_asia_2023(false)
-            , height_and_direction(true)  {}
+            , height_and_direction(true)
+            , tabulated(true)
+            , table_tolerance(1e-4)
+            , table_tau_0(-1.)
+            , table_rho(0.) {}
+
+        /**
+         * @brief Tabulate lambda over cos(theta) for the current tau_0.
+         * The table is refined until the interpolated G1 = 1 / (1 + lambda)
+         * is within table_tolerance of the analytic one.
+         */
+        void init();
 
         Float D(const vec3& wh_u);
         Float D(const vec3& wh_u, const vec3& wi_u);
@@ -38,7 +53,16 @@ namespace LT_NAMESPACE {
         
         Float sigma(const vec3& wi_u);
         
+        /**
+         * @brief Smith lambda, read from the table when it matches tau_0.
+         */
         Float lambda(const vec3& wi_u);
+        Float lambda_analytic(const vec3& wi_u);
+
+        /**
+         * @brief Density of grains per unit area times their section, -log(1 - tau_0) / pi.
+         */
+        Float rho();
 
         // Eq 24. Siggraph Asia 2023
         Float w_plus(const vec3& wi_u, const vec3& wo_u);
@@ -49,6 +73,12 @@ namespace LT_NAMESPACE {
         bool use_smith;
         bool height_and_direction;
         bool sig_asia_2023;
+
+        bool tabulated; /**< Use the lambda table, false for the analytic validation path. */
+        Float table_tolerance; /**< Maximum error on G1 of the lambda table. */
+        std::vector<Float> lambda_table; /**< lambda * cos(theta), uniform in cos(theta). */
+        Float table_tau_0; /**< tau_0 used to build the table. */
+        Float table_rho;
     };
 
 
@@ -64,51 +94,130 @@ namespace LT_NAMESPACE {
             link_params();
         }
 
+        void init()
+        {
+            ms.init();
+            RoughShapeInvariantMicrosurface<MicrograinMicrosurface>::init();
+            init_lobe_albedo();
+        }
+
         Spectrum eval(vec3 wi, vec3 wo, Sampler& sampler) {
-            Spectrum surf_brdf = RoughShapeInvariantMicrosurface<MicrograinMicrosurface>::eval(wi, wo, sampler);
-            Spectrum base_brdf = base->eval(wi, wo, sampler);
-            
+            return evaluate(wi, wo, sampler).value;
+        }
+
+        Brdf::Eval evaluate(const vec3& wi, const vec3& wo, Sampler& sampler) {
+            return evaluate(wi, wo, base->evaluate(wi, wo, sampler));
+        }
+
+        /**
+         * @brief \ref evaluate knowing the evaluation of the base BRDF.
+         */
+        Brdf::Eval evaluate(const vec3& wi, const vec3& wo, const Brdf::Eval& base_eval) {
+            Query q = query(wi, wo);
+            Brdf::Eval surf = RoughShapeInvariantMicrosurface<MicrograinMicrosurface>::evaluate(q, wi);
+
+            Float base_probability_ = base_probability(wi);
+            Float pdf_ = (1 - base_probability_) * surf.pdf + base_probability_ * base_eval.pdf;
+
             if (ms.sig_asia_2023) {
-                Float wei = ms.w_plus(to_unit_space(wi), to_unit_space(wo));
-                return wei * surf_brdf + (1.f - wei) * base_brdf;
+                Float wei = ms.w_plus(q.wi_u, q.wo_u);
+                return { wei * surf.value + (1.f - wei) * base_eval.value, pdf_ };
             }
 
-            Float visibility = ms.G2_0(to_unit_space(wi), to_unit_space(wo));
-            return ms.tau_0 * surf_brdf + (1.f - ms.tau_0) * base_brdf * visibility;
+            Float visibility = ms.G2_0(q.wi_u, q.wo_u);
+            return { ms.tau_0 * surf.value + (1.f - ms.tau_0) * base_eval.value * visibility, pdf_ };
+        }
+
+        /**
+         * @brief Share of the base BRDF in the reflection, ignoring the albedos.
+         * @param wi_u Incident direction in the unit space.
+         */
+        Float base_weight(const vec3& wi_u)
+        {
+            Float porosity = 1 - ms.tau_v(wi_u);
+            // Eq 26 Siggraph 2024
+            return porosity / (ms.tau_0 + porosity);
+        }
+
+        /**
+         * @brief Probability to sample the base BRDF, \ref base_weight scaled by
+         * the directional albedo of each lobe.
+         */
+        Float base_probability(const vec3& wi)
+        {
+            Float base_weight_ = base_weight(to_unit_space(wi));
+            Float base_albedo = std::max(base->directional_albedo(wi), min_selection_albedo);
+            Float surface_albedo = std::max(channel_average(lookup_directional_albedo(surface_albedo_table, wi)), min_selection_albedo);
+            return base_weight_ * base_albedo / (base_weight_ * base_albedo + (1 - base_weight_) * surface_albedo);
+        }
+
+        /**
+         * @brief Tabulate the directional albedo of the microsurface lobe, and of the base if needed.
+         */
+        void init_lobe_albedo()
+        {
+            surface_albedo_table = tabulate_directional_albedo([this](const vec3& wi, Sampler& sampler) { return surface_sample(wi, sampler); });
+            if (base && base->albedo_table.empty())
+                base->init_albedo_table();
+        }
+
+        /**
+         * @brief Sampling and density of the microsurface lobe alone.
+         */
+        Brdf::Sample surface_sample(const vec3& wi, Sampler& sampler)
+        {
+            return RoughShapeInvariantMicrosurface<MicrograinMicrosurface>::sample(wi, sampler);
+        }
+
+        Float surface_pdf(const vec3& wi, const vec3& wo)
+        {
+            return RoughShapeInvariantMicrosurface<MicrograinMicrosurface>::pdf(wi, wo);
         }
 
         Brdf::Sample sample(const vec3& wi, Sampler& sampler)
         {
-            Brdf::Sample bs;
+            return sample(wi, sampler,
+                [&] { return base->sample(wi, sampler); },
+                [&](const vec3& wo) { return evaluate(wi, wo, sampler); });
+        }
 
-            Float porosity = 1 - ms.tau_v(to_unit_space(wi));
-            // Eq 26 Siggraph 2024
-            Float base_weight = porosity / (ms.tau_0 + porosity);
-                       
-            if (sampler.next_float() < base_weight) {
-                bs = base->sample(wi, sampler);
-            }
-            else {
-                bs = RoughShapeInvariantMicrosurface<MicrograinMicrosurface>::sample(wi, sampler);
-            }
+        /**
+         * @brief Samples the base or the microsurface lobe, the weight and density are the ones of the whole BRDF.
+         * Shared with the material table, which samples and evaluates the base without virtual calls.
+         * @param sample_base Sampling of the base BRDF.
+         * @param evaluate_brdf Evaluation of the BRDF in the sampled direction.
+         */
+        template <class SAMPLE_BASE, class EVALUATE>
+        Brdf::Sample sample(const vec3& wi, Sampler& sampler, SAMPLE_BASE sample_base, EVALUATE evaluate_brdf)
+        {
+            Brdf::Sample bs = sampler.next_float() < base_probability(wi) ? sample_base() : surface_sample(wi, sampler);
 
-            Float pdf_ = (1 - base_weight) * RoughShapeInvariantMicrosurface<MicrograinMicrosurface>::pdf(wi, bs.wo) + base_weight * base->pdf(wi, bs.wo);
-            bs.value = eval(wi, bs.wo, sampler) / pdf_;
+            Brdf::Eval e = evaluate_brdf(bs.wo);
+            if (e.pdf <= 0.)
+                return { vec3(0., 0., -1.), Spectrum(0.), 0., flags };
+            bs.pdf = e.pdf;
+            bs.value = e.value / e.pdf;
 
             return bs;
         }
 
         Float pdf(const vec3& wi, const vec3& wo)
         {
+            return pdf(wi, wo, base->pdf(wi, wo));
+        }
 
-            Float porosity = 1 - ms.tau_v(to_unit_space(wi));
-            // Eq 26 Siggraph 2024
-            Float base_weight = porosity / (ms.tau_0 + porosity);
-           
-            return (1- base_weight) * RoughShapeInvariantMicrosurface<MicrograinMicrosurface>::pdf(wi,wo) + base_weight * base->pdf(wi,wo);
+        /**
+         * @brief \ref pdf knowing the density of the base BRDF.
+         */
+        Float pdf(const vec3& wi, const vec3& wo, const Float& base_pdf)
+        {
+            Float base_probability_ = base_probability(wi);
+            return (1 - base_probability_) * surface_pdf(wi, wo) + base_probability_ * base_pdf;
         }
         
         std::shared_ptr<Brdf> base;
+        std::vector<Spectrum> surface_albedo_table; /**< Directional albedo of the microsurface lobe. */
+        static constexpr Float min_selection_albedo = 0.05; /**< Keeps both lobes sampled, see Mix. */
 
     protected:
         void link_params()
@@ -120,7 +229,10 @@ namespace LT_NAMESPACE {
             params.add("kappa", Params::Type::IOR, &kappa);
             params.add("height_and_direction", Params::Type::BOOL, &(ms.height_and_direction));
             params.add("use_smith", Params::Type::BOOL, &(ms.use_smith));
+            params.add("tabulated", Params::Type::BOOL, &(ms.tabulated));
+            params.add("table_tolerance", Params::Type::FLOAT, &(ms.table_tolerance));
             params.add("sig_asia_2023", Params::Type::BOOL, &(ms.sig_asia_2023));
+            params.add("sample_visible_distribution", Params::Type::BOOL, &sample_visible_distribution);
             params.add("base", Params::Type::BRDF, &base);
         }
         
@@ -133,50 +245,136 @@ namespace LT_NAMESPACE {
 
         DiffuseMicrograin(const Float& scale_x = 0.1, const Float& scale_y = 0.1)
             : DiffuseShapeInvariantMicrosurface<MicrograinMicrosurface>("DiffuseMicrograin", scale_x, scale_y)
+            , eval_table_tau_0(-1.)
         {
             base = std::make_shared<Diffuse>(Spectrum(0.5));
             link_params();
         }
 
+        void init()
+        {
+            ms.init();
+            DiffuseShapeInvariantMicrosurface<MicrograinMicrosurface>::init();
+            eval_table_tau_0 = ms.tau_0;
+            init_lobe_albedo();
+        }
+
         Spectrum eval(vec3 wi, vec3 wo, Sampler & sampler) {
-            Spectrum surf_brdf = DiffuseShapeInvariantMicrosurface<MicrograinMicrosurface>::eval(wi, wo, sampler);
-            Spectrum base_brdf = base->eval(wi, wo, sampler);
+            return evaluate(wi, wo, sampler).value;
+        }
 
-            Float visibility = ms.G2_0(to_unit_space(wi), to_unit_space(wo));
-            return ms.tau_0 * surf_brdf + (1.f - ms.tau_0) * base_brdf * visibility;
+        Brdf::Eval evaluate(const vec3& wi, const vec3& wo, Sampler& sampler) {
+            return evaluate(wi, wo, sampler, base->evaluate(wi, wo, sampler));
         }
 
-        Brdf::Sample sample(const vec3 & wi, Sampler & sampler)
-        {
-            Brdf::Sample bs;
+        /**
+         * @brief \ref evaluate knowing the evaluation of the base BRDF.
+         */
+        Brdf::Eval evaluate(const vec3& wi, const vec3& wo, Sampler& sampler, const Brdf::Eval& base_eval) {
+            // The evaluation table is stale once tau changed
+            Spectrum surf_brdf = ms.tau_0 == eval_table_tau_0
+                ? DiffuseShapeInvariantMicrosurface<MicrograinMicrosurface>::eval(wi, wo, sampler)
+                : albedo * eval_stochastic(wi, wo, sampler);
+
+            vec3 wi_u = to_unit_space(wi);
+            Float base_probability_ = base_probability(wi);
+            Float pdf_ = (1 - base_probability_) * square_to_cosine_hemisphere_pdf(wo) + base_probability_ * base_eval.pdf;
+
+            Float visibility = ms.G2_0(wi_u, to_unit_space(wo));
+            return { ms.tau_0 * surf_brdf + (1.f - ms.tau_0) * base_eval.value * visibility, pdf_ };
+        }
 
-            Float porosity = 1 - ms.tau_v(to_unit_space(wi));
+        /**
+         * @brief Share of the base BRDF in the reflection, ignoring the albedos.
+         * @param wi_u Incident direction in the unit space.
+         */
+        Float base_weight(const vec3& wi_u)
+        {
+            Float porosity = 1 - ms.tau_v(wi_u);
             // Eq 26 Siggraph 2024
-            Float base_weight = porosity / (ms.tau_0 + porosity);
+            return porosity / (ms.tau_0 + porosity);
+        }
 
-            if (sampler.next_float() < base_weight) {
-                bs = base->sample(wi, sampler);
-            }
-            else {
-                bs = DiffuseShapeInvariantMicrosurface<MicrograinMicrosurface>::sample(wi, sampler);
-            }
+        /**
+         * @brief Probability to sample the base BRDF, \ref base_weight scaled by
+         * the directional albedo of each lobe.
+         */
+        Float base_probability(const vec3& wi)
+        {
+            Float base_weight_ = base_weight(to_unit_space(wi));
+            Float base_albedo = std::max(base->directional_albedo(wi), min_selection_albedo);
+            Float surface_albedo = std::max(channel_average(lookup_directional_albedo(surface_albedo_table, wi)), min_selection_albedo);
+            return base_weight_ * base_albedo / (base_weight_ * base_albedo + (1 - base_weight_) * surface_albedo);
+        }
 
-            Float pdf_ = (1 - base_weight) * DiffuseShapeInvariantMicrosurface<MicrograinMicrosurface>::pdf(wi, bs.wo) + base_weight * base->pdf(wi, bs.wo);
-            bs.value = eval(wi, bs.wo, sampler) / pdf_;
+        /**
+         * @brief Tabulate the directional albedo of the microsurface lobe, and of the base if needed.
+         */
+        void init_lobe_albedo()
+        {
+            surface_albedo_table = tabulate_directional_albedo([this](const vec3& wi, Sampler& sampler) { return surface_sample(wi, sampler); });
+            if (base && base->albedo_table.empty())
+                base->init_albedo_table();
+        }
+
+        /**
+         * @brief Sampling and density of the microsurface lobe alone.
+         */
+        Brdf::Sample surface_sample(const vec3& wi, Sampler& sampler)
+        {
+            return DiffuseShapeInvariantMicrosurface<MicrograinMicrosurface>::sample(wi, sampler);
+        }
+
+        Float surface_pdf(const vec3& wi, const vec3& wo)
+        {
+            return DiffuseShapeInvariantMicrosurface<MicrograinMicrosurface>::pdf(wi, wo);
+        }
+
+        Brdf::Sample sample(const vec3& wi, Sampler& sampler)
+        {
+            return sample(wi, sampler,
+                [&] { return base->sample(wi, sampler); },
+                [&](const vec3& wo) { return evaluate(wi, wo, sampler); });
+        }
+
+        /**
+         * @brief Samples the base or the microsurface lobe, the weight and density are the ones of the whole BRDF.
+         * Shared with the material table, which samples and evaluates the base without virtual calls.
+         * @param sample_base Sampling of the base BRDF.
+         * @param evaluate_brdf Evaluation of the BRDF in the sampled direction.
+         */
+        template <class SAMPLE_BASE, class EVALUATE>
+        Brdf::Sample sample(const vec3& wi, Sampler& sampler, SAMPLE_BASE sample_base, EVALUATE evaluate_brdf)
+        {
+            Brdf::Sample bs = sampler.next_float() < base_probability(wi) ? sample_base() : surface_sample(wi, sampler);
+
+            Brdf::Eval e = evaluate_brdf(bs.wo);
+            if (e.pdf <= 0.)
+                return { vec3(0., 0., -1.), Spectrum(0.), 0., flags };
+            bs.pdf = e.pdf;
+            bs.value = e.value / e.pdf;
 
             return bs;
         }
 
-        Float pdf(const vec3 & wi, const vec3 & wo)
+        Float pdf(const vec3& wi, const vec3& wo)
         {
-            Float porosity = 1 - ms.tau_v(to_unit_space(wi));
-            // Eq 26 Siggraph 2024
-            Float base_weight = porosity / (ms.tau_0 + porosity);
+            return pdf(wi, wo, base->pdf(wi, wo));
+        }
 
-            return (1 - base_weight) * DiffuseShapeInvariantMicrosurface<MicrograinMicrosurface>::pdf(wi, wo) + base_weight * base->pdf(wi, wo);
+        /**
+         * @brief \ref pdf knowing the density of the base BRDF.
+         */
+        Float pdf(const vec3& wi, const vec3& wo, const Float& base_pdf)
+        {
+            Float base_probability_ = base_probability(wi);
+            return (1 - base_probability_) * surface_pdf(wi, wo) + base_probability_ * base_pdf;
         }
 
         std::shared_ptr<Brdf> base;
+        Float eval_table_tau_0; /**< tau_0 used to build the evaluation table. */
+        std::vector<Spectrum> surface_albedo_table; /**< Directional albedo of the microsurface lobe. */
+        static constexpr Float min_selection_albedo = 0.05; /**< Keeps both lobes sampled, see Mix. */
 
     protected:
         void link_params()
@@ -186,6 +384,11 @@ namespace LT_NAMESPACE {
             params.add("tau", Params::Type::FLOAT, &(ms.tau_0));
             params.add("albedo", Params::Type::VEC3, &albedo);
             params.add("use_smith", Params::Type::BOOL, &(ms.use_smith));
+            params.add("tabulated", Params::Type::BOOL, &(ms.tabulated));
+            params.add("table_tolerance", Params::Type::FLOAT, &(ms.table_tolerance));
+            params.add("sample_visible_distribution", Params::Type::BOOL, &sample_visible_distribution);
+            params.add("deterministic", Params::Type::BOOL, &deterministic);
+            params.add("eval_table_tolerance", Params::Type::FLOAT, &eval_table_tolerance);
             params.add("base", Params::Type::BRDF, &base);
         }
     };
@@ -1,7 +1,74 @@
-#include "brdf.h"
+#include "mix.h"
 
 namespace LT_NAMESPACE {
 
+void Mix::init()
+{
+    flags = Flags(0);
+    for (int k = 0; k < lobe_count(); k++) {
+        Brdf* brdf = lobe(k);
+        if (!brdf)
+            continue;
+        flags = flags | brdf->flags;
+        // Lobes shared by several mixtures are tabulated once
+        if (brdf->albedo_table.empty())
+            brdf->init_albedo_table();
+    }
 
+    Float sum = 0.;
+    for (int k = 0; k < lobe_count(); k++)
+        sum += std::abs(lobe_weight(k));
+    if (sum <= 0.)
+        Log(logError) << "Mix : all the lobe weights are zero, the mixture is black and is not sampled";
+}
 
-} // namespace LT_NAMESPACE
\ No newline at end of file
+Spectrum Mix::eval(vec3 wi, vec3 wo, Sampler& sampler)
+{
+    Spectrum value(0.);
+    for (int k = 0; k < lobe_count(); k++)
+        value += lobe_weight(k) * lobe(k)->eval(wi, wo, sampler);
+    return value;
+}
+
+Brdf::Sample Mix::sample(const vec3& wi, Sampler& sampler)
+{
+    return sample_lobes(wi, sampler,
+        [&](const int& k) { return lobe(k)->sample(wi, sampler); },
+        [&](const vec3& wo) { return evaluate(wi, wo, sampler); });
+}
+
+Float Mix::pdf(const vec3& wi, const vec3& wo)
+{
+    return pdf_lobes(wi, [&](const int& k) { return lobe(k)->pdf(wi, wo); });
+}
+
+Brdf::Eval Mix::evaluate(const vec3& wi, const vec3& wo, Sampler& sampler)
+{
+    return evaluate_lobes(wi, [&](const int& k) { return lobe(k)->evaluate(wi, wo, sampler); });
+}
+
+Float Mix::selection_normalization(const vec3& wi) const
+{
+    Float sum = 0.;
+    for (int k = 0; k < lobe_count(); k++)
+        sum += selection_weight(wi, k);
+    return sum > 0. ? 1.f / sum : 0.f;
+}
+
+int Mix::select_lobe(const vec3& wi, const Float& u) const
+{
+    const Float normalization = selection_normalization(wi);
+    if (normalization <= 0.)
+        return 0;
+
+    Float target = u / normalization;
+    const int n = lobe_count();
+    for (int k = 0; k < n - 1; k++) {
+        target -= selection_weight(wi, k);
+        if (target < 0.)
+            return k;
+    }
+    return n - 1;
+}
+
+} // namespace LT_NAMESPACE
@@ -11,6 +11,13 @@
 
 namespace LT_NAMESPACE {
 
+/**
+ * @brief Weighted sum of BRDFs, sum_k weight_k * f_k.
+ * The lobes are either brdf1 and brdf2 with weight and 1 - weight, or the
+ * "brdfs" list with its "weights" when the list is not empty.
+ * Lobes are sampled in proportion to weight_k times their directional albedo
+ * for wi (see Brdf::init_albedo_table), so a dim lobe is rarely picked.
+ */
 class Mix : public Brdf {
 public:
     PARAMETER(Spectrum, albedo, 0.5); /**< Albedo of the surface. */
@@ -23,41 +30,128 @@ public:
         weight = 0.5;
     }
 
-    void init() {
-        flags = brdf1->flags | brdf2->flags;
+    /**
+     * @brief Gather the flags of the lobes and build their albedo tables.
+     */
+    void init();
+
+    Spectrum eval(vec3 wi, vec3 wo, Sampler& sampler);
+    Sample sample(const vec3& wi, Sampler& sampler);
+    Float pdf(const vec3& wi, const vec3& wo);
+    Eval evaluate(const vec3& wi, const vec3& wo, Sampler& sampler);
+
+    int lobe_count() const { return brdfs.empty() ? 2 : int(brdfs.size()); }
+
+    Brdf* lobe(const int& k) const
+    {
+        if (brdfs.empty())
+            return k == 0 ? brdf1.get() : brdf2.get();
+        return brdfs[k].get();
     }
 
-    Spectrum eval(vec3 wi, vec3 wo, Sampler& sampler) {
-        return weight * brdf1->eval(wi, wo, sampler) + (1.f - weight) * brdf2->eval(wi, wo, sampler);
+    /**
+     * @brief Weight of the lobe in the sum. Without weights the lobes of the list are averaged.
+     */
+    Float lobe_weight(const int& k) const
+    {
+        if (brdfs.empty())
+            return k == 0 ? weight : 1.f - weight;
+        if (weights.empty())
+            return 1.f / brdfs.size();
+        return k < int(weights.size()) ? weights[k] : 0.f;
     }
 
+    /**
+     * @brief Unnormalized probability to sample the lobe for wi.
+     * The albedo is bounded below so lobes stay sampled where they are not null.
+     */
+    Float selection_weight(const vec3& wi, const int& k) const
+    {
+        return std::abs(lobe_weight(k)) * std::max(lobe(k)->directional_albedo(wi), min_selection_albedo);
+    }
+
+    /**
+     * @brief Inverse of the sum of \ref selection_weight over the lobes.
+     */
+    Float selection_normalization(const vec3& wi) const;
+
+    /**
+     * @brief Pick a lobe with probability selection_weight * selection_normalization.
+     * The first lobe is returned when no lobe has a weight.
+     * @param u Uniform random number.
+     */
+    int select_lobe(const vec3& wi, const Float& u) const;
 
-    Sample sample(const vec3& wi, Sampler& sampler) 
+    /**
+     * @brief Sum of the lobes, weighted by lobe_weight in value and by their selection in density.
+     * Shared with the material table, which evaluates the lobes without virtual calls.
+     * @param evaluate_lobe Evaluation of the lobe k in the direction.
+     */
+    template <class EVALUATE_LOBE>
+    Eval evaluate_lobes(const vec3& wi, EVALUATE_LOBE evaluate_lobe) const
     {
-        Sample bs;
-        if (sampler.next_float() < weight) {
-            bs = brdf1->sample(wi, sampler);
+        Eval e = { Spectrum(0.), 0. };
+        for (int k = 0; k < lobe_count(); k++) {
+            Eval e_k = evaluate_lobe(k);
+            e.value += lobe_weight(k) * e_k.value;
+            e.pdf += selection_weight(wi, k) * e_k.pdf;
         }
-        else {
-            bs = brdf2->sample(wi, sampler);
-        }
-        return bs;
+        e.pdf *= selection_normalization(wi);
+        return e;
+    }
+
+    /**
+     * @brief Density of the lobe selection, see \ref evaluate_lobes.
+     * @param pdf_lobe Density of the lobe k in the direction.
+     */
+    template <class PDF_LOBE>
+    Float pdf_lobes(const vec3& wi, PDF_LOBE pdf_lobe) const
+    {
+        Float pdf_ = 0.;
+        for (int k = 0; k < lobe_count(); k++)
+            pdf_ += selection_weight(wi, k) * pdf_lobe(k);
+        return pdf_ * selection_normalization(wi);
     }
 
-    Float pdf(const vec3& wi, const vec3& wo) {
-        return weight * brdf1->pdf(wi, wo) + (1.f - weight) * brdf2->pdf(wi, wo);
+    /**
+     * @brief Samples a selected lobe, the weight and density are the ones of the mixture.
+     * Without any weighted lobe, or without density in the sampled direction,
+     * the sample is below the surface and ends the path.
+     * @param sample_lobe Sampling of the lobe k.
+     * @param evaluate_mix Evaluation of the mixture in the sampled direction.
+     */
+    template <class SAMPLE_LOBE, class EVALUATE>
+    Sample sample_lobes(const vec3& wi, Sampler& sampler, SAMPLE_LOBE sample_lobe, EVALUATE evaluate_mix) const
+    {
+        if (selection_normalization(wi) <= 0.)
+            return { vec3(0., 0., -1.), Spectrum(0.), 0., flags };
+
+        Sample bs = sample_lobe(select_lobe(wi, sampler.next_float()));
+        Eval e = evaluate_mix(bs.wo);
+        if (e.pdf <= 0.)
+            return { vec3(0., 0., -1.), Spectrum(0.), 0., flags };
+        bs.pdf = e.pdf;
+        bs.value = e.value / e.pdf;
+        return bs;
     }
 
     std::shared_ptr<Brdf> brdf1;
     std::shared_ptr<Brdf> brdf2;
     Float weight;
 
+    std::vector<std::shared_ptr<Brdf>> brdfs; /**< Lobes, replace brdf1 and brdf2 when not empty. */
+    std::vector<float> weights; /**< Weights of brdfs. */
+
+    static constexpr Float min_selection_albedo = 0.05;
+
 protected:
     void link_params() 
     { 
         params.add("brdf1", Params::Type::BRDF, &brdf1);
         params.add("brdf2", Params::Type::BRDF, &brdf2);
         params.add("weight", Params::Type::FLOAT, &weight);
+        params.add("brdfs", Params::Type::BRDFS, &brdfs);
+        params.add("weights", Params::Type::FLOATS, &weights);
     }
 };
 
@@ -18,6 +18,12 @@ public:
         sample_visible_distribution = false;
     }
 
+    /**
+     * @brief Tabulate the visible normal distribution when the microsurface
+     * has no analytic sampling of it (MICROSURFACE::analytic_visible_sampling).
+     */
+    void init();
+
     vec3 to_unit_space(const vec3& wi);
     vec3 to_transformed_space(const vec3& wi);
     
@@ -33,6 +39,25 @@ public:
 
     vec3 sample_D(Sampler& sampler);
     vec3 sample_D(const vec3& wi, Sampler& sampler);
+
+    /**
+     * @brief Vectors of a (wi, wo) pair mapped once to the unit microsurface,
+     * shared by D, G2 and pdf_wh.
+     */
+    struct Query {
+        vec3 wh; /**< Half vector. */
+        vec3 wh_u; /**< Half vector in the transformed space. */
+        vec3 wi_u; /**< wi in the unit space. */
+        vec3 wo_u; /**< wo in the unit space. */
+        Float det_m; /**< Inverse determinant of the scale. */
+        Float ratio; /**< wh_u.z / wh.z */
+    };
+
+    Query query(const vec3& wi, const vec3& wo);
+    Query query(const vec3& wh, const vec3& wi, const vec3& wo);
+    Float D(const Query& q);
+    Float G2(const Query& q);
+    Float pdf_wh(const Query& q);
     
     //virtual Sample sample(const vec3& wi, Sampler& sampler) = 0;
     //virtual Spectrum eval(vec3 wi, vec3 wo) = 0;
@@ -41,6 +66,35 @@ public:
     MICROSURFACE ms;
     bool sample_visible_distribution;
     bool optimize;
+
+    static constexpr int visible_table_theta_res = 32; /**< Incident angles of the table. */
+    static constexpr int visible_table_cos_res = 32; /**< Rows in cos(theta_h). */
+    static constexpr int visible_table_phi_res = 64; /**< Columns in phi_h. */
+
+protected:
+    /**
+     * @brief Use the tabulated visible normals for sample_D(wi) and pdf_wh(wh, wi).
+     */
+    bool use_visible_table();
+
+    /**
+     * @brief Sample the tabulated visible normals in the unit space.
+     */
+    vec3 sample_visible_table(const vec3& wi_u, Sampler& sampler);
+
+    /**
+     * @brief Density of \ref sample_visible_table.
+     */
+    Float pdf_visible_table(const vec3& wh_u, const vec3& wi_u);
+
+    /**
+     * @brief Density of the cell of wh_u, given in the frame where phi_i = 0, for the slice k.
+     */
+    Float visible_table_density(const int& k, const vec3& wh_u);
+
+    std::vector<Float> visible_density; /**< Density per solid angle of each cell, per slice. */
+    std::vector<Float> visible_row_cdf; /**< Cumulative density of the rows, per slice. */
+    std::vector<Float> visible_cell_cdf; /**< Cumulative density of the cells inside their row, per slice. */
 };
 
 
@@ -77,7 +131,7 @@ Float ShapeInvariantMicrosurface<MICROSURFACE>::D(const vec3& wh)
 {
     Float det_m = 1. / std::abs(scale.x * scale.y);
     vec3 wh_u = to_transformed_space(wh);
-    return ms.D(wh_u) * det_m * std::pow(wh_u.z / wh.z, 4.);
+    return ms.D(wh_u) * det_m * pow4(wh_u.z / wh.z);
 }
 
 template <class MICROSURFACE>
@@ -85,7 +139,7 @@ Float ShapeInvariantMicrosurface<MICROSURFACE>::pdf_wh(const vec3& wh)
 {
     Float det_m = 1. / std::abs(scale.x * scale.y);
     vec3 wh_u = to_transformed_space(wh);
-    return ms.pdf(wh_u) * det_m * std::pow(wh_u.z / wh.z, 3.);
+    return ms.pdf(wh_u) * det_m * pow3(wh_u.z / wh.z);
 }
 
 template <class MICROSURFACE>
@@ -94,7 +148,7 @@ Float ShapeInvariantMicrosurface<MICROSURFACE>::D(const vec3& wh, const vec3& wi
     Float det_m = 1. / std::abs(scale.x * scale.y);
     vec3 wh_u = to_transformed_space(wh);
     vec3 wi_u = to_unit_space(wi);
-    return ms.D(wh_u, wi_u) * det_m * std::pow(wh_u.z / wh.z, 3.);
+    return ms.D(wh_u, wi_u) * det_m * pow3(wh_u.z / wh.z);
 }
 
 template <class MICROSURFACE>
@@ -103,7 +157,9 @@ Float ShapeInvariantMicrosurface<MICROSURFACE>::pdf_wh(const vec3& wh, const vec
     Float det_m = 1. / std::abs(scale.x * scale.y);
     vec3 wh_u = to_transformed_space(wh);
     vec3 wi_u = to_unit_space(wi);
-    return ms.pdf(wh_u, wi_u) * det_m * std::pow(wh_u.z / wh.z, 3.);
+    Float pdf_u = use_visible_table() ? pdf_visible_table(wh_u, wi_u)
+        : MICROSURFACE::analytic_visible_sampling ? ms.pdf(wh_u, wi_u) : ms.pdf(wh_u);
+    return pdf_u * det_m * pow3(wh_u.z / wh.z);
 }
 
 template <class MICROSURFACE>
@@ -115,9 +171,212 @@ vec3 ShapeInvariantMicrosurface<MICROSURFACE>::sample_D(Sampler& sampler)
 template <class MICROSURFACE>
 vec3 ShapeInvariantMicrosurface<MICROSURFACE>::sample_D(const vec3& wi, Sampler& sampler)
 {
+    if (use_visible_table())
+        return to_unit_space(sample_visible_table(to_unit_space(wi), sampler));
+    if constexpr (!MICROSURFACE::analytic_visible_sampling)
+        return sample_D(sampler);
     return to_unit_space(ms.sample_D(to_unit_space(wi), sampler));
 }
 
+template <class MICROSURFACE>
+void ShapeInvariantMicrosurface<MICROSURFACE>::init()
+{
+    visible_density.clear();
+    visible_row_cdf.clear();
+    visible_cell_cdf.clear();
+
+    if constexpr (MICROSURFACE::analytic_visible_sampling)
+        return;
+
+    const int n_theta = visible_table_theta_res;
+    const int n_cos = visible_table_cos_res;
+    const int n_phi = visible_table_phi_res;
+    const int n_sub = 2;
+    const Float cell_area = 2. * pi / Float(n_cos * n_phi);
+
+    visible_density.resize(n_theta * n_cos * n_phi);
+    visible_row_cdf.resize(n_theta * (n_cos + 1));
+    visible_cell_cdf.resize(n_theta * n_cos * (n_phi + 1));
+
+    for (int k = 0; k < n_theta; k++) {
+        Float theta_i = 0.5 * pi * k / Float(n_theta - 1);
+        Float cos_theta_i = std::max(std::cos(theta_i), 0.0001f);
+        vec3 wi_u = vec3(std::sqrt(1. - cos_theta_i * cos_theta_i), 0., cos_theta_i);
+
+        Float* density = &visible_density[k * n_cos * n_phi];
+        Float total = 0.;
+        for (int r = 0; r < n_cos; r++) {
+            for (int c = 0; c < n_phi; c++) {
+                // G1 * <wh, wi> * D, averaged over the cell
+                Float v = 0.;
+                for (int j = 0; j < n_sub * n_sub; j++) {
+                    Float cos_theta_h = std::max((r + (j / n_sub + 0.5f) / n_sub) / n_cos, 0.0001f);
+                    Float phi_h = 2. * pi * (c + (j % n_sub + 0.5f) / n_sub) / n_phi;
+                    Float sin_theta_h = std::sqrt(1. - cos_theta_h * cos_theta_h);
+                    vec3 wh_u = vec3(sin_theta_h * std::cos(phi_h), sin_theta_h * std::sin(phi_h), cos_theta_h);
+                    Float i_dot_h = glm::dot(wh_u, wi_u);
+                    if (i_dot_h > 0.)
+                        v += ms.G1(wh_u, wi_u) * i_dot_h * ms.D(wh_u);
+                }
+                density[r * n_phi + c] = std::max(v, 0.f) / (n_sub * n_sub);
+                total += density[r * n_phi + c];
+            }
+        }
+
+        // Small defensive density so that no cell crossed by the visible normals is missed
+        Float floor = 0.01 * total / Float(n_cos * n_phi);
+        total = 0.;
+        for (int i = 0; i < n_cos * n_phi; i++) {
+            density[i] += floor;
+            total += density[i];
+        }
+
+        Float* row_cdf = &visible_row_cdf[k * (n_cos + 1)];
+        row_cdf[0] = 0.;
+        for (int r = 0; r < n_cos; r++) {
+            Float* cell_cdf = &visible_cell_cdf[(k * n_cos + r) * (n_phi + 1)];
+            cell_cdf[0] = 0.;
+            for (int c = 0; c < n_phi; c++)
+                cell_cdf[c + 1] = cell_cdf[c] + density[r * n_phi + c];
+            row_cdf[r + 1] = row_cdf[r] + cell_cdf[n_phi];
+            for (int c = 1; c <= n_phi; c++)
+                cell_cdf[c] /= cell_cdf[n_phi];
+        }
+        for (int r = 1; r <= n_cos; r++)
+            row_cdf[r] /= total;
+
+        for (int i = 0; i < n_cos * n_phi; i++)
+            density[i] /= total * cell_area;
+    }
+}
+
+template <class MICROSURFACE>
+bool ShapeInvariantMicrosurface<MICROSURFACE>::use_visible_table()
+{
+    return !MICROSURFACE::analytic_visible_sampling && !visible_density.empty();
+}
+
+/**
+ * @brief Slice of the table and probability of the next one for wi_u.
+ */
+inline void visible_table_slice(const vec3& wi_u, const int& n_theta, int& k, Float& t)
+{
+    Float theta_i = math::acos(glm::clamp(wi_u.z, 0.f, 1.f));
+    Float x = theta_i / (0.5f * pi) * (n_theta - 1);
+    k = std::min(int(x), n_theta - 2);
+    t = x - k;
+}
+
+template <class MICROSURFACE>
+vec3 ShapeInvariantMicrosurface<MICROSURFACE>::sample_visible_table(const vec3& wi_u, Sampler& sampler)
+{
+    const int n_cos = visible_table_cos_res;
+    const int n_phi = visible_table_phi_res;
+
+    int k;
+    Float t;
+    visible_table_slice(wi_u, visible_table_theta_res, k, t);
+    if (sampler.next_float() < t)
+        k++;
+
+    Float u = sampler.next_float();
+    const Float* row_cdf = &visible_row_cdf[k * (n_cos + 1)];
+    int r = binary_search<Float>(row_cdf, u, n_cos + 1);
+    Float du = (u - row_cdf[r]) / std::max(row_cdf[r + 1] - row_cdf[r], 1e-12f);
+
+    Float v = sampler.next_float();
+    const Float* cell_cdf = &visible_cell_cdf[(k * n_cos + r) * (n_phi + 1)];
+    int c = binary_search<Float>(cell_cdf, v, n_phi + 1);
+    Float dv = (v - cell_cdf[c]) / std::max(cell_cdf[c + 1] - cell_cdf[c], 1e-12f);
+
+    Float cos_theta_h = (r + glm::clamp(du, 0.f, 1.f)) / n_cos;
+    Float phi_h = 2. * pi * (c + glm::clamp(dv, 0.f, 1.f)) / n_phi;
+    Float sin_theta_h = std::sqrt(std::max(0.f, 1.f - cos_theta_h * cos_theta_h));
+    Float sin_phi_h, cos_phi_h;
+    math::sincos(phi_h, sin_phi_h, cos_phi_h);
+    vec3 wh = vec3(sin_theta_h * cos_phi_h, sin_theta_h * sin_phi_h, cos_theta_h);
+
+    // Rotate from the frame where phi_i = 0
+    Float r_i = std::sqrt(wi_u.x * wi_u.x + wi_u.y * wi_u.y);
+    Float cos_phi_i = r_i > 0. ? wi_u.x / r_i : 1.;
+    Float sin_phi_i = r_i > 0. ? wi_u.y / r_i : 0.;
+    return vec3(cos_phi_i * wh.x - sin_phi_i * wh.y, sin_phi_i * wh.x + cos_phi_i * wh.y, wh.z);
+}
+
+template <class MICROSURFACE>
+Float ShapeInvariantMicrosurface<MICROSURFACE>::visible_table_density(const int& k, const vec3& wh_u)
+{
+    const int n_cos = visible_table_cos_res;
+    const int n_phi = visible_table_phi_res;
+
+    Float phi_h = math::atan2(wh_u.y, wh_u.x);
+    phi_h = phi_h < 0. ? phi_h + 2. * pi : phi_h;
+    int r = glm::clamp(int(wh_u.z * n_cos), 0, n_cos - 1);
+    int c = glm::clamp(int(phi_h / (2. * pi) * n_phi), 0, n_phi - 1);
+    return visible_density[(k * n_cos + r) * n_phi + c];
+}
+
+template <class MICROSURFACE>
+Float ShapeInvariantMicrosurface<MICROSURFACE>::pdf_visible_table(const vec3& wh_u, const vec3& wi_u)
+{
+    if (wh_u.z <= 0.)
+        return 0.;
+
+    int k;
+    Float t;
+    visible_table_slice(wi_u, visible_table_theta_res, k, t);
+
+    // Rotate to the frame where phi_i = 0
+    Float r_i = std::sqrt(wi_u.x * wi_u.x + wi_u.y * wi_u.y);
+    Float cos_phi_i = r_i > 0. ? wi_u.x / r_i : 1.;
+    Float sin_phi_i = r_i > 0. ? wi_u.y / r_i : 0.;
+    vec3 wh = vec3(cos_phi_i * wh_u.x + sin_phi_i * wh_u.y, -sin_phi_i * wh_u.x + cos_phi_i * wh_u.y, wh_u.z);
+
+    return (1.f - t) * visible_table_density(k, wh) + t * visible_table_density(k + 1, wh);
+}
+
+
+template <class MICROSURFACE>
+typename ShapeInvariantMicrosurface<MICROSURFACE>::Query ShapeInvariantMicrosurface<MICROSURFACE>::query(const vec3& wi, const vec3& wo)
+{
+    return query(glm::normalize(wi + wo), wi, wo);
+}
+
+template <class MICROSURFACE>
+typename ShapeInvariantMicrosurface<MICROSURFACE>::Query ShapeInvariantMicrosurface<MICROSURFACE>::query(const vec3& wh, const vec3& wi, const vec3& wo)
+{
+    Query q;
+    q.wh = wh;
+    q.wh_u = to_transformed_space(q.wh);
+    q.wi_u = to_unit_space(wi);
+    q.wo_u = to_unit_space(wo);
+    q.det_m = 1. / std::abs(scale.x * scale.y);
+    q.ratio = q.wh_u.z / q.wh.z;
+    return q;
+}
+
+template <class MICROSURFACE>
+Float ShapeInvariantMicrosurface<MICROSURFACE>::D(const Query& q)
+{
+    Float ratio_sqr = q.ratio * q.ratio;
+    return ms.D(q.wh_u) * q.det_m * ratio_sqr * ratio_sqr;
+}
+
+template <class MICROSURFACE>
+Float ShapeInvariantMicrosurface<MICROSURFACE>::G2(const Query& q)
+{
+    return ms.G2(q.wh_u, q.wi_u, q.wo_u);
+}
+
+template <class MICROSURFACE>
+Float ShapeInvariantMicrosurface<MICROSURFACE>::pdf_wh(const Query& q)
+{
+    Float pdf_u = !sample_visible_distribution ? ms.pdf(q.wh_u)
+        : use_visible_table() ? pdf_visible_table(q.wh_u, q.wi_u)
+        : MICROSURFACE::analytic_visible_sampling ? ms.pdf(q.wh_u, q.wi_u) : ms.pdf(q.wh_u);
+    return pdf_u * q.det_m * q.ratio * q.ratio * q.ratio;
+}
+
 
 /////////////////////
 // RoughShapeInvariantMicrosurface<MICROSURFACE>
@@ -132,40 +391,273 @@ public:
         Brdf::flags = Brdf::Flags::rough | Brdf::Flags::reflection;
         eta = Spectrum(1.);
         kappa = Spectrum(10000.);
+        mirror = false;
     }
 
+    using Query = typename ShapeInvariantMicrosurface<MICROSURFACE>::Query;
+
+    /**
+     * @brief Build the visible normals table and the Fresnel table of eta and kappa.
+     */
+    void init();
+
     Spectrum eval(vec3 wi, vec3 wo, Sampler& sampler);
     Brdf::Sample sample(const vec3& wi, Sampler& sampler);
     Float pdf(const vec3& wi, const vec3& wo);
+    Brdf::Eval evaluate(const vec3& wi, const vec3& wo, Sampler& sampler);
+
+    /**
+     * @brief \ref evaluate from an already computed query.
+     */
+    Brdf::Eval evaluate(const Query& q, const vec3& wi);
+    Float pdf(const Query& q, const vec3& wi);
 
     // Return eval / pdf
     Spectrum eval_optim(vec3 wi, vec3 wo, Sampler& sampler);
 
+    void eval_n(const vec3& wi, std::span<const vec3> wo, std::span<Spectrum> out, Sampler& sampler);
+    void pdf_n(const vec3& wi, std::span<const vec3> wo, std::span<Float> out);
+    void sample_n(const vec3& wi, std::span<Brdf::Sample> out, Sampler& sampler);
+
+    /**
+     * @brief Fresnel term, interpolated in the table when it is up to date with eta and kappa.
+     * @param cos_theta Cosine between the incident direction and the microfacet normal.
+     */
+    Spectrum fresnel(const Float& cos_theta) const;
+
     Spectrum eta;
     Spectrum kappa;
+
+    static constexpr int batch_size = 64; /**< Directions per block of the batched kernels. */
+    static constexpr int fresnel_table_res = 256; /**< Nodes of the Fresnel table, uniform in cos(theta). */
+    static constexpr Float mirror_tolerance = 1e-3; /**< Hemispherical loss of Fresnel under which the conductor is a perfect mirror. */
+
+protected:
+    /**
+     * @brief The table and the mirror flag were built for the current eta and kappa.
+     */
+    bool fresnel_table_current() const
+    {
+        return !fresnel_table.empty() && fresnel_eta == eta && fresnel_kappa == kappa;
+    }
+
+    std::vector<Spectrum> fresnel_table; /**< Fresnel term, uniform in cos(theta) over [0, 1]. */
+    Spectrum fresnel_eta; /**< eta when the table was built. */
+    Spectrum fresnel_kappa; /**< kappa when the table was built. */
+    bool mirror; /**< The Fresnel term is 1 in every channel, up to mirror_tolerance. */
+
+    /**
+     * @brief \ref evaluate over a block of at most batch_size directions, written as
+     * structure of arrays loops the compiler can vectorize. Needs MICROSURFACE::batched_kernels:
+     * static D_cos, pdf_cos, lambda_cos and a height-correlated G2.
+     * @param value Evaluations, nullptr to only compute the densities.
+     * @param pdf Densities.
+     */
+    void evaluate_block(const vec3& wi, const vec3* wo, const int& n, Spectrum* value, Float* pdf);
 };
 
+template <class MICROSURFACE>
+void RoughShapeInvariantMicrosurface<MICROSURFACE>::init()
+{
+    ShapeInvariantMicrosurface<MICROSURFACE>::init();
+
+    const int n = fresnel_table_res;
+    fresnel_table.resize(n);
+    for (int i = 0; i < n; i++)
+        fresnel_table[i] = fresnelConductor(Float(i) / (n - 1), eta, kappa);
+    fresnel_eta = eta;
+    fresnel_kappa = kappa;
+
+    // Hemispherical average of 1 - F, 2 int (1 - F(mu)) mu dmu
+    Spectrum loss(0.);
+    for (int i = 0; i < n - 1; i++) {
+        Float mu_0 = Float(i) / (n - 1), mu_1 = Float(i + 1) / (n - 1);
+        loss += (mu_1 - mu_0) * ((1.f - fresnel_table[i]) * mu_0 + (1.f - fresnel_table[i + 1]) * mu_1);
+    }
+    mirror = std::max({ std::abs(loss.x), std::abs(loss.y), std::abs(loss.z) }) < mirror_tolerance;
+}
 
 template <class MICROSURFACE>
-Spectrum RoughShapeInvariantMicrosurface<MICROSURFACE>::eval(vec3 wi, vec3 wo, Sampler& sampler)
+Spectrum RoughShapeInvariantMicrosurface<MICROSURFACE>::fresnel(const Float& cos_theta) const
+{
+    if (!fresnel_table_current())
+        return fresnelConductor(cos_theta, eta, kappa);
+    if (mirror)
+        return Spectrum(1.);
+
+    Float x = glm::clamp(cos_theta, 0.f, 1.f) * (fresnel_table_res - 1);
+    int i = std::min(int(x), fresnel_table_res - 2);
+    Float t = x - i;
+    return fresnel_table[i] + t * (fresnel_table[i + 1] - fresnel_table[i]);
+}
+
+template <class MICROSURFACE>
+void RoughShapeInvariantMicrosurface<MICROSURFACE>::evaluate_block(const vec3& wi, const vec3* wo, const int& n, Spectrum* value, Float* pdf)
+{
+    using Base = ShapeInvariantMicrosurface<MICROSURFACE>;
+
+    const vec3 scale = Base::scale;
+    const Float det_m = 1. / std::abs(scale.x * scale.y);
+    const vec3 wi_u = Base::to_unit_space(wi);
+    const Float lambda_i = MICROSURFACE::lambda_cos(wi_u.z);
+    const Float cos_theta_i = glm::clamp(wi[2], 0.0001f, 0.9999f);
+    const bool table = Base::sample_visible_distribution && Base::use_visible_table();
+    const bool analytic = Base::sample_visible_distribution && !table && MICROSURFACE::analytic_visible_sampling;
+
+    Float wh_u_x[batch_size], wh_u_y[batch_size], wh_u_z[batch_size];
+    Float ratio[batch_size], i_dot_h[batch_size], pdf_u[batch_size];
+
+    // Half vector, in the transformed space too
+    for (int i = 0; i < n; i++) {
+        Float hx = wi.x + wo[i].x, hy = wi.y + wo[i].y, hz = wi.z + wo[i].z;
+        Float inv_h = 1.f / std::sqrt(hx * hx + hy * hy + hz * hz);
+        hx *= inv_h;
+        hy *= inv_h;
+        hz *= inv_h;
+
+        Float ux = hx / scale.x, uy = hy / scale.y, uz = hz;
+        Float inv_u = 1.f / std::sqrt(ux * ux + uy * uy + uz * uz);
+        wh_u_x[i] = ux * inv_u;
+        wh_u_y[i] = uy * inv_u;
+        wh_u_z[i] = uz * inv_u;
+        ratio[i] = wh_u_z[i] / hz;
+        i_dot_h[i] = hx * wi.x + hy * wi.y + hz * wi.z;
+    }
+
+    // Density of the half vector in the unit space
+    if (table) {
+        for (int i = 0; i < n; i++)
+            pdf_u[i] = Base::pdf_visible_table(vec3(wh_u_x[i], wh_u_y[i], wh_u_z[i]), wi_u);
+    } else if (analytic) {
+        const Float norm = 1.f / ((1.f + lambda_i) * wi_u.z * pi);
+        for (int i = 0; i < n; i++)
+            pdf_u[i] = glm::clamp(wh_u_x[i] * wi_u.x + wh_u_y[i] * wi_u.y + wh_u_z[i] * wi_u.z, 0.f, 1.f) * norm;
+    } else {
+        for (int i = 0; i < n; i++)
+            pdf_u[i] = MICROSURFACE::pdf_cos(wh_u_z[i]);
+    }
+
+    for (int i = 0; i < n; i++)
+        pdf[i] = pdf_u[i] * det_m * ratio[i] * ratio[i] * ratio[i] / (4.f * glm::clamp(i_dot_h[i], 0.0001f, 0.9999f));
+
+    if (!value)
+        return;
+
+    // D * G2 / (4 cos_theta_i), then the Fresnel term per channel
+    Float dg[batch_size];
+    for (int i = 0; i < n; i++) {
+        Float ox = wo[i].x * scale.x, oy = wo[i].y * scale.y, oz = wo[i].z;
+        Float wo_u_z = oz / std::sqrt(ox * ox + oy * oy + oz * oz);
+        Float ratio_sqr = ratio[i] * ratio[i];
+        Float d = MICROSURFACE::D_cos(wh_u_z[i]) * det_m * ratio_sqr * ratio_sqr;
+        Float g = 1.f / (1.f + lambda_i + MICROSURFACE::lambda_cos(wo_u_z));
+        dg[i] = d * g / (4.f * cos_theta_i);
+    }
+
+    if (!fresnel_table_current()) {
+        for (int c = 0; c < 3; c++) {
+            const Float eta_c = eta[c], kappa_c = kappa[c];
+            for (int i = 0; i < n; i++)
+                value[i][c] = dg[i] * fresnelConductor(i_dot_h[i], eta_c, kappa_c);
+        }
+    } else if (mirror) {
+        for (int i = 0; i < n; i++)
+            value[i] = Spectrum(dg[i]);
+    } else {
+        for (int i = 0; i < n; i++)
+            value[i] = dg[i] * fresnel(i_dot_h[i]);
+    }
+}
+
+template <class MICROSURFACE>
+void RoughShapeInvariantMicrosurface<MICROSURFACE>::eval_n(const vec3& wi, std::span<const vec3> wo, std::span<Spectrum> out, Sampler& sampler)
+{
+    if constexpr (!MICROSURFACE::batched_kernels) {
+        Brdf::eval_n(wi, wo, out, sampler);
+    } else {
+        Float pdf[batch_size];
+        for (size_t i = 0; i < wo.size(); i += batch_size)
+            evaluate_block(wi, &wo[i], std::min<int>(batch_size, wo.size() - i), &out[i], pdf);
+    }
+}
+
+template <class MICROSURFACE>
+void RoughShapeInvariantMicrosurface<MICROSURFACE>::pdf_n(const vec3& wi, std::span<const vec3> wo, std::span<Float> out)
+{
+    if constexpr (!MICROSURFACE::batched_kernels) {
+        Brdf::pdf_n(wi, wo, out);
+    } else {
+        for (size_t i = 0; i < wo.size(); i += batch_size)
+            evaluate_block(wi, &wo[i], std::min<int>(batch_size, wo.size() - i), nullptr, &out[i]);
+    }
+}
+
+template <class MICROSURFACE>
+void RoughShapeInvariantMicrosurface<MICROSURFACE>::sample_n(const vec3& wi, std::span<Brdf::Sample> out, Sampler& sampler)
+{
+    if constexpr (!MICROSURFACE::batched_kernels) {
+        Brdf::sample_n(wi, out, sampler);
+    } else {
+        vec3 wo[batch_size];
+        Spectrum value[batch_size];
+        Float pdf[batch_size];
+        for (size_t i = 0; i < out.size(); i += batch_size) {
+            int n = std::min<int>(batch_size, out.size() - i);
+
+            // Microfacet normals are drawn in the order of the scalar sample
+            for (int j = 0; j < n; j++) {
+                vec3 wh = ShapeInvariantMicrosurface<MICROSURFACE>::sample_visible_distribution
+                    ? ShapeInvariantMicrosurface<MICROSURFACE>::sample_D(wi, sampler)
+                    : ShapeInvariantMicrosurface<MICROSURFACE>::sample_D(sampler);
+                wo[j] = glm::reflect(-wi, wh);
+            }
+
+            evaluate_block(wi, wo, n, value, pdf);
+
+            for (int j = 0; j < n; j++) {
+                out[i + j].wo = wo[j];
+                out[i + j].pdf = pdf[j];
+                out[i + j].value = value[j] / pdf[j];
+            }
+        }
+    }
+}
+
+template <class MICROSURFACE>
+Brdf::Eval RoughShapeInvariantMicrosurface<MICROSURFACE>::evaluate(const Query& q, const vec3& wi)
 {
-    vec3 wh = glm::normalize(wi + wo);
-    Float d = ShapeInvariantMicrosurface<MICROSURFACE>::D(wh);
-    Float g = ShapeInvariantMicrosurface<MICROSURFACE>::G2(wh, wi, wo);
-    Spectrum f = fresnelConductor(glm::dot(wh, wi), eta, kappa);
+    Float d = ShapeInvariantMicrosurface<MICROSURFACE>::D(q);
+    Float g = ShapeInvariantMicrosurface<MICROSURFACE>::G2(q);
+    Spectrum f = fresnel(glm::dot(q.wh, wi));
     Spectrum brdf = d * g * f / (4.f * glm::clamp(wi[2], 0.0001f, 0.9999f));
-    return brdf;
+    return { brdf, pdf(q, wi) };
+}
+
+template <class MICROSURFACE>
+Float RoughShapeInvariantMicrosurface<MICROSURFACE>::pdf(const Query& q, const vec3& wi)
+{
+    Float pdf_wh_ = ShapeInvariantMicrosurface<MICROSURFACE>::pdf_wh(q);
+    return pdf_wh_ / (4. * glm::clamp(glm::dot(q.wh, wi), 0.0001f, 0.9999f));
+}
+
+template <class MICROSURFACE>
+Brdf::Eval RoughShapeInvariantMicrosurface<MICROSURFACE>::evaluate(const vec3& wi, const vec3& wo, Sampler& sampler)
+{
+    return evaluate(ShapeInvariantMicrosurface<MICROSURFACE>::query(wi, wo), wi);
+}
+
+
+template <class MICROSURFACE>
+Spectrum RoughShapeInvariantMicrosurface<MICROSURFACE>::eval(vec3 wi, vec3 wo, Sampler& sampler)
+{
+    return evaluate(ShapeInvariantMicrosurface<MICROSURFACE>::query(wi, wo), wi).value;
 }
 
 template <class MICROSURFACE>
 Spectrum RoughShapeInvariantMicrosurface<MICROSURFACE>::eval_optim(vec3 wi, vec3 wo, Sampler& sampler)
 {
-    if (ShapeInvariantMicrosurface<MICROSURFACE>::optimize) {
-        return ShapeInvariantMicrosurface<MICROSURFACE>::sample_visible_distribution
-            ? eval(wi, wo, sampler) / pdf(wi, wo)
-            : eval(wi, wo, sampler) / pdf(wi, wo);
-    }
-    return eval(wi, wo, sampler) / pdf(wi, wo);
+    Brdf::Eval e = evaluate(ShapeInvariantMicrosurface<MICROSURFACE>::query(wi, wo), wi);
+    return e.value / e.pdf;
 }
 
 
@@ -179,13 +671,10 @@ Brdf::Sample RoughShapeInvariantMicrosurface<MICROSURFACE>::sample(const vec3& w
         : ShapeInvariantMicrosurface<MICROSURFACE>::sample_D(sampler);
 
     bs.wo = glm::reflect(-wi, wh);
-    //bs.wo = wh;
-
 
-    bs.value = eval_optim(wi, bs.wo, sampler);
-
-    //Float g = sample_visible_distribution ? G2(wh,wi, bs.wo)  / G1(wh,bs.wo) : G1(wh, wi) * G1(wh, bs.wo) * glm::dot(wi, wh) / (glm::clamp(wi[2], 0.0001f, 0.9999f) * glm::clamp(wh[2], 0.0001f, 0.9999f));
-    //bs.value = F * e;
+    Brdf::Eval e = evaluate(ShapeInvariantMicrosurface<MICROSURFACE>::query(wi, bs.wo), wi);
+    bs.pdf = e.pdf;
+    bs.value = e.value / e.pdf;
 
     return bs;
 }
@@ -193,20 +682,7 @@ Brdf::Sample RoughShapeInvariantMicrosurface<MICROSURFACE>::sample(const vec3& w
 template <class MICROSURFACE>
 Float RoughShapeInvariantMicrosurface<MICROSURFACE>::pdf(const vec3& wi, const vec3& wo)
 {
-
-    //Float pdf_wh_ = ShapeInvariantMicrosurface<MICROSURFACE>::sample_visible_distribution
-    //    ? ShapeInvariantMicrosurface<MICROSURFACE>::pdf_wh(wo, wi)
-    //    : ShapeInvariantMicrosurface<MICROSURFACE>::pdf_wh(wo);
-
-    //return pdf_wh_;
-
-    vec3 wh = glm::normalize(wi + wo);
-
-    Float pdf_wh_ = ShapeInvariantMicrosurface<MICROSURFACE>::sample_visible_distribution
-        ? ShapeInvariantMicrosurface<MICROSURFACE>::pdf_wh(wh, wi)
-        : ShapeInvariantMicrosurface<MICROSURFACE>::pdf_wh(wh);
-
-    return pdf_wh_ / (4. * glm::clamp(glm::dot(wh, wi), 0.0001f, 0.9999f));
+    return pdf(ShapeInvariantMicrosurface<MICROSURFACE>::query(wi, wo), wi);
 }
 
 /////////////////////
@@ -221,36 +697,201 @@ public:
     {
         Brdf::flags = Brdf::Flags::diffuse | Brdf::Flags::reflection;
         albedo = Spectrum(0.5);
+        deterministic = true;
+        eval_table_tolerance = 5e-3;
     }
 
+    /**
+     * @brief Build the visible normal table and, for an isotropic roughness,
+     * the deterministic evaluation table.
+     * Each node averages microfacet normals until its standard error is within
+     * eval_table_tolerance, the table is then checked against \ref eval_stochastic
+     * at the middle of the cells, a warning is logged when the RMS error exceeds twice the tolerance.
+     */
+    void init();
+
     Spectrum eval(vec3 wi, vec3 wo, Sampler& sampler);
     Brdf::Sample sample(const vec3& wi, Sampler& sampler);
     Float pdf(const vec3& wi, const vec3& wo);
+    Brdf::Eval evaluate(const vec3& wi, const vec3& wo, Sampler& sampler);
+
+    /**
+     * @brief One sample estimate of the BRDF times cos(theta_o), without the albedo.
+     * The microfacet normal is drawn from the sampler.
+     */
+    Float eval_stochastic(const vec3& wi, const vec3& wo, Sampler& sampler);
+
+    /**
+     * @brief Interpolated lookup of \ref eval_stochastic averaged over the microfacet normals.
+     */
+    Float eval_table_lookup(const vec3& wi, const vec3& wo);
+
+    /**
+     * @brief Use the evaluation table, false if the roughness changed since init().
+     */
+    bool use_eval_table();
 
     Spectrum albedo;
+    bool deterministic; /**< Evaluate from the table instead of sampling a microfacet normal. */
+    Float eval_table_tolerance; /**< Standard error of the nodes of the evaluation table, on the BRDF times cos(theta_o). */
+
+    static constexpr int eval_table_cos_res = 16; /**< Nodes in cos(theta_i) and cos(theta_o). */
+    static constexpr int eval_table_phi_res = 16; /**< Nodes in phi_o - phi_i over [0, pi]. */
+    static constexpr int eval_table_min_samples = 1024; /**< Microfacet normals averaged per node before checking the error. */
+    static constexpr int eval_table_max_samples = 65536; /**< Microfacet normals averaged per node at most. */
+    static constexpr Float eval_table_cos_min = 0.02; /**< cos(theta) of the directions of the first nodes. */
+
+protected:
+    /**
+     * @brief Average of \ref eval_stochastic, the samples are doubled until its standard error is within eval_table_tolerance.
+     */
+    Float eval_average(const vec3& wi, const vec3& wo, Sampler& sampler);
+
+    std::vector<Float> eval_table; /**< Indexed by [cos_theta_i][cos_theta_o][phi_d]. */
+    vec3 eval_table_scale; /**< Roughness the table was built for. */
 };
 
 
+template <class MICROSURFACE>
+void DiffuseShapeInvariantMicrosurface<MICROSURFACE>::init()
+{
+    ShapeInvariantMicrosurface<MICROSURFACE>::init();
+
+    eval_table.clear();
+    eval_table_scale = ShapeInvariantMicrosurface<MICROSURFACE>::scale;
+
+    // The table is parameterized by phi_o - phi_i, only valid for an isotropic roughness
+    if (!deterministic || eval_table_scale.x != eval_table_scale.y)
+        return;
+
+    const int n_cos = eval_table_cos_res;
+    const int n_phi = eval_table_phi_res;
+    eval_table.resize(n_cos * n_cos * n_phi);
+
+    // Directions at fractional node coordinates, the middle of the cells are checked with the same mapping.
+    // The estimator diverges at grazing angles, the first node holds the value just above them
+    auto direction = [](const Float& cos_theta, const Float& phi) {
+        Float c = std::max(cos_theta, eval_table_cos_min);
+        Float s = std::sqrt(1.f - c * c);
+        return vec3(s * std::cos(phi), s * std::sin(phi), c);
+    };
+
+    // One sampler per row of nodes, seeded by the row, the table does not depend on the threads
+#pragma omp parallel for schedule(dynamic)
+    for (int row = 0; row < n_cos * n_cos; row++) {
+        Sampler sampler;
+        sampler.seed(row + 1);
+        vec3 wi = direction((row / n_cos) / Float(n_cos - 1), 0.);
+        Float cos_theta_o = (row % n_cos) / Float(n_cos - 1);
+        for (int p = 0; p < n_phi; p++)
+            eval_table[row * n_phi + p] = eval_average(wi, direction(cos_theta_o, pi * p / Float(n_phi - 1)), sampler);
+    }
+
+    // RMS error over the middle of the cells, the estimates there have the same standard error as the nodes
+    double sum_sqr = 0.;
+#pragma omp parallel for schedule(dynamic) reduction(+ : sum_sqr)
+    for (int row = 0; row < (n_cos - 1) * (n_cos - 1); row++) {
+        Sampler sampler;
+        sampler.seed(n_cos * n_cos + row + 1);
+        vec3 wi = direction((row / (n_cos - 1) + 0.5f) / Float(n_cos - 1), 0.);
+        Float cos_theta_o = (row % (n_cos - 1) + 0.5f) / Float(n_cos - 1);
+        for (int p = 0; p < n_phi - 1; p++) {
+            vec3 wo = direction(cos_theta_o, pi * (p + 0.5f) / Float(n_phi - 1));
+            double e = eval_table_lookup(wi, wo) - eval_average(wi, wo, sampler);
+            sum_sqr += e * e;
+        }
+    }
+    Float error = std::sqrt(sum_sqr / ((n_cos - 1) * (n_cos - 1) * (n_phi - 1)));
+
+    if (error > 2 * eval_table_tolerance)
+        Log(logWarning) << this->type << " : evaluation table error " << error << " above tolerance " << eval_table_tolerance;
+}
+
+template <class MICROSURFACE>
+Float DiffuseShapeInvariantMicrosurface<MICROSURFACE>::eval_average(const vec3& wi, const vec3& wo, Sampler& sampler)
+{
+    double sum = 0.;
+    double sum_sqr = 0.;
+    int n = 0;
+    for (int batch = eval_table_min_samples; n < eval_table_max_samples; batch = n) {
+        for (int s = 0; s < batch; s++) {
+            double f = eval_stochastic(wi, wo, sampler);
+            sum += f;
+            sum_sqr += f * f;
+        }
+        n += batch;
+
+        double mean = sum / n;
+        if (std::sqrt(std::max(sum_sqr / n - mean * mean, 0.) / n) <= eval_table_tolerance)
+            break;
+    }
+    return sum / n;
+}
+
+template <class MICROSURFACE>
+bool DiffuseShapeInvariantMicrosurface<MICROSURFACE>::use_eval_table()
+{
+    return deterministic && !eval_table.empty() && eval_table_scale == ShapeInvariantMicrosurface<MICROSURFACE>::scale;
+}
+
+template <class MICROSURFACE>
+Float DiffuseShapeInvariantMicrosurface<MICROSURFACE>::eval_table_lookup(const vec3& wi, const vec3& wo)
+{
+    const int n_cos = eval_table_cos_res;
+    const int n_phi = eval_table_phi_res;
+
+    Float r_i = std::sqrt(wi.x * wi.x + wi.y * wi.y);
+    Float r_o = std::sqrt(wo.x * wo.x + wo.y * wo.y);
+    Float cos_phi_d = r_i > 0. && r_o > 0. ? (wi.x * wo.x + wi.y * wo.y) / (r_i * r_o) : 1.;
+
+    Float x_i = glm::clamp(wi.z, 0.f, 1.f) * (n_cos - 1);
+    Float x_o = glm::clamp(wo.z, 0.f, 1.f) * (n_cos - 1);
+    Float x_p = math::acos(glm::clamp(cos_phi_d, -1.f, 1.f)) / pi * (n_phi - 1);
+
+    int i = std::min(int(x_i), n_cos - 2);
+    int o = std::min(int(x_o), n_cos - 2);
+    int p = std::min(int(x_p), n_phi - 2);
+    Float t_i = x_i - i;
+    Float t_o = x_o - o;
+    Float t_p = x_p - p;
+
+    auto at = [&](const int& di, const int& d_o) {
+        const Float* row = &eval_table[((i + di) * n_cos + o + d_o) * n_phi + p];
+        return (1.f - t_p) * row[0] + t_p * row[1];
+    };
+
+    return (1.f - t_i) * ((1.f - t_o) * at(0, 0) + t_o * at(0, 1))
+        + t_i * ((1.f - t_o) * at(1, 0) + t_o * at(1, 1));
+}
+
+
 template <class MICROSURFACE>
 Spectrum DiffuseShapeInvariantMicrosurface<MICROSURFACE>::eval(vec3 wi, vec3 wo, Sampler& sampler)
+{
+    if (use_eval_table())
+        return albedo * eval_table_lookup(wi, wo);
+    return albedo * eval_stochastic(wi, wo, sampler);
+}
+
+template <class MICROSURFACE>
+Float DiffuseShapeInvariantMicrosurface<MICROSURFACE>::eval_stochastic(const vec3& wi, const vec3& wo, Sampler& sampler)
 {
     vec3 wh = ShapeInvariantMicrosurface<MICROSURFACE>::sample_visible_distribution
         ? ShapeInvariantMicrosurface<MICROSURFACE>::sample_D(wi, sampler)
         : ShapeInvariantMicrosurface<MICROSURFACE>::sample_D(sampler);
 
-    Float pdf_wh_ = ShapeInvariantMicrosurface<MICROSURFACE>::sample_visible_distribution
-        ? ShapeInvariantMicrosurface<MICROSURFACE>::pdf_wh(wh, wi)
-        : ShapeInvariantMicrosurface<MICROSURFACE>::pdf_wh(wh);
+    typename ShapeInvariantMicrosurface<MICROSURFACE>::Query q = ShapeInvariantMicrosurface<MICROSURFACE>::query(wh, wi, wo);
 
-    Float d = ShapeInvariantMicrosurface<MICROSURFACE>::D(wh);
-    Float g = ShapeInvariantMicrosurface<MICROSURFACE>::G2(wh, wi, wo);
+    Float pdf_wh_ = ShapeInvariantMicrosurface<MICROSURFACE>::pdf_wh(q);
+    Float d = ShapeInvariantMicrosurface<MICROSURFACE>::D(q);
+    Float g = ShapeInvariantMicrosurface<MICROSURFACE>::G2(q);
 
     Float i_dot_m = glm::clamp(glm::dot(wi, wh), 0.00001f, 0.99999f);
     Float o_dot_m = glm::clamp(glm::dot(wo, wh), 0.00001f, 0.99999f);
     Float cos_theta_i = glm::clamp(wi[2], 0.00001f, 0.99999f);
 
     Float brdf = i_dot_m * o_dot_m * d * g / pdf_wh_;
-    return albedo * brdf / cos_theta_i / pi;
+    return brdf / cos_theta_i / pi;
 }
 
 
@@ -260,7 +901,8 @@ Brdf::Sample DiffuseShapeInvariantMicrosurface<MICROSURFACE>::sample(const vec3&
     Brdf::Sample bs;
 
     bs.wo = square_to_cosine_hemisphere(sampler.next_float(), sampler.next_float());
-    bs.value = eval(wi, bs.wo, sampler) / ShapeInvariantMicrosurface<MICROSURFACE>::pdf(wi, bs.wo);
+    bs.pdf = square_to_cosine_hemisphere_pdf(bs.wo);
+    bs.value = eval(wi, bs.wo, sampler) / bs.pdf;
 
     return bs;
 }
@@ -271,5 +913,11 @@ Float DiffuseShapeInvariantMicrosurface<MICROSURFACE>::pdf(const vec3& wi, const
     return square_to_cosine_hemisphere_pdf(wo);
 }
 
+template <class MICROSURFACE>
+Brdf::Eval DiffuseShapeInvariantMicrosurface<MICROSURFACE>::evaluate(const vec3& wi, const vec3& wo, Sampler& sampler)
+{
+    return { eval(wi, wo, sampler), square_to_cosine_hemisphere_pdf(wo) };
+}
+
 
 } // namespace LT_NAMESPACE
\ No newline at end of file
@@ -0,0 +1,410 @@
+#include "tabulated.h"
+
+#include <cstring>
+#include <fstream>
+
+namespace LT_NAMESPACE {
+
+static const char tabulated_brdf_magic[8] = "LTBRDF1";
+
+/**
+ * @brief Rotation of v around z by the angle of cosine c and sine s.
+ */
+static vec3 rotate_z(const vec3& v, const Float& c, const Float& s)
+{
+    return vec3(c * v.x - s * v.y, s * v.x + c * v.y, v.z);
+}
+
+/**
+ * @brief Rotation of v around y by the angle of cosine c and sine s.
+ */
+static vec3 rotate_y(const vec3& v, const Float& c, const Float& s)
+{
+    return vec3(c * v.x + s * v.z, v.y, -s * v.x + c * v.z);
+}
+
+/**
+ * @brief Position between two nodes of a grid axis.
+ */
+struct GridAxis {
+    int i0 = 0;
+    int i1 = 0;
+    Float t = 0.;
+
+    GridAxis() = default;
+
+    /**
+     * @param x Position in node units.
+     * @param n Number of nodes.
+     * @param periodic The node n is the node 0.
+     */
+    GridAxis(const Float& x, const int& n, const bool& periodic)
+    {
+        if (n < 2)
+            return;
+        if (periodic) {
+            Float x_ = x - n * std::floor(x / n);
+            i0 = std::min(int(x_), n - 1);
+            i1 = (i0 + 1) % n;
+            t = x_ - i0;
+        } else {
+            Float x_ = glm::clamp(x, 0.f, Float(n - 1));
+            i0 = std::min(int(x_), n - 2);
+            i1 = i0 + 1;
+            t = x_ - i0;
+        }
+    }
+};
+
+/////////////////////
+// TabulatedBrdf
+///////////////////
+void TabulatedBrdf::init()
+{
+    if (!filename.empty()) {
+        if (!load(filename))
+            Log(logError) << "TabulatedBrdf : cannot load " << filename;
+    } else if (brdf) {
+        bake(*brdf, samples);
+    } else {
+        Log(logWarning) << "TabulatedBrdf : no filename nor brdf to bake";
+    }
+
+    init_sampling();
+}
+
+void TabulatedBrdf::bake(Brdf& brdf, const int& samples)
+{
+    res_theta_h = std::max(res_theta_h, 2);
+    res_theta_d = std::max(res_theta_d, 2);
+    res_phi_d = std::max(res_phi_d, 2);
+    res_phi_h = anisotropic ? std::max(res_phi_h, 1) : 1;
+
+    const int n_nodes = res_phi_h * res_theta_h * res_theta_d * res_phi_d;
+    table.assign(n_nodes, Spectrum(0.));
+
+    auto bake_node = [&](const int& idx, Sampler& sampler) {
+        int p_d = idx % res_phi_d;
+        int t_d = (idx / res_phi_d) % res_theta_d;
+        int t_h = (idx / (res_phi_d * res_theta_d)) % res_theta_h;
+        int p_h = idx / (res_phi_d * res_theta_d * res_theta_h);
+
+        Float x_h = t_h / Float(res_theta_h - 1);
+        Float theta_h = x_h * x_h * 0.5 * pi;
+        Float theta_d = t_d / Float(res_theta_d - 1) * 0.5 * pi;
+        Float phi_d = anisotropic ? 2. * pi * p_d / Float(res_phi_d) : pi * p_d / Float(res_phi_d - 1);
+        Float phi_h = 2. * pi * p_h / Float(res_phi_h);
+
+        vec3 d = polar_to_card(theta_d, phi_d);
+        vec3 d_o = vec3(-d.x, -d.y, d.z);
+        Float c_h = std::cos(theta_h), s_h = std::sin(theta_h);
+        Float c_p = std::cos(phi_h), s_p = std::sin(phi_h);
+        vec3 wi = rotate_z(rotate_y(d, c_h, s_h), c_p, s_p);
+        vec3 wo = rotate_z(rotate_y(d_o, c_h, s_h), c_p, s_p);
+
+        if (wi.z <= 0. || wo.z <= 0.)
+            return;
+
+        Spectrum sum(0.);
+        for (int s = 0; s < samples; s++) {
+            Spectrum f = brdf.eval(wi, wo, sampler) / wo.z;
+            if (std::isfinite(f.x) && std::isfinite(f.y) && std::isfinite(f.z))
+                sum += f;
+        }
+        table[idx] = glm::max(sum / Float(std::max(samples, 1)), Spectrum(0.));
+    };
+
+    // One sampler per theta_h row seeded by its index, the table does not depend on the thread count
+    const int n_rows = res_phi_h * res_theta_h;
+    const int row_size = res_theta_d * res_phi_d;
+#pragma omp parallel for schedule(dynamic)
+    for (int row = 0; row < n_rows; row++) {
+        Sampler sampler;
+        sampler.seed(row);
+        for (int idx = row * row_size; idx < (row + 1) * row_size; idx++)
+            bake_node(idx, sampler);
+    }
+}
+
+bool TabulatedBrdf::save(const std::string& path)
+{
+    std::ofstream file(path, std::ios::binary);
+    if (!file)
+        return false;
+
+    int32_t header[5] = { anisotropic, res_theta_h, res_theta_d, res_phi_d, res_phi_h };
+    file.write(tabulated_brdf_magic, sizeof(tabulated_brdf_magic));
+    file.write((const char*)header, sizeof(header));
+    file.write((const char*)table.data(), sizeof(Spectrum) * table.size());
+    return bool(file);
+}
+
+bool TabulatedBrdf::load(const std::string& path)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+        return false;
+
+    char magic[8];
+    int32_t header[5];
+    file.read(magic, sizeof(magic));
+    file.read((char*)header, sizeof(header));
+    if (!file || std::memcmp(magic, tabulated_brdf_magic, sizeof(magic)) != 0)
+        return false;
+
+    if (header[1] < 2 || header[2] < 2 || header[3] < 2 || header[4] < 1)
+        return false;
+
+    anisotropic = header[0];
+    res_theta_h = header[1];
+    res_theta_d = header[2];
+    res_phi_d = header[3];
+    res_phi_h = anisotropic ? header[4] : 1;
+
+    table.resize(size_t(res_phi_h) * res_theta_h * res_theta_d * res_phi_d);
+    file.read((char*)table.data(), sizeof(Spectrum) * table.size());
+    if (!file) {
+        table.clear();
+        return false;
+    }
+    return true;
+}
+
+Spectrum TabulatedBrdf::lookup(const vec3& wi, const vec3& wo)
+{
+    if (table.empty() || wi.z <= 0. || wo.z <= 0.)
+        return Spectrum(0.);
+
+    // Rusinkiewicz coordinates
+    vec3 h = glm::normalize(wi + wo);
+    Float theta_h = std::acos(glm::clamp(h.z, -1.f, 1.f));
+    Float phi_h = std::atan2(h.y, h.x);
+    vec3 d = rotate_y(rotate_z(wi, std::cos(phi_h), -std::sin(phi_h)), h.z, -std::sin(theta_h));
+    Float theta_d = std::acos(glm::clamp(d.z, -1.f, 1.f));
+    Float phi_d = std::atan2(d.y, d.x);
+
+    GridAxis axes[4];
+    if (anisotropic) {
+        axes[0] = GridAxis(phi_h / (2. * pi) * res_phi_h, res_phi_h, true);
+        axes[3] = GridAxis(phi_d / (2. * pi) * res_phi_d, res_phi_d, true);
+    } else {
+        // Isotropic BRDFs are symmetric with respect to phi_d = 0
+        axes[3] = GridAxis(std::abs(phi_d) / pi * (res_phi_d - 1), res_phi_d, false);
+    }
+    axes[1] = GridAxis(std::sqrt(theta_h / (0.5 * pi)) * (res_theta_h - 1), res_theta_h, false);
+    axes[2] = GridAxis(theta_d / (0.5 * pi) * (res_theta_d - 1), res_theta_d, false);
+
+    const int res[4] = { res_phi_h, res_theta_h, res_theta_d, res_phi_d };
+    Spectrum value(0.);
+    for (int corner = 0; corner < 16; corner++) {
+        Float weight = 1.;
+        int idx = 0;
+        for (int k = 0; k < 4; k++) {
+            bool upper = (corner >> k) & 1;
+            weight *= upper ? axes[k].t : 1.f - axes[k].t;
+            idx = idx * res[k] + (upper ? axes[k].i1 : axes[k].i0);
+        }
+        if (weight > 0.)
+            value += weight * table[idx];
+    }
+    return value;
+}
+
+void TabulatedBrdf::init_sampling()
+{
+    sampling_density.clear();
+    sampling_row_cdf.clear();
+    sampling_cell_cdf.clear();
+
+    if (table.empty())
+        return;
+
+    const int n_theta = sampling_theta_res;
+    const int n_phi_i = anisotropic ? sampling_phi_res : 1;
+    const int n_cos = sampling_cos_res;
+    const int n_cell = sampling_cell_res;
+    const int n_sub = 2;
+    const Float cell_area = 2. * pi / Float(n_cos * n_cell);
+
+    sampling_density.resize(n_theta * n_phi_i * n_cos * n_cell);
+    sampling_row_cdf.resize(n_theta * n_phi_i * (n_cos + 1));
+    sampling_cell_cdf.resize(n_theta * n_phi_i * n_cos * (n_cell + 1));
+
+    for (int slice = 0; slice < n_theta * n_phi_i; slice++) {
+        Float theta_i = 0.5 * pi * (slice / n_phi_i) / Float(n_theta - 1);
+        Float phi_i = 2. * pi * (slice % n_phi_i) / Float(n_phi_i);
+        Float cos_theta_i = std::max(std::cos(theta_i), 0.001f);
+        Float sin_theta_i = std::sqrt(1.f - cos_theta_i * cos_theta_i);
+        Float c_i = std::cos(phi_i), s_i = std::sin(phi_i);
+        vec3 wi = vec3(sin_theta_i * c_i, sin_theta_i * s_i, cos_theta_i);
+
+        // Luminance of brdf * cos_theta_o, averaged over the cell
+        Float* density = &sampling_density[slice * n_cos * n_cell];
+        Float total = 0.;
+        for (int r = 0; r < n_cos; r++) {
+            for (int c = 0; c < n_cell; c++) {
+                Float v = 0.;
+                for (int j = 0; j < n_sub * n_sub; j++) {
+                    Float cos_theta_o = std::max((r + (j / n_sub + 0.5f) / n_sub) / n_cos, 0.0001f);
+                    Float phi_o = 2. * pi * (c + (j % n_sub + 0.5f) / n_sub) / n_cell;
+                    Float sin_theta_o = std::sqrt(1. - cos_theta_o * cos_theta_o);
+                    vec3 wo = rotate_z(vec3(sin_theta_o * std::cos(phi_o), sin_theta_o * std::sin(phi_o), cos_theta_o), c_i, s_i);
+                    Spectrum f = lookup(wi, wo);
+                    v += (f.x + f.y + f.z) / 3.f * cos_theta_o;
+                }
+                density[r * n_cell + c] = v / (n_sub * n_sub);
+                total += density[r * n_cell + c];
+            }
+        }
+
+        // Small defensive density, the grid does not resolve the lobe exactly
+        Float floor = total > 0. ? 0.01 * total / Float(n_cos * n_cell) : 1.;
+        total = 0.;
+        for (int i = 0; i < n_cos * n_cell; i++) {
+            density[i] += floor;
+            total += density[i];
+        }
+
+        Float* row_cdf = &sampling_row_cdf[slice * (n_cos + 1)];
+        row_cdf[0] = 0.;
+        for (int r = 0; r < n_cos; r++) {
+            Float* cell_cdf = &sampling_cell_cdf[(slice * n_cos + r) * (n_cell + 1)];
+            cell_cdf[0] = 0.;
+            for (int c = 0; c < n_cell; c++)
+                cell_cdf[c + 1] = cell_cdf[c] + density[r * n_cell + c];
+            row_cdf[r + 1] = row_cdf[r] + cell_cdf[n_cell];
+            for (int c = 1; c <= n_cell; c++)
+                cell_cdf[c] /= cell_cdf[n_cell];
+        }
+        for (int r = 1; r <= n_cos; r++)
+            row_cdf[r] /= total;
+
+        for (int i = 0; i < n_cos * n_cell; i++)
+            density[i] /= total * cell_area;
+    }
+}
+
+int TabulatedBrdf::sampling_slices(const vec3& wi, int* slice, Float* weight)
+{
+    const int n_theta = sampling_theta_res;
+    const int n_phi_i = anisotropic ? sampling_phi_res : 1;
+
+    Float x = std::acos(glm::clamp(wi.z, 0.f, 1.f)) / (0.5f * pi) * (n_theta - 1);
+    int k = std::min(int(x), n_theta - 2);
+    Float t = x - k;
+
+    if (n_phi_i == 1) {
+        slice[0] = k;
+        slice[1] = k + 1;
+        weight[0] = 1.f - t;
+        weight[1] = t;
+        return 2;
+    }
+
+    GridAxis phi(std::atan2(wi.y, wi.x) / (2. * pi) * n_phi_i, n_phi_i, true);
+    slice[0] = k * n_phi_i + phi.i0;
+    slice[1] = k * n_phi_i + phi.i1;
+    slice[2] = (k + 1) * n_phi_i + phi.i0;
+    slice[3] = (k + 1) * n_phi_i + phi.i1;
+    weight[0] = (1.f - t) * (1.f - phi.t);
+    weight[1] = (1.f - t) * phi.t;
+    weight[2] = t * (1.f - phi.t);
+    weight[3] = t * phi.t;
+    return 4;
+}
+
+Spectrum TabulatedBrdf::eval(vec3 wi, vec3 wo, Sampler& sampler)
+{
+    return lookup(wi, wo) * glm::clamp(wo.z, 0.f, 1.f);
+}
+
+Brdf::Sample TabulatedBrdf::sample(const vec3& wi, Sampler& sampler)
+{
+    Sample bs;
+
+    if (sampling_density.empty()) {
+        bs.wo = square_to_cosine_hemisphere(sampler.next_float(), sampler.next_float());
+        bs.pdf = square_to_cosine_hemisphere_pdf(bs.wo);
+        bs.value = Spectrum(0.);
+        return bs;
+    }
+
+    const int n_cos = sampling_cos_res;
+    const int n_cell = sampling_cell_res;
+
+    int slices[4];
+    Float weights[4];
+    int n = sampling_slices(wi, slices, weights);
+    Float u_slice = sampler.next_float();
+    int slice = slices[n - 1];
+    for (int i = 0; i < n - 1; i++) {
+        if (u_slice < weights[i]) {
+            slice = slices[i];
+            break;
+        }
+        u_slice -= weights[i];
+    }
+
+    Float u = sampler.next_float();
+    const Float* row_cdf = &sampling_row_cdf[slice * (n_cos + 1)];
+    int r = binary_search<Float>(row_cdf, u, n_cos + 1);
+    Float du = (u - row_cdf[r]) / std::max(row_cdf[r + 1] - row_cdf[r], 1e-12f);
+
+    Float v = sampler.next_float();
+    const Float* cell_cdf = &sampling_cell_cdf[(slice * n_cos + r) * (n_cell + 1)];
+    int c = binary_search<Float>(cell_cdf, v, n_cell + 1);
+    Float dv = (v - cell_cdf[c]) / std::max(cell_cdf[c + 1] - cell_cdf[c], 1e-12f);
+
+    Float cos_theta_o = (r + glm::clamp(du, 0.f, 1.f)) / n_cos;
+    Float phi_o = 2. * pi * (c + glm::clamp(dv, 0.f, 1.f)) / n_cell;
+    Float sin_theta_o = std::sqrt(std::max(0.f, 1.f - cos_theta_o * cos_theta_o));
+
+    // From the frame where phi_i = 0
+    Float r_i = std::sqrt(wi.x * wi.x + wi.y * wi.y);
+    Float c_i = r_i > 0. ? wi.x / r_i : 1.;
+    Float s_i = r_i > 0. ? wi.y / r_i : 0.;
+    bs.wo = rotate_z(vec3(sin_theta_o * std::cos(phi_o), sin_theta_o * std::sin(phi_o), cos_theta_o), c_i, s_i);
+
+    Eval e = evaluate(wi, bs.wo, sampler);
+    bs.pdf = e.pdf;
+    bs.value = e.pdf > 0. ? e.value / e.pdf : Spectrum(0.);
+    return bs;
+}
+
+float TabulatedBrdf::pdf(const vec3& wi, const vec3& wo)
+{
+    if (sampling_density.empty())
+        return square_to_cosine_hemisphere_pdf(wo);
+
+    if (wo.z <= 0.)
+        return 0.;
+
+    const int n_cos = sampling_cos_res;
+    const int n_cell = sampling_cell_res;
+
+    // To the frame where phi_i = 0
+    Float r_i = std::sqrt(wi.x * wi.x + wi.y * wi.y);
+    Float c_i = r_i > 0. ? wi.x / r_i : 1.;
+    Float s_i = r_i > 0. ? wi.y / r_i : 0.;
+    vec3 w = rotate_z(wo, c_i, -s_i);
+
+    Float phi_o = std::atan2(w.y, w.x);
+    phi_o = phi_o < 0. ? phi_o + 2. * pi : phi_o;
+    int r = glm::clamp(int(w.z * n_cos), 0, n_cos - 1);
+    int c = glm::clamp(int(phi_o / (2. * pi) * n_cell), 0, n_cell - 1);
+
+    int slices[4];
+    Float weights[4];
+    int n = sampling_slices(wi, slices, weights);
+    Float pdf_ = 0.;
+    for (int i = 0; i < n; i++)
+        pdf_ += weights[i] * sampling_density[(slices[i] * n_cos + r) * n_cell + c];
+    return pdf_;
+}
+
+Brdf::Eval TabulatedBrdf::evaluate(const vec3& wi, const vec3& wo, Sampler& sampler)
+{
+    return { eval(wi, wo, sampler), pdf(wi, wo) };
+}
+
+} // namespace LT_NAMESPACE
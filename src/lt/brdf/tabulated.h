@@ -0,0 +1,115 @@
+/**
+ * @file tabulated.h
+ * @brief Defines the TabulatedBrdf class, a measured approximation of any BRDF.
+ */
+
+#pragma once
+
+#include "brdf.h"
+
+namespace LT_NAMESPACE {
+
+/**
+ * @brief BRDF read from a grid in the Rusinkiewicz parameterization
+ * (theta_h, theta_d, phi_d, and phi_h when anisotropic).
+ * The grid is either loaded from a file written by \ref save (see apps/brdf_baker)
+ * or baked at init from the "brdf" parameter. Evaluation is a multilinear lookup
+ * and sampling uses tabulated CDFs over wo, so the cost does not depend on the
+ * measured model.
+ */
+class TabulatedBrdf : public Brdf {
+public:
+    TabulatedBrdf()
+        : Brdf("TabulatedBrdf")
+        , anisotropic(false)
+        , res_theta_h(64)
+        , res_theta_d(32)
+        , res_phi_d(64)
+        , res_phi_h(32)
+        , samples(1)
+    {
+        flags = Flags::rough | Flags::reflection;
+        link_params();
+    }
+
+    /**
+     * @brief Load filename, or bake brdf when no file is given, then build the sampling tables.
+     */
+    void init();
+
+    Spectrum eval(vec3 wi, vec3 wo, Sampler& sampler);
+    Sample sample(const vec3& wi, Sampler& sampler);
+    float pdf(const vec3& wi, const vec3& wo);
+    Eval evaluate(const vec3& wi, const vec3& wo, Sampler& sampler);
+
+    /**
+     * @brief Measure a BRDF on the grid, using all the hardware threads.
+     * The grid resolution and anisotropic flag are read from the members.
+     * @param brdf The measured BRDF.
+     * @param samples Evaluations averaged per node, for stochastic BRDFs.
+     */
+    void bake(Brdf& brdf, const int& samples = 1);
+
+    /**
+     * @brief Write the grid to a binary file.
+     * @return True on success.
+     */
+    bool save(const std::string& path);
+
+    /**
+     * @brief Read a grid written by \ref save, the resolution is read from the file.
+     * @return True on success.
+     */
+    bool load(const std::string& path);
+
+    /**
+     * @brief Interpolated BRDF value, without the cosine.
+     */
+    Spectrum lookup(const vec3& wi, const vec3& wo);
+
+    std::string filename; /**< Binary file of the grid. */
+    std::shared_ptr<Brdf> brdf; /**< BRDF baked at init when there is no file. */
+    bool anisotropic; /**< Also tabulate phi_h. */
+    int res_theta_h;
+    int res_theta_d;
+    int res_phi_d;
+    int res_phi_h; /**< Only used when anisotropic. */
+    int samples; /**< Evaluations averaged per node when baking. */
+
+    std::vector<Spectrum> table; /**< Indexed by [phi_h][theta_h][theta_d][phi_d]. */
+
+    static constexpr int sampling_theta_res = 32; /**< Incident theta of the sampling tables. */
+    static constexpr int sampling_phi_res = 8; /**< Incident phi of the sampling tables, when anisotropic. */
+    static constexpr int sampling_cos_res = 32; /**< Rows in cos(theta_o). */
+    static constexpr int sampling_cell_res = 64; /**< Columns in phi_o - phi_i. */
+
+protected:
+    void link_params()
+    {
+        params.add("filename", Params::Type::PATH, &filename);
+        params.add("brdf", Params::Type::BRDF, &brdf);
+        params.add("anisotropic", Params::Type::BOOL, &anisotropic);
+        params.add("res_theta_h", Params::Type::INT, &res_theta_h);
+        params.add("res_theta_d", Params::Type::INT, &res_theta_d);
+        params.add("res_phi_d", Params::Type::INT, &res_phi_d);
+        params.add("res_phi_h", Params::Type::INT, &res_phi_h);
+        params.add("samples", Params::Type::INT, &samples);
+    }
+
+    /**
+     * @brief Build the CDFs over wo for each incident slice from the grid.
+     */
+    void init_sampling();
+
+    /**
+     * @brief Incident slices around wi and their probability.
+     * @return Number of slices written.
+     */
+    int sampling_slices(const vec3& wi, int* slice, Float* weight);
+
+    std::vector<Float> sampling_density; /**< Density per solid angle of each cell, per slice. */
+    std::vector<Float> sampling_row_cdf; /**< Cumulative density of the rows, per slice. */
+    std::vector<Float> sampling_cell_cdf; /**< Cumulative density of the cells inside their row, per slice. */
+};
+
+} // namespace LT_NAMESPACE
@@ -1,9 +1,13 @@
 #include "brdf_common.h"
 
+#include <thread>
+
 namespace LT_NAMESPACE {
 
     int BrdfValidation::number_of_theta = 90;
     int BrdfValidation::number_of_sample = 10000;
+    Float BrdfValidation::significance = 0.01;
+    Float BrdfValidation::reciprocity_tolerance = 0.05;
 
     /////////////////////
     // Brdf Factory
@@ -21,9 +25,321 @@ namespace LT_NAMESPACE {
             { "RoughBeckmann", std::make_shared<RoughBeckmann> },
             { "RoughMicrograin", std::make_shared<RoughMicrograin> },
             { "Mix", std::make_shared<Mix> },
+            { "TabulatedBrdf", std::make_shared<TabulatedBrdf> },
             { "TestBrdf", std::make_shared<TestBrdf> }
         };
         return registry;
     }
 
-} // namespace LT_NAMESPACE
\ No newline at end of file
+    /////////////////////
+    // Brdf Validation
+    ///////////////////
+
+    namespace {
+
+        // Histogram of wo in equal area cells, uniform in cos(theta) and phi
+        constexpr int validation_cos_res = 16;
+        constexpr int validation_phi_res = 32;
+        constexpr int validation_min_sub_res = 4; // Quadrature points per cell and dimension
+        constexpr int validation_max_sub_res = 128;
+        constexpr int validation_reciprocity_pairs = 16384;
+        constexpr int validation_reciprocity_cos_res = 4; // Regions of wo where the reciprocity is compared
+        constexpr int validation_reciprocity_phi_res = 4;
+        constexpr Float validation_min_expected = 5.;
+
+        bool is_valid(const Float& v) { return !std::isnan(v) && !std::isinf(v); }
+        bool is_valid(const Spectrum& v) { return is_valid(v.x) && is_valid(v.y) && is_valid(v.z); }
+        bool is_negative(const Spectrum& v) { return v.x < 0. || v.y < 0. || v.z < 0.; }
+        Float max_channel(const Spectrum& v) { return std::max(v.x, std::max(v.y, v.z)); }
+
+        int validation_cell(const vec3& wo)
+        {
+            Float phi = std::atan2(wo.y, wo.x);
+            phi = phi < 0. ? phi + 2. * pi : phi;
+            int c = std::min(int((1. - wo.z) * validation_cos_res), validation_cos_res - 1);
+            int p = std::min(int(phi / (2. * pi) * validation_phi_res), validation_phi_res - 1);
+            return c * validation_phi_res + p;
+        }
+
+        /**
+         * @brief Pearson's chi-square test, cells with a low expected count are pooled.
+         * A cell with no expected samples but observed ones fails the test.
+         */
+        Float chi_square_test(const std::vector<Float>& observed, const std::vector<Float>& expected, const int& n_samples)
+        {
+            std::vector<int> order(observed.size());
+            for (int i = 0; i < order.size(); i++)
+                order[i] = i;
+            std::sort(order.begin(), order.end(), [&](int a, int b) { return expected[a] < expected[b]; });
+
+            Float pooled_observed = 0.;
+            Float pooled_expected = 0.;
+            double chi2 = 0.;
+            int dof = 0;
+            for (const int& i : order) {
+                if (expected[i] == 0.) {
+                    if (observed[i] > n_samples * 1e-5)
+                        return 0.;
+                } else if (expected[i] < validation_min_expected
+                    || (pooled_expected > 0. && pooled_expected < validation_min_expected)) {
+                    pooled_observed += observed[i];
+                    pooled_expected += expected[i];
+                } else {
+                    chi2 += (observed[i] - expected[i]) * (observed[i] - expected[i]) / expected[i];
+                    dof++;
+                }
+            }
+            if (pooled_expected > 0.) {
+                chi2 += (pooled_observed - pooled_expected) * (pooled_observed - pooled_expected) / pooled_expected;
+                dof++;
+            }
+            dof--;
+
+            if (dof <= 0)
+                return 1.;
+            return chisqr(dof, chi2);
+        }
+
+        struct AngleValidation {
+            Float directional_albedo = 0.;
+            Float integrated_albedo = 0.;
+            Float sampling_difference = 0.;
+            Float p_value = 1.;
+            Float reciprocity_error = 0.;
+            bool energy_conservative = true;
+            bool found_nan = false;
+            bool negative_value = false;
+        };
+
+        AngleValidation validate_angle(Brdf& brdf, const vec3& wi, Sampler& sampler, const int& n_samples)
+        {
+            AngleValidation r;
+            const int n_cells = validation_cos_res * validation_phi_res;
+
+            auto check = [&](const Spectrum& v) {
+                r.found_nan |= !is_valid(v);
+                r.negative_value |= is_negative(v);
+            };
+
+            // Histogram of the samples, the last cell counts the lost samples
+            std::vector<Float> observed(n_cells + 1, 0.);
+            std::vector<Brdf::Sample> samples(n_samples);
+            brdf.sample_n(wi, samples, sampler);
+
+            Spectrum albedo(0.);
+            Float albedo_sqr = 0.;
+            for (const Brdf::Sample& s : samples) {
+                // Samples below the horizon are discarded by the integrators, they are not checked
+                bool lost = !is_valid(s.wo) || s.wo.z <= 0.;
+                if (!lost) {
+                    check(s.value);
+                    check(Spectrum(s.pdf));
+                    lost = !is_valid(s.pdf) || !(s.pdf > 0.);
+                }
+                if (lost) {
+                    observed[n_cells] += 1.;
+                    continue;
+                }
+
+                observed[validation_cell(s.wo)] += 1.;
+                if (is_valid(s.value)) {
+                    albedo += s.value;
+                    albedo_sqr += max_channel(s.value) * max_channel(s.value);
+                }
+            }
+            albedo /= Float(n_samples);
+            r.directional_albedo = max_channel(albedo);
+
+            // Expected counts from the pdf integrated over each cell, and
+            // integrated albedo from eval at the same quadrature points.
+            // The midpoint rule is refined until the expected count is stable.
+            std::vector<Float> expected(n_cells + 1, 0.);
+            Spectrum integrated(0.);
+            Float integrated_pdf = 0.;
+            std::vector<vec3> wos;
+            std::vector<Float> pdfs;
+            std::vector<Spectrum> values;
+
+            auto integrate_cell = [&](const int& c, const int& p, const int& n_sub) {
+                wos.resize(n_sub * n_sub);
+                pdfs.resize(n_sub * n_sub);
+                for (int k = 0; k < n_sub * n_sub; k++) {
+                    Float cos_theta = 1. - (c + (k / n_sub + 0.5) / n_sub) / Float(validation_cos_res);
+                    Float phi = 2. * pi * (p + (k % n_sub + 0.5) / n_sub) / Float(validation_phi_res);
+                    Float sin_theta = std::sqrt(std::max(0.f, 1.f - cos_theta * cos_theta));
+                    wos[k] = vec3(sin_theta * std::cos(phi), sin_theta * std::sin(phi), cos_theta);
+                }
+                brdf.pdf_n(wi, wos, pdfs);
+
+                double sum = 0.;
+                for (const Float& pdf : pdfs) {
+                    check(Spectrum(pdf));
+                    if (is_valid(pdf))
+                        sum += std::max(pdf, 0.f);
+                }
+                return sum * 2. * pi / double(n_cells * n_sub * n_sub);
+            };
+
+            for (int c = 0; c < validation_cos_res; c++) {
+                for (int p = 0; p < validation_phi_res; p++) {
+                    int n_sub = validation_min_sub_res;
+                    double coarse = integrate_cell(c, p, n_sub);
+                    while (n_sub < validation_max_sub_res) {
+                        double fine = integrate_cell(c, p, 2 * n_sub);
+                        n_sub *= 2;
+                        bool converged = n_samples * std::abs(fine - coarse) < 0.01 * std::max(1., std::sqrt(n_samples * fine));
+                        coarse = fine;
+                        if (converged)
+                            break;
+                    }
+                    expected[c * validation_phi_res + p] = coarse;
+                    integrated_pdf += coarse;
+
+                    // wos holds the points of the last level
+                    values.resize(wos.size());
+                    brdf.eval_n(wi, wos, values, sampler);
+                    for (const Spectrum& v : values) {
+                        check(v);
+                        if (is_valid(v))
+                            integrated += v * Float(2. * pi / double(n_cells * wos.size()));
+                    }
+                }
+            }
+            // The quadrature is not exact, a few lost samples are not a failure on their own
+            expected[n_cells] = std::max(1.f - integrated_pdf, 1e-5f);
+            r.integrated_albedo = max_channel(integrated);
+
+            Float difference = 0.;
+            for (int i = 0; i <= n_cells; i++) {
+                observed[i] /= Float(n_samples);
+                difference += std::abs(observed[i] - expected[i]);
+            }
+            r.sampling_difference = 0.5 * difference;
+
+            for (int i = 0; i <= n_cells; i++) {
+                observed[i] *= Float(n_samples);
+                expected[i] *= Float(n_samples);
+            }
+            r.p_value = chi_square_test(observed, expected, n_samples);
+
+            // Albedo above one by more than the Monte Carlo error
+            Float variance = std::max(albedo_sqr / Float(n_samples) - r.directional_albedo * r.directional_albedo, 0.f);
+            r.energy_conservative = r.directional_albedo <= 1. + 4. * std::sqrt(variance / Float(n_samples)) + 1e-3;
+
+            // Reciprocity on uniform pairs, the cosine is removed from eval.
+            // Both evaluations are summed per region of wo, so the noise of stochastic
+            // BRDFs averages out while a systematic asymmetry remains.
+            const int n_regions = validation_reciprocity_cos_res * validation_reciprocity_phi_res;
+            std::vector<Float> sum_io(n_regions, 0.);
+            std::vector<Float> sum_oi(n_regions, 0.);
+            for (int i = 0; i < validation_reciprocity_pairs; i++) {
+                vec3 wo = square_to_uniform_hemisphere(sampler.next_float(), sampler.next_float());
+                if (wo.z < 0.01)
+                    continue;
+                Spectrum f_io = brdf.eval(wi, wo, sampler) / wo.z;
+                Spectrum f_oi = brdf.eval(wo, wi, sampler) / wi.z;
+                check(f_io);
+                check(f_oi);
+                if (!is_valid(f_io) || !is_valid(f_oi))
+                    continue;
+
+                Float phi = std::atan2(wo.y, wo.x);
+                phi = phi < 0. ? phi + 2. * pi : phi;
+                int c = std::min(int((1. - wo.z) * validation_reciprocity_cos_res), validation_reciprocity_cos_res - 1);
+                int p = std::min(int(phi / (2. * pi) * validation_reciprocity_phi_res), validation_reciprocity_phi_res - 1);
+                sum_io[c * validation_reciprocity_phi_res + p] += max_channel(f_io);
+                sum_oi[c * validation_reciprocity_phi_res + p] += max_channel(f_oi);
+            }
+            for (int i = 0; i < n_regions; i++) {
+                Float m = std::max(sum_io[i], sum_oi[i]);
+                if (m > 1e-4 * validation_reciprocity_pairs / n_regions)
+                    r.reciprocity_error = std::max(r.reciprocity_error, std::abs(sum_io[i] - sum_oi[i]) / m);
+            }
+
+            // Specific directions: mirror, wo = wi, normal and grazing
+            const vec3 specific[] = {
+                vec3(-wi.x, -wi.y, wi.z),
+                wi,
+                vec3(0., 0., 1.),
+                glm::normalize(vec3(1., 0., 1e-4)),
+                glm::normalize(vec3(-1., 0., 1e-4))
+            };
+            for (const vec3& wo : specific) {
+                Brdf::Eval e = brdf.evaluate(wi, wo, sampler);
+                check(e.value);
+                check(Spectrum(e.pdf));
+            }
+
+            return r;
+        }
+
+    } // namespace
+
+    nlohmann::json BrdfValidation::to_json() const
+    {
+        nlohmann::json j;
+        j["type"] = type;
+        j["passed"] = passed();
+        j["energy_conservative"] = energy_conservative;
+        j["correct_sampling"] = correct_sampling;
+        j["reciprocity"] = reciprocity;
+        j["found_nan"] = found_nan;
+        j["negative_value"] = negative_value;
+        j["min_p_value"] = min_p_value;
+        j["max_reciprocity_error"] = max_reciprocity_error;
+        j["thetas"] = thetas;
+        j["directional_albedo"] = directional_albedo;
+        j["integrated_albedo"] = integrated_albedo;
+        j["sampling_difference"] = sampling_difference;
+        j["p_values"] = p_values;
+        j["reciprocity_error"] = reciprocity_error;
+        return j;
+    }
+
+    BrdfValidation BrdfValidation::validate(Brdf& brdf, const int& n_threads)
+    {
+        BrdfValidation validation;
+        validation.type = brdf.type;
+        validation.thetas = linspace<Float>(0, 0.5 * pi, number_of_theta);
+
+        const int n_theta = number_of_theta;
+        const int n_samples = std::max(number_of_sample, 1);
+        std::vector<AngleValidation> angles(n_theta);
+
+        // Incident angles are dispatched dynamically, grazing ones are often slower. Each angle
+        // seeds its sampler from its index, the result does not depend on the thread count
+        const int n_workers = std::min<int>(n_threads > 0 ? n_threads : std::max(1u, std::thread::hardware_concurrency()), n_theta);
+#pragma omp parallel for schedule(dynamic) num_threads(std::max(n_workers, 1))
+        for (int i = 0; i < n_theta; i++) {
+            Sampler sampler;
+            sampler.seed(i + 1);
+            angles[i] = validate_angle(brdf, polar_to_card(validation.thetas[i], 0.), sampler, n_samples);
+        }
+
+        // Sidak correction, the series passes with probability 1 - significance
+        const Float alpha = 1. - std::pow(1. - significance, 1. / std::max(n_theta, 1));
+
+        validation.energy_conservative = true;
+        validation.correct_sampling = true;
+        for (const AngleValidation& a : angles) {
+            validation.directional_albedo.push_back(a.directional_albedo);
+            validation.integrated_albedo.push_back(a.integrated_albedo);
+            validation.sampling_difference.push_back(a.sampling_difference);
+            validation.p_values.push_back(a.p_value);
+            validation.reciprocity_error.push_back(a.reciprocity_error);
+
+            validation.min_p_value = std::min(validation.min_p_value, a.p_value);
+            validation.max_reciprocity_error = std::max(validation.max_reciprocity_error, a.reciprocity_error);
+            validation.energy_conservative &= a.energy_conservative;
+            validation.correct_sampling &= a.p_value >= alpha;
+            validation.found_nan |= a.found_nan;
+            validation.negative_value |= a.negative_value;
+        }
+        validation.reciprocity = validation.max_reciprocity_error <= reciprocity_tolerance;
+
+        Log(logInfo) << "validate " << brdf.type << (validation.passed() ? " : passed" : " : failed");
+
+        return validation;
+    }
+
+} // namespace LT_NAMESPACE
@@ -0,0 +1,61 @@
+#include <lt/checkpoint.h>
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+namespace LT_NAMESPACE {
+
+static const char checkpoint_magic[8] = "LTCKPT2";
+
+bool save_checkpoint(const Renderer& ren, const std::string& path, const float& time)
+{
+    const std::string tmp_path = path + ".tmp";
+    {
+        std::ofstream file(tmp_path, std::ios::binary);
+        if (!file)
+            return false;
+
+        uint32_t n_sample = ren.integrator->n_sample;
+        file.write(checkpoint_magic, sizeof(checkpoint_magic));
+        file.write((const char*)&n_sample, sizeof(n_sample));
+        file.write((const char*)&time, sizeof(time));
+        ren.sensor->save_state(file);
+        file.flush();
+        if (!file)
+            return false;
+    }
+
+    // The rename replaces the previous checkpoint at once
+    std::error_code ec;
+    std::filesystem::rename(tmp_path, path, ec);
+    return !ec;
+}
+
+int load_checkpoint(Renderer& ren, const std::string& path, float& time)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+        return -1;
+
+    char magic[8];
+    uint32_t n_sample;
+    float t;
+    file.read(magic, sizeof(magic));
+    file.read((char*)&n_sample, sizeof(n_sample));
+    file.read((char*)&t, sizeof(t));
+    if (!file || std::memcmp(magic, checkpoint_magic, sizeof(magic)) != 0 || n_sample < 1)
+        return -1;
+
+    if (!ren.sensor->load_state(file)) {
+        // A partial read may have overwritten some of the accumulators
+        ren.sensor->reset();
+        return -1;
+    }
+
+    ren.integrator->n_sample = n_sample;
+    time = t;
+    return int(n_sample) - 1;
+}
+
+} // namespace LT_NAMESPACE
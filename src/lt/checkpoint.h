@@ -0,0 +1,36 @@
+/**
+ * @file
+ * @brief Checkpoints of a render, to resume it after the process stopped.
+ */
+
+#pragma once
+
+#include <lt/lt_common.h>
+#include <lt/renderer.h>
+
+namespace LT_NAMESPACE {
+
+/**
+ * @brief Writes the pass index, the render time and the accumulators of the sensor.
+ *
+ * The samplers of a pass are seeded from the pass index, so a render resumed from
+ * the checkpoint gives the same image as an uninterrupted one. The file is written
+ * next to path and renamed, a crash while writing keeps the previous checkpoint.
+ *
+ * @param time Render time so far, in ms.
+ * @return False if the file could not be written.
+ */
+bool save_checkpoint(const Renderer& ren, const std::string& path, const float& time);
+
+/**
+ * @brief Restores a render from a checkpoint written by \ref save_checkpoint.
+ *
+ * The renderer must be generated from the same scene. The sensor is reset
+ * if the checkpoint does not match it.
+ *
+ * @param time Render time of the checkpoint, in ms.
+ * @return Number of passes already rendered, or -1 if the checkpoint is missing or invalid.
+ */
+int load_checkpoint(Renderer& ren, const std::string& path, float& time);
+
+} // namespace LT_NAMESPACE
@@ -0,0 +1,273 @@
+#include <lt/denoiser.h>
+
+namespace LT_NAMESPACE {
+
+static Float luminance(const Spectrum& s)
+{
+    return 0.2126f * s.r + 0.7152f * s.g + 0.0722f * s.b;
+}
+
+static int find_aov(const Sensor& sensor, const std::string& name)
+{
+    for (int a = 0; a < (int)sensor.aovs.size(); a++)
+        if (sensor.aovs[a].name == name)
+            return a;
+    return -1;
+}
+
+/**
+ * @brief Planar buffers of an a-trous pass, as raw pointers so that the vectorized loop does not reload them.
+ */
+struct AtrousBuffers {
+    const float* col[3];
+    const float* lum;
+    const float* var;
+    const float* nx;
+    const float* ny;
+    const float* nz;
+    const float* z;
+    const float* dz;
+
+    AtrousBuffers shift(const size_t& i) const
+    {
+        return { { col[0] + i, col[1] + i, col[2] + i }, lum + i, var + i, nx + i, ny + i, nz + i, z + i, dz + i };
+    }
+};
+
+/**
+ * @brief Sums of the taps for a row of a tile.
+ */
+struct AtrousRow {
+    float col[3][AtrousDenoiser::tile_size];
+    float w[AtrousDenoiser::tile_size];
+    float var[AtrousDenoiser::tile_size];
+    float inv_sigma_l[AtrousDenoiser::tile_size]; /**< 1 / (sigma_color * standard deviation). */
+    int x0; /**< First column of the tile. */
+    size_t p0; /**< Index of the first pixel of the row. */
+};
+
+/**
+ * @brief One of the 25 taps of the kernel.
+ */
+struct AtrousTap {
+    float k; /**< B3-spline weight. */
+    float inv_dist; /**< 1 / (sigma_depth * distance to the tap). */
+    float sigma_normal;
+    size_t qy; /**< Index of the first pixel of the row of the tap. */
+    int offset; /**< Column offset of the tap. */
+    int w;
+};
+
+/**
+ * @brief Adds the tap to the pixels [xa, xb) of the row, clamped for the taps outside the image.
+ */
+template <bool clamped>
+static void atrous_taps(const AtrousBuffers& g, const AtrousTap& tap, AtrousRow& acc, const int& xa, const int& xb)
+{
+    // Rows of the pixels and of the taps, indexed by x
+    const AtrousBuffers gp = g.shift(acc.p0);
+    const AtrousBuffers gq = g.shift(tap.qy);
+    const int x0 = acc.x0;
+    const int offset = tap.offset;
+    const int w = tap.w;
+    const float k = tap.k;
+    const float inv_dist = tap.inv_dist;
+    const float sigma_normal = tap.sigma_normal;
+
+#pragma omp simd
+    for (int x = xa; x < xb; x++) {
+        const int q = clamped ? std::min(std::max(x + offset, 0), w - 1) : x + offset;
+
+        float e = std::abs(gp.lum[x] - gq.lum[q]) * acc.inv_sigma_l[x - x0];
+        e += std::abs(gp.z[x] - gq.z[q]) * inv_dist / (gp.dz[x] + 1e-6f);
+
+        // cos^sigma_normal as exp(sigma_normal (cos - 1)), pixels without surface only mix together
+        float d = gp.nx[x] * gq.nx[q] + gp.ny[x] * gq.ny[q] + gp.nz[x] * gq.nz[q];
+        float surface = gp.nx[x] * gp.nx[x] + gp.ny[x] * gp.ny[x] + gp.nz[x] * gp.nz[x] + gq.nx[q] * gq.nx[q] + gq.ny[q] * gq.ny[q] + gq.nz[q] * gq.nz[q];
+        e += (surface > 0.f ? sigma_normal : 0.f) * (1.f - std::max(d, 0.f));
+
+        float wt = k * fastmath::exp(-e);
+
+        acc.col[0][x - x0] += wt * gq.col[0][q];
+        acc.col[1][x - x0] += wt * gq.col[1][q];
+        acc.col[2][x - x0] += wt * gq.col[2][q];
+        acc.w[x - x0] += wt;
+        acc.var[x - x0] += wt * wt * gq.var[q];
+    }
+}
+
+void AtrousDenoiser::apply(Sensor& sensor, std::vector<Spectrum>& out) const
+{
+    const int w = sensor.w;
+    const int h = sensor.h;
+    const size_t n = size_t(w) * h;
+
+    // Allocates the value array if it is the output
+    sensor.resolve();
+    out.resize(n);
+
+    int a_albedo = find_aov(sensor, "albedo");
+    int a_normal = find_aov(sensor, "normal");
+    int a_depth = find_aov(sensor, "depth");
+    std::vector<Spectrum> albedo = a_albedo >= 0 ? sensor.resolve_aov(a_albedo) : std::vector<Spectrum>();
+    std::vector<Spectrum> normal = a_normal >= 0 ? sensor.resolve_aov(a_normal) : std::vector<Spectrum>();
+    std::vector<Spectrum> depth = a_depth >= 0 ? sensor.resolve_aov(a_depth) : std::vector<Spectrum>();
+
+    // Planar buffers, so that the inner loops vectorize
+    std::vector<float> col[3], col_out[3];
+    std::vector<float> lum(n), var(n), var_blur(n), var_out(n);
+    std::vector<float> nx(n, 0.), ny(n, 0.), nz(n, 0.), z(n, 0.), dz(n, 0.);
+    std::vector<Spectrum> modulation(n, Spectrum(1.));
+    for (int c = 0; c < 3; c++) {
+        col[c].resize(n);
+        col_out[c].resize(n);
+    }
+
+    // Demodulate the albedo, emitters and background have none
+    for (size_t i = 0; i < n; i++) {
+        if (!albedo.empty() && luminance(albedo[i]) > 1e-3f)
+            modulation[i] = glm::max(albedo[i], Spectrum(1e-3f));
+        Spectrum c = sensor.mean(i) / modulation[i];
+        col[0][i] = c.r;
+        col[1][i] = c.g;
+        col[2][i] = c.b;
+    }
+
+    // Variance of the mean of each pixel, from the sensor or over 3x3 pixels
+    const VarianceSensor* variance_sensor = dynamic_cast<const VarianceSensor*>(&sensor);
+    for (size_t i = 0; i < n; i++)
+        lum[i] = 0.2126f * col[0][i] + 0.7152f * col[1][i] + 0.0722f * col[2][i];
+
+#pragma omp parallel for schedule(static)
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x++) {
+            size_t i = size_t(y) * w + x;
+            uint32_t count = sensor.pixels[i].count;
+            if (variance_sensor && count >= 2) {
+                Spectrum v = variance_sensor->variance_of_mean(i);
+                Float mod = luminance(modulation[i]);
+                var[i] = std::max(luminance(v), 0.f) / (mod * mod);
+                continue;
+            }
+
+            float sum = 0.;
+            float sum_sqr = 0.;
+            for (int dy = -1; dy <= 1; dy++)
+                for (int dx = -1; dx <= 1; dx++) {
+                    float l = lum[size_t(glm::clamp(y + dy, 0, h - 1)) * w + glm::clamp(x + dx, 0, w - 1)];
+                    sum += l;
+                    sum_sqr += l * l;
+                }
+            var[i] = std::max(sum_sqr / 9.f - (sum / 9.f) * (sum / 9.f), 0.f);
+        }
+    }
+
+    // Guides, with the depth gradient that scales the depth weight. Missing guides
+    // stay at zero, where their weights are one
+    if (!normal.empty()) {
+        for (size_t i = 0; i < n; i++) {
+            // Averaged normals are shorter at edges
+            vec3 nor = glm::length(normal[i]) > 0.f ? glm::normalize(normal[i]) : vec3(0.);
+            nx[i] = nor.x;
+            ny[i] = nor.y;
+            nz[i] = nor.z;
+        }
+    }
+    if (!depth.empty()) {
+        for (size_t i = 0; i < n; i++)
+            z[i] = depth[i].x;
+        for (int y = 0; y < h; y++)
+            for (int x = 0; x < w; x++) {
+                float gx = z[size_t(y) * w + std::min(x + 1, w - 1)] - z[size_t(y) * w + std::max(x - 1, 0)];
+                float gy = z[size_t(std::min(y + 1, h - 1)) * w + x] - z[size_t(std::max(y - 1, 0)) * w + x];
+                dz[size_t(y) * w + x] = 0.5f * std::max(std::abs(gx), std::abs(gy));
+            }
+    }
+
+    const float kernel[3] = { 3.f / 8.f, 1.f / 4.f, 1.f / 16.f };
+    const int n_tile_x = (w + tile_size - 1) / tile_size;
+    const int n_tile_y = (h + tile_size - 1) / tile_size;
+
+    for (int it = 0; it < iterations; it++) {
+        const int step = 1 << it;
+
+        // The luminance weight uses the variance prefiltered over 3x3 pixels
+#pragma omp parallel for schedule(static)
+        for (int y = 0; y < h; y++) {
+            for (int x = 0; x < w; x++) {
+                float sum = 0.;
+                for (int dy = -1; dy <= 1; dy++)
+                    for (int dx = -1; dx <= 1; dx++)
+                        sum += (dx == 0 ? 0.5f : 0.25f) * (dy == 0 ? 0.5f : 0.25f) * var[size_t(glm::clamp(y + dy, 0, h - 1)) * w + glm::clamp(x + dx, 0, w - 1)];
+                var_blur[size_t(y) * w + x] = sum;
+            }
+        }
+
+        const AtrousBuffers buffers = { { col[0].data(), col[1].data(), col[2].data() }, lum.data(), var.data(), nx.data(), ny.data(), nz.data(), z.data(), dz.data() };
+
+#pragma omp parallel for collapse(2) schedule(dynamic)
+        for (int ty = 0; ty < n_tile_y; ty++) {
+            for (int tx = 0; tx < n_tile_x; tx++) {
+                const int x0 = tx * tile_size;
+                const int x1 = std::min(x0 + tile_size, w);
+                const int y0 = ty * tile_size;
+                const int y1 = std::min(y0 + tile_size, h);
+
+                const AtrousBuffers g = buffers;
+                for (int y = y0; y < y1; y++) {
+                    AtrousRow acc = {};
+                    acc.x0 = x0;
+                    acc.p0 = size_t(y) * w;
+                    for (int x = x0; x < x1; x++)
+                        acc.inv_sigma_l[x - x0] = 1.f / (sigma_color * std::sqrt(var_blur[acc.p0 + x]) + 1e-6f);
+
+                    for (int dy = -2; dy <= 2; dy++) {
+                        const size_t qy = size_t(glm::clamp(y + dy * step, 0, h - 1)) * w;
+                        for (int dx = -2; dx <= 2; dx++) {
+                            AtrousTap tap;
+                            tap.k = kernel[std::abs(dx)] * kernel[std::abs(dy)];
+                            tap.inv_dist = 1.f / (sigma_depth * step * std::sqrt(float(dx * dx + dy * dy)) + 1e-6f);
+                            tap.sigma_normal = sigma_normal;
+                            tap.qy = qy;
+                            tap.offset = dx * step;
+                            tap.w = w;
+
+                            // Taps inside the image are contiguous and vectorize, the others are clamped to the border
+                            const int xa = std::min(std::max(x0, -tap.offset), x1);
+                            const int xb = std::max(std::min(x1, w - tap.offset), xa);
+                            atrous_taps<true>(g, tap, acc, x0, xa);
+                            atrous_taps<false>(g, tap, acc, xa, xb);
+                            atrous_taps<true>(g, tap, acc, xb, x1);
+                        }
+                    }
+
+                    for (int x = x0; x < x1; x++) {
+                        const size_t p = acc.p0 + x;
+                        const float sum_w = acc.w[x - x0];
+                        if (sum_w <= 0.f) {
+                            for (int c = 0; c < 3; c++)
+                                col_out[c][p] = col[c][p];
+                            var_out[p] = var[p];
+                            continue;
+                        }
+                        for (int c = 0; c < 3; c++)
+                            col_out[c][p] = acc.col[c][x - x0] / sum_w;
+                        var_out[p] = acc.var[x - x0] / (sum_w * sum_w);
+                    }
+                }
+            }
+        }
+
+        for (int c = 0; c < 3; c++)
+            std::swap(col[c], col_out[c]);
+        std::swap(var, var_out);
+        for (size_t i = 0; i < n; i++)
+            lum[i] = 0.2126f * col[0][i] + 0.7152f * col[1][i] + 0.0722f * col[2][i];
+    }
+
+    // Remodulate the albedo
+    for (size_t i = 0; i < n; i++)
+        out[i] = Spectrum(col[0][i], col[1][i], col[2][i]) * modulation[i];
+}
+
+} // namespace LT_NAMESPACE
@@ -0,0 +1,60 @@
+/**
+ * @file
+ * @brief Definition of the edge-avoiding a-trous denoiser.
+ */
+
+#pragma once
+
+#include <lt/lt_common.h>
+#include <lt/sensor.h>
+#include <lt/serialize.h>
+
+namespace LT_NAMESPACE {
+
+/**
+ * @brief Edge-avoiding a-trous wavelet filter, the spatial part of SVGF (Schied et al. 2017).
+ *
+ * The mean of the sensor is demodulated by the "albedo" AOV, then filtered by
+ * \ref iterations passes of a 5x5 B3-spline kernel whose taps are spread by 2^i.
+ * The weights stop at edges of the "normal" and "depth" AOVs, and at luminance
+ * differences large compared to the standard deviation of the pixel. The
+ * variance is the one of a \ref VarianceSensor, or estimated over 3x3 pixels
+ * for the other sensors. Missing AOVs are ignored.
+ */
+class AtrousDenoiser : public Serializable {
+public:
+    AtrousDenoiser()
+        : Serializable("AtrousDenoiser")
+        , iterations(5)
+        , sigma_color(4.)
+        , sigma_normal(128.)
+        , sigma_depth(1.)
+    {
+        link_params();
+    }
+
+    /**
+     * @brief Denoises the mean of the sensor pixels.
+     * @param sensor The sensor, with its AOVs.
+     * @param out The denoised image, w * h pixels. May be the value array of the sensor.
+     */
+    void apply(Sensor& sensor, std::vector<Spectrum>& out) const;
+
+    int iterations; /**< Number of a-trous passes, the kernel covers 4 * 2^iterations pixels. */
+    Float sigma_color; /**< Luminance difference allowed, in standard deviations. */
+    Float sigma_normal; /**< Exponent of the cosine between normals. */
+    Float sigma_depth; /**< Depth difference allowed, relative to the local depth gradient. */
+
+    static constexpr int tile_size = 32; /**< Pixels processed together by a thread. */
+
+protected:
+    void link_params()
+    {
+        params.add("iterations", Params::Type::INT, &iterations);
+        params.add("sigma_color", Params::Type::FLOAT, &sigma_color);
+        params.add("sigma_normal", Params::Type::FLOAT, &sigma_normal);
+        params.add("sigma_depth", Params::Type::FLOAT, &sigma_depth);
+    }
+};
+
+} // namespace LT_NAMESPACE
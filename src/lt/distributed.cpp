@@ -0,0 +1,125 @@
+#include <lt/distributed.h>
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <set>
+
+namespace LT_NAMESPACE {
+
+static const char sensor_part_magic[8] = "LTPART2";
+
+RenderPart RenderPart::split(const int& index, const int& count, const int& max_sample)
+{
+    int n = max_sample / count;
+    int r = max_sample % count;
+    return { index, count, index * n + std::min(index, r), n + (index < r ? 1 : 0) };
+}
+
+std::string RenderPart::path(const std::string& dir, const std::string& name) const
+{
+    return (std::filesystem::path(dir) / (name + "." + std::to_string(index) + "-" + std::to_string(count) + ".part")).string();
+}
+
+bool save_sensor_part(const Renderer& ren, const std::string& dir, const std::string& name, const RenderPart& part, const float& time)
+{
+    std::error_code ec;
+    std::filesystem::create_directories(dir, ec);
+
+    const std::string path = part.path(dir, name);
+    const std::string tmp_path = path + ".tmp";
+    {
+        std::ofstream file(tmp_path, std::ios::binary);
+        if (!file)
+            return false;
+
+        int32_t header[4] = { part.index, part.count, part.first_pass, part.n_pass };
+        file.write(sensor_part_magic, sizeof(sensor_part_magic));
+        file.write((const char*)header, sizeof(header));
+        file.write((const char*)&time, sizeof(time));
+        ren.sensor->save_state(file);
+        file.flush();
+        if (!file)
+            return false;
+    }
+
+    std::filesystem::rename(tmp_path, path, ec);
+    return !ec;
+}
+
+/**
+ * @brief Reads the index and the part count of a file named <name>.<index>-<count>.part.
+ */
+static bool parse_part_filename(const std::string& file, const std::string& name, int& index, int& count)
+{
+    const std::string prefix = name + ".";
+    const std::string suffix = ".part";
+    if (file.size() <= prefix.size() + suffix.size() || file.compare(0, prefix.size(), prefix) != 0
+        || file.compare(file.size() - suffix.size(), suffix.size(), suffix) != 0)
+        return false;
+
+    const std::string numbers = file.substr(prefix.size(), file.size() - prefix.size() - suffix.size());
+    size_t dash = numbers.find('-');
+    auto is_number = [](const std::string& str) {
+        return !str.empty() && str.size() < 10 && str.find_first_not_of("0123456789") == std::string::npos;
+    };
+    if (dash == std::string::npos || !is_number(numbers.substr(0, dash)) || !is_number(numbers.substr(dash + 1)))
+        return false;
+
+    index = std::stoi(numbers.substr(0, dash));
+    count = std::stoi(numbers.substr(dash + 1));
+    return count > 0 && index < count;
+}
+
+int merge_sensor_parts(Renderer& ren, const std::string& dir, const std::string& name, float& time)
+{
+    // All the parts of the directory must split the render the same way
+    std::set<int> counts;
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator(dir, ec)) {
+        int index, count;
+        if (parse_part_filename(entry.path().filename().string(), name, index, count))
+            counts.insert(count);
+    }
+    if (counts.empty()) {
+        Log(logError) << "No part of " << name << " in " << dir;
+        return -1;
+    }
+    if (counts.size() > 1) {
+        Log(logError) << "Parts of " << name << " in " << dir << " split the render in " << counts.size()
+                      << " different counts, from " << *counts.begin() << " to " << *counts.rbegin();
+        return -1;
+    }
+    const int count = *counts.begin();
+
+    ren.sensor->reset();
+    time = 0.;
+    int n_pass = 0;
+    int last_pass = 0;
+    for (int index = 0; index < count; index++) {
+        const std::string path = RenderPart { index, count, 0, 0 }.path(dir, name);
+        std::ifstream file(path, std::ios::binary);
+
+        char magic[8];
+        int32_t header[4];
+        float t;
+        file.read(magic, sizeof(magic));
+        file.read((char*)header, sizeof(header));
+        file.read((char*)&t, sizeof(t));
+        if (!file || std::memcmp(magic, sensor_part_magic, sizeof(magic)) != 0 || header[0] != index || header[1] != count
+            || !ren.sensor->add_state(file)) {
+            Log(logError) << "Missing or invalid part " << path;
+            ren.sensor->reset();
+            return -1;
+        }
+
+        time += t;
+        n_pass += header[3];
+        last_pass = std::max(last_pass, header[2] + header[3]);
+    }
+
+    ren.integrator->n_sample = last_pass + 1;
+    return n_pass;
+}
+
+} // namespace LT_NAMESPACE
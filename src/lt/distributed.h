@@ -0,0 +1,55 @@
+/**
+ * @file
+ * @brief Renders split across processes, each writing a part of the sensor that is merged afterwards.
+ */
+
+#pragma once
+
+#include <lt/lt_common.h>
+#include <lt/renderer.h>
+
+namespace LT_NAMESPACE {
+
+/**
+ * @brief Range of passes rendered by one of several processes.
+ *
+ * The samplers of a pass are seeded from the pass index, so the parts render
+ * disjoint samples and their sensors add up to the sensor of the whole render.
+ */
+struct RenderPart {
+    int index; /**< Index of the part, in [0, count). */
+    int count; /**< Number of parts of the render. */
+    int first_pass; /**< First pass of the part. */
+    int n_pass; /**< Number of passes of the part. */
+
+    /**
+     * @brief Splits max_sample passes in count contiguous ranges, the first ones get the remainder.
+     */
+    static RenderPart split(const int& index, const int& count, const int& max_sample);
+
+    /**
+     * @brief Path of the part in the directory shared by the processes, "dir/name.index-count.part".
+     */
+    std::string path(const std::string& dir, const std::string& name) const;
+};
+
+/**
+ * @brief Writes the sensor of a part, renamed once complete so that a merge never reads a partial file.
+ * @param time Render time of the part, in ms.
+ */
+bool save_sensor_part(const Renderer& ren, const std::string& dir, const std::string& name, const RenderPart& part, const float& time);
+
+/**
+ * @brief Adds the sensors of all the parts of a render to the sensor of the renderer.
+ *
+ * The parts are the files <name>.<index>-<count>.part of dir, the merge fails if
+ * one of them is missing or does not match the sensor, or if the directory holds
+ * parts of several counts. The pass index of the integrator is set after the
+ * last part, so the render can be continued.
+ *
+ * @param time Sum of the render times of the parts, in ms.
+ * @return Number of passes merged, or -1 on failure.
+ */
+int merge_sensor_parts(Renderer& ren, const std::string& dir, const std::string& name, float& time);
+
+} // namespace LT_NAMESPACE
@@ -0,0 +1,141 @@
+/**
+ * @file fastmath.h
+ * @brief Polynomial approximations of the transcendental functions used by the sampling and lookup routines.
+ *
+ * The approximations are branchless inline functions on float, so the compiler can inline and
+ * vectorize them where libm calls cannot be. The maximum error of each function is measured over
+ * its domain and documented below, it stays under 1e-4 relative to the result.
+ * glibc expf is table driven and was measured faster than a polynomial in scalar code, so there is
+ * no lt::math::exp; \ref fastmath::exp is only meant for loops that vectorize.
+ *
+ * They are used through the lt::math wrappers, which call either the approximation or the standard
+ * function depending on the LT_FASTMATH compile definition (CMake option LT_FASTMATH, off by default).
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+
+namespace LT_NAMESPACE {
+
+namespace fastmath {
+
+#ifdef LT_FASTMATH
+constexpr bool enabled = true;
+#else
+constexpr bool enabled = false;
+#endif
+
+constexpr float pi = 3.14159265358979f;
+constexpr float half_pi = 1.57079632679490f;
+
+/**
+ * @brief Nearest integer of |x| < 2^22, adding 1.5 2^23 drops the fraction without a libm call.
+ */
+inline float round(float x)
+{
+    return (x + 12582912.f) - 12582912.f;
+}
+
+/**
+ * @brief Sine and cosine, max absolute error 1e-7 for |x| < 1e4.
+ * The argument is reduced to [-pi/4, pi/4] around the nearest multiple of pi/2, minimax
+ * polynomials from Cephes sinf/cosf are evaluated and swapped according to the quadrant.
+ */
+inline void sincos(float x, float& s, float& c)
+{
+    float j = round(x * (1.f / half_pi));
+    // Cody-Waite reduction with pi/2 split in three
+    float r = ((x - j * 1.5703125f) - j * 4.837512969970703125e-4f) - j * 7.54978995489188216e-8f;
+    float r2 = r * r;
+    float ps = r + r * r2 * (-1.6666654611e-1f + r2 * (8.3321608736e-3f + r2 * -1.9515295891e-4f));
+    float pc = 1.f - 0.5f * r2 + r2 * r2 * (4.166664568298827e-2f + r2 * (-1.388731625493765e-3f + r2 * 2.443315711809948e-5f));
+
+    int q = int(j) & 3;
+    float sq = (q & 1) ? pc : ps;
+    float cq = (q & 1) ? ps : pc;
+    s = (q & 2) ? -sq : sq;
+    c = ((q + 1) & 2) ? -cq : cq;
+}
+
+/**
+ * @brief Arc tangent of y/x in [-pi, pi], max absolute error 2e-6.
+ * The ratio is reduced to [-1, 1], where atan is a degree 11 odd minimax polynomial.
+ */
+inline float atan2(float y, float x)
+{
+    float ax = std::abs(x);
+    float ay = std::abs(y);
+    bool swap = ay > ax;
+    float t = (swap ? ax : ay) / std::fmax(swap ? ay : ax, 1e-30f);
+    float t2 = t * t;
+    float a = t * (0.99997726f + t2 * (-0.33262347f + t2 * (0.19354346f + t2 * (-0.11643287f + t2 * (0.05265332f + t2 * -0.01172120f)))));
+    a = swap ? half_pi - a : a;
+    a = x < 0.f ? pi - a : a;
+    return std::copysign(a, y);
+}
+
+/**
+ * @brief Arc cosine, max absolute error 7e-5 on [-1, 1].
+ * Abramowitz and Stegun 4.4.45: acos(x) = sqrt(1 - x) P(x) on [0, 1], mirrored for x < 0.
+ */
+inline float acos(float x)
+{
+    float ax = std::fmin(std::abs(x), 1.f);
+    float a = std::sqrt(1.f - ax) * (1.5707288f + ax * (-0.2121144f + ax * (0.0742610f + ax * -0.0187293f)));
+    return x < 0.f ? pi - a : a;
+}
+
+/**
+ * @brief Exponential, max relative error 1e-5 on [-86, 88], clamped outside.
+ * 2^(x log2(e)) is split in an integer power, added to the exponent bits, and a degree 6
+ * polynomial on [-0.5, 0.5]. Unlike expf it does not prevent the vectorization of a loop.
+ */
+inline float exp(float x)
+{
+    float t = std::min(std::max(x, -86.f), 88.f) * 1.44269504f;
+    float j = round(t);
+    float f = t - j;
+    float p = 1.f + f * (0.69314718f + f * (0.24022651f + f * (0.05550411f + f * (0.00961813f + f * (0.00133336f + f * 0.00015404f)))));
+    return std::bit_cast<float>(std::bit_cast<int32_t>(p) + (int32_t(j) << 23));
+}
+
+} // namespace fastmath
+
+/**
+ * @brief Transcendental functions of the hot paths, approximated by \ref fastmath when LT_FASTMATH is defined.
+ */
+namespace math {
+
+inline void sincos(float x, float& s, float& c)
+{
+    if constexpr (fastmath::enabled) {
+        fastmath::sincos(x, s, c);
+    } else {
+        s = std::sin(x);
+        c = std::cos(x);
+    }
+}
+
+inline float atan2(float y, float x)
+{
+    if constexpr (fastmath::enabled)
+        return fastmath::atan2(y, x);
+    else
+        return std::atan2(y, x);
+}
+
+inline float acos(float x)
+{
+    if constexpr (fastmath::enabled)
+        return fastmath::acos(x);
+    else
+        return std::acos(x);
+}
+
+} // namespace math
+
+} // namespace LT_NAMESPACE
@@ -0,0 +1,92 @@
+#include <lt/filter.h>
+
+namespace LT_NAMESPACE {
+
+template<>
+Factory<Filter>::CreatorRegistry& Factory<Filter>::registry()
+{
+    static Factory<Filter>::CreatorRegistry registry {
+        { "BoxFilter", std::make_shared<BoxFilter> },
+        { "TentFilter", std::make_shared<TentFilter> },
+        { "GaussianFilter", std::make_shared<GaussianFilter> },
+        { "MitchellFilter", std::make_shared<MitchellFilter> },
+        { "BlackmanHarrisFilter", std::make_shared<BlackmanHarrisFilter> }
+    };
+    return registry;
+}
+
+
+void Filter::init()
+{
+    const int n_sub = 8;
+    const Float dx = 2. * radius / table_res;
+
+    table.resize(table_res);
+    cdf.resize(table_res + 1);
+    integral = 0.;
+    integral_abs = 0.;
+
+    cdf[0] = 0.;
+    for (int i = 0; i < table_res; i++) {
+        Float sum = 0.;
+        Float sum_abs = 0.;
+        for (int j = 0; j < n_sub; j++) {
+            Float f = eval_1d(-radius + (i + (j + 0.5f) / n_sub) * dx);
+            sum += f;
+            sum_abs += std::abs(f);
+        }
+        table[i] = sum_abs / n_sub;
+        integral += sum / n_sub * dx;
+        integral_abs += table[i] * dx;
+        cdf[i + 1] = cdf[i] + table[i] * dx;
+    }
+
+    for (int i = 1; i <= table_res; i++)
+        cdf[i] = integral_abs > 0. ? cdf[i] / integral_abs : Float(i) / table_res;
+}
+
+Float Filter::sample_1d(const Float& u, Float& weight) const
+{
+    const Float dx = 2. * radius / table_res;
+
+    int i = binary_search<Float>(cdf, u);
+    Float du = (u - cdf[i]) / std::max(cdf[i + 1] - cdf[i], 1e-12f);
+    Float x = -radius + (i + glm::clamp(du, 0.f, 1.f)) * dx;
+
+    // The bins are constant, the weight corrects the variation of the filter inside them
+    Float pdf = table[i] / integral_abs;
+    weight = pdf > 0. && integral != 0. ? eval_1d(x) / (pdf * integral) : 0.;
+    return x;
+}
+
+Filter::Sample Filter::sample(const Float& u1, const Float& u2) const
+{
+    Sample fs;
+    Float weight_x, weight_y;
+    fs.p.x = sample_1d(u1, weight_x);
+    fs.p.y = sample_1d(u2, weight_y);
+    fs.weight = weight_x * weight_y;
+    return fs;
+}
+
+
+Float MitchellFilter::eval_1d(const Float& x) const
+{
+    // Mitchell and Netravali 1988, defined over [-2, 2]
+    Float t = std::abs(2.f * x / radius);
+    if (t > 2.)
+        return 0.;
+    if (t > 1.)
+        return ((-b - 6.f * c) * t * t * t + (6.f * b + 30.f * c) * t * t + (-12.f * b - 48.f * c) * t + (8.f * b + 24.f * c)) / 6.f;
+    return ((12.f - 9.f * b - 6.f * c) * t * t * t + (-18.f + 12.f * b + 6.f * c) * t * t + (6.f - 2.f * b)) / 6.f;
+}
+
+
+Float BlackmanHarrisFilter::eval_1d(const Float& x) const
+{
+    const Float a0 = 0.35875, a1 = 0.48829, a2 = 0.14128, a3 = 0.01168;
+    Float t = 2. * pi * (x / (2. * radius) + 0.5);
+    return std::max(a0 - a1 * std::cos(t) + a2 * std::cos(2.f * t) - a3 * std::cos(3.f * t), 0.f);
+}
+
+} // namespace LT_NAMESPACE
@@ -0,0 +1,189 @@
+/**
+ * @file
+ * @brief Definitions of the pixel reconstruction filters.
+ */
+
+#pragma once
+
+#include <lt/factory.h>
+#include <lt/lt_common.h>
+#include <lt/serialize.h>
+
+namespace LT_NAMESPACE {
+
+/**
+ * @brief Abstract base class for separable pixel reconstruction filters.
+ *
+ * Offsets are in pixels from the pixel center. With importance_sampling the
+ * camera rays are distributed like the filter and each sample only goes to its
+ * own pixel with the weight returned by \ref sample. Otherwise the samples are
+ * uniform in the pixel and splatted to all the pixels under the filter.
+ */
+class Filter : public Serializable {
+public:
+    /**
+     * @brief Offset of a camera ray and its weight.
+     */
+    struct Sample {
+        vec2 p; /**< Offset from the pixel center, in pixels. */
+        Float weight; /**< filter / (pdf * integral of the filter), 1 for positive filters sampled exactly. */
+    };
+
+    /**
+     * @brief Constructor for Filter.
+     * @param type The type of filter.
+     * @param radius The default radius of the filter, in pixels.
+     */
+    Filter(const std::string& type, const Float& radius)
+        : Serializable(type)
+        , radius(radius)
+        , importance_sampling(true)
+    {
+    }
+
+    /**
+     * @brief Tabulate |filter| along one axis for \ref sample.
+     */
+    void init();
+
+    /**
+     * @brief Evaluate the filter along one axis.
+     * @param x Offset from the pixel center, in [-radius, radius].
+     */
+    virtual Float eval_1d(const Float& x) const = 0;
+
+    /**
+     * @brief Evaluate the filter, zero outside [-radius, radius]^2.
+     */
+    Float eval(const vec2& p) const
+    {
+        if (std::abs(p.x) > radius || std::abs(p.y) > radius)
+            return 0.;
+        return eval_1d(p.x) * eval_1d(p.y);
+    }
+
+    /**
+     * @brief Draw an offset proportionally to |filter|, needs \ref init.
+     */
+    Sample sample(const Float& u1, const Float& u2) const;
+
+    Float radius; /**< Support of the filter is [-radius, radius]^2, in pixels. */
+    bool importance_sampling; /**< Draw the camera rays from the filter instead of splatting the samples. */
+
+    static constexpr int table_res = 256; /**< Bins of the sampling table along one axis. */
+
+protected:
+    void link_params()
+    {
+        params.add("radius", Params::Type::FLOAT, &radius);
+        params.add("importance_sampling", Params::Type::BOOL, &importance_sampling);
+    }
+
+    /**
+     * @brief Draw an offset along one axis, and its weight.
+     */
+    Float sample_1d(const Float& u, Float& weight) const;
+
+    std::vector<Float> table; /**< |filter| averaged over each bin of [-radius, radius]. */
+    std::vector<Float> cdf; /**< Cumulative distribution of the bins, table_res + 1 entries. */
+    Float integral; /**< Integral of the filter along one axis. */
+    Float integral_abs; /**< Integral of |filter| along one axis. */
+};
+
+/**
+ * @brief Box filter, a sample only counts for the pixel it falls in when radius is 0.5.
+ */
+class BoxFilter : public Filter {
+public:
+    BoxFilter()
+        : Filter("BoxFilter", 0.5)
+    {
+        link_params();
+    }
+
+    Float eval_1d(const Float& x) const { return 1.; }
+};
+
+/**
+ * @brief Tent filter, linear falloff to zero at radius.
+ */
+class TentFilter : public Filter {
+public:
+    TentFilter()
+        : Filter("TentFilter", 1.)
+    {
+        link_params();
+    }
+
+    Float eval_1d(const Float& x) const { return std::max(radius - std::abs(x), 0.f); }
+};
+
+/**
+ * @brief Gaussian filter, shifted down to reach zero at radius.
+ */
+class GaussianFilter : public Filter {
+public:
+    GaussianFilter()
+        : Filter("GaussianFilter", 1.5)
+        , sigma(0.5)
+    {
+        link_params();
+    }
+
+    Float eval_1d(const Float& x) const
+    {
+        return std::max(std::exp(-x * x / (2.f * sigma * sigma)) - std::exp(-radius * radius / (2.f * sigma * sigma)), 0.f);
+    }
+
+    Float sigma; /**< Standard deviation, in pixels. */
+
+protected:
+    void link_params()
+    {
+        Filter::link_params();
+        params.add("sigma", Params::Type::FLOAT, &sigma);
+    }
+};
+
+/**
+ * @brief Mitchell-Netravali cubic filter, negative lobes sharpen the image.
+ */
+class MitchellFilter : public Filter {
+public:
+    MitchellFilter()
+        : Filter("MitchellFilter", 2.)
+        , b(1. / 3.)
+        , c(1. / 3.)
+    {
+        link_params();
+    }
+
+    Float eval_1d(const Float& x) const;
+
+    Float b; /**< Blur, B parameter of the family. */
+    Float c; /**< Ringing, C parameter of the family. */
+
+protected:
+    void link_params()
+    {
+        Filter::link_params();
+        params.add("b", Params::Type::FLOAT, &b);
+        params.add("c", Params::Type::FLOAT, &c);
+    }
+};
+
+/**
+ * @brief Blackman-Harris window, close to a Gaussian with less blur.
+ */
+class BlackmanHarrisFilter : public Filter {
+public:
+    BlackmanHarrisFilter()
+        : Filter("BlackmanHarrisFilter", 2.)
+    {
+        link_params();
+    }
+
+    Float eval_1d(const Float& x) const;
+};
+
+} // namespace LT_NAMESPACE
@@ -13,7 +13,6 @@
 
 #include <chrono>
 
-//#define SAMPLE_OPTIM
 #define USE_MIS
 namespace LT_NAMESPACE {
 
@@ -21,6 +20,15 @@ inline Float power_heuristic(const Float& pdf_1, const Float& pdf_2) {
     return (pdf_1 * pdf_1) / (pdf_1 * pdf_1 + pdf_2 * pdf_2);
 }
 
+/**
+ * @brief AOVs of the camera sample traced by a thread, see \ref Integrator::init_aovs.
+ */
+struct AovRecord {
+    std::vector<Spectrum> values; /**< One value per AOV of the sensor. */
+    vec3 origin; /**< Origin of the camera ray. */
+    Spectrum throughput; /**< Path throughput, weights the light group contributions. */
+};
+
 class Integrator : public Serializable {
 public:
     /**
@@ -46,6 +54,15 @@ public:
     {
         auto t1 = std::chrono::high_resolution_clock::now();
 
+        // Follow BRDFs swapped on geometries since the last render
+        scene.materials.update(scene.geometries);
+
+        // The albedo AOV reads the directional albedo tables, built once per BRDF before the parallel passes
+        if (slots.albedo >= 0)
+            for (const auto& geometry : scene.geometries)
+                if (geometry->brdf && !geometry->brdf->is_emissive() && geometry->brdf->albedo_table.empty())
+                    geometry->brdf->init_albedo_table();
+
 #if 0
 			for (int h = 0; h < sensor->h; h++) {
 				for (int w = 0; w < sensor->w; w++) {
@@ -63,15 +80,33 @@ public:
 #endif
 #if 1
         int block_size = 16;
+        uint64_t pass_counts = 0;
+
+        // Splatted tiles overlap their neighbours through the halo: blocks are rendered
+        // in 4 interleaved groups where blocks are one block apart, at least twice the halo
+        int step = sensor->halo() > 0 ? 2 : 1;
+
+        // Blocks of the image covering the crop window, a block and its seed do not depend on the crop
+        int h_first_block = sensor->crop_y / block_size;
+        int w_first_block = sensor->crop_x / block_size;
+        int h_num_block = (sensor->crop_y + sensor->h + block_size - 1) / block_size;
+        int w_num_block = (sensor->crop_x + sensor->w + block_size - 1) / block_size;
         //std::cout << "in" << std::endl;
-#pragma omp parallel for collapse(2) schedule(dynamic)
-        for (int h = 0; h < sensor->h / block_size + 1; h++)
-            for (int w = 0; w < sensor->w / block_size + 1; w++) {
-                Sampler s;
-                //s.seed(n_sample);
-                s.seed((h + w * (block_size + 1) + 1) * n_sample);
-                render_block(h, w, block_size, camera, sensor, scene, sampler);
-            }
+        for (int group = 0; group < step * step; group++) {
+            int h0 = h_first_block + group / step;
+            int w0 = w_first_block + group % step;
+#pragma omp parallel for collapse(2) schedule(dynamic) reduction(+ : pass_counts)
+            for (int h = h0; h < h_num_block; h += step)
+                for (int w = w0; w < w_num_block; w += step) {
+                    Sampler s;
+                    //s.seed(n_sample);
+                    s.seed((h + w * (block_size + 1) + 1) * n_sample);
+                    pass_counts += render_block(h, w, block_size, camera, sensor, scene, s);
+                }
+        }
+
+        // Sample totals are reduced once per pass instead of per sample
+        sensor->sum_counts += pass_counts;
 
 #endif
         //std::cout << "out" << std::endl;
@@ -103,36 +138,73 @@ public:
     };
 
     /**
-     * @brief Renders a block of pixels in the scene.
-     * @param id_h The ID of the block in the vertical direction.
-     * @param id_w The ID of the block in the horizontal direction.
+     * @brief Renders the pixels of a block of the image inside the crop window of the sensor.
+     * @param id_h The ID of the block of the image in the vertical direction.
+     * @param id_w The ID of the block of the image in the horizontal direction.
      * @param block_size The size of the block.
      * @param camera The camera used for rendering.
      * @param sensor The sensor to capture the rendered image.
      * @param scene The scene to render.
      * @param sampler The sampler used for sampling.
+     * @return The number of samples added to the sensor.
      */
-    void render_block(uint32_t id_h, uint32_t id_w, uint32_t block_size,
+    uint64_t render_block(uint32_t id_h, uint32_t id_w, uint32_t block_size,
         std::shared_ptr<Camera> camera,
         std::shared_ptr<Sensor> sensor, Scene& scene,
         Sampler& sampler)
     {
-        uint32_t h_min = id_h * block_size;
-        uint32_t w_min = id_w * block_size;
+        // Rows and columns of the block on the sensor
+        uint32_t h_min = std::max(id_h * block_size, sensor->crop_y) - sensor->crop_y;
+        uint32_t w_min = std::max(id_w * block_size, sensor->crop_x) - sensor->crop_x;
+
+        uint32_t h_max = std::min((id_h + 1) * block_size - sensor->crop_y, sensor->h);
+        uint32_t w_max = std::min((id_w + 1) * block_size - sensor->crop_x, sensor->w);
+        if (h_min >= h_max || w_min >= w_max)
+            return 0;
+
+        // Samples are accumulated in a tile of the thread, merged in the sensor once
+        static thread_local SensorTile tile;
+        sensor->init_tile(tile, w_min, h_min, w_max - w_min, h_max - h_min);
 
-        uint32_t h_max = std::min((id_h + 1) * block_size, sensor->h);
-        uint32_t w_max = std::min((id_w + 1) * block_size, sensor->w);
+        AovRecord& aov = aov_record();
+        aov.values.resize(sensor->aovs.size());
+
+        const Filter& filter = *sensor->filter;
         for (int h = h_min; h < h_max; h++) {
             for (int w = w_min; w < w_max; w++) {
-                float jw = (2. * sampler.next_float()) / (float)sensor->w;
-                float jh = (2. * sampler.next_float()) / (float)sensor->h;
+                // Offset of the ray from the pixel center, in pixels
+                float u1 = sampler.next_float();
+                float u2 = sampler.next_float();
+                Filter::Sample fs;
+                if (filter.importance_sampling) {
+                    fs = filter.sample(u1, u2);
+                } else {
+                    fs.p = vec2(u1 - 0.5f, u2 - 0.5f);
+                    fs.weight = 1.;
+                }
+                float jw = (2. * fs.p.x) / (float)sensor->full_w;
+                float jh = (2. * fs.p.y) / (float)sensor->full_h;
 
                 Ray r = camera->generate_ray(sensor->u[w] + jw, sensor->v[h] + jh);
+                if (tile.n_aov > 0) {
+                    std::fill(aov.values.begin(), aov.values.end(), Spectrum(0.));
+                    aov.origin = r.o;
+                    aov.throughput = Spectrum(1.);
+                }
+
                 Spectrum s = render_pixel(r, scene, sampler);
 
-                sensor->add(w, h, s);
+                if (filter.importance_sampling)
+                    tile.add(w, h, s, fs.weight);
+                else
+                    tile.splat(w, h, fs.p, s, filter);
+                if (tile.n_aov > 0)
+                    tile.add_aovs(w, h, aov.values);
             }
         }
+
+        sensor->merge(tile);
+        return tile.sum_counts;
     }
 
     /**
@@ -144,6 +216,52 @@ public:
      */
     virtual Spectrum render_pixel(Ray& r, Scene& scene, Sampler& sampler) = 0;
 
+    /**
+     * @brief Registers the AOVs requested in \ref aovs in the sensor.
+     *
+     * The AOVs are written during the passes of \ref render: "albedo", "normal",
+     * "depth", "position" and "id" of the first surface with a BRDF, and
+     * "light_groups", one layer per group of the lights of the scene. Light
+     * groups are written by the integrators using direct lighting.
+     * @param sensor The sensor receiving the AOVs.
+     * @param scene The scene, for its light groups.
+     */
+    void init_aovs(Sensor& sensor, const Scene& scene)
+    {
+        slots = AovSlots();
+        for (const std::string& name : aovs) {
+            if (name == "albedo") {
+                slots.albedo = sensor.add_aov(name, { "R", "G", "B" });
+            } else if (name == "normal") {
+                slots.normal = sensor.add_aov(name, { "X", "Y", "Z" });
+            } else if (name == "depth") {
+                slots.depth = sensor.add_aov(name, { "Z" });
+            } else if (name == "position") {
+                slots.position = sensor.add_aov(name, { "X", "Y", "Z" });
+            } else if (name == "id") {
+                slots.id = sensor.add_aov(name, { "id" }, false);
+            } else if (name == "light_groups") {
+                int n_group = 0;
+                for (const auto& light : scene.lights)
+                    n_group = std::max(n_group, light->group + 1);
+                for (const auto& light : scene.infinite_lights)
+                    n_group = std::max(n_group, light->group + 1);
+                for (int g = 0; g < n_group; g++)
+                    slots.light_groups.push_back(sensor.add_aov("light_group" + std::to_string(g), { "R", "G", "B" }));
+
+                // Group of the light on each geometry, looked up on the emissive hits
+                slots.geometry_groups.assign(scene.geometries.size(), -1);
+                for (const auto& light : scene.lights) {
+                    int id = light->geometry_id();
+                    if (id >= 0 && id < (int)slots.geometry_groups.size())
+                        slots.geometry_groups[id] = light->group;
+                }
+            } else {
+                Log(logWarning) << "Unknown AOV : " << name;
+            }
+        }
+    }
+
     /**
      * @brief Estimates direct lighting contribution from random light source.
      * @param r The ray representing the pixel.
@@ -166,7 +284,9 @@ public:
             ? scene.lights[light_idx]
             : scene.infinite_lights[n_light - light_idx - 1];
 
-        return estimate_direct(r, si, light, scene, sampler) * Float(n_light);
+        Spectrum contrib = estimate_direct(r, si, light, scene, sampler) * Float(n_light);
+        record_light(light->group, contrib);
+        return contrib;
     }
 
     /**
@@ -182,24 +302,28 @@ public:
     {
         Spectrum contrib = Spectrum(0.);      
         for (int i = 0; i < scene.lights.size(); ++i) {
-            contrib += estimate_direct(r, si, scene.lights[i], scene, sampler);
+            Spectrum c = estimate_direct(r, si, scene.lights[i], scene, sampler);
+            record_light(scene.lights[i]->group, c);
+            contrib += c;
         }
         for (int i = 0; i < scene.infinite_lights.size(); ++i) {
-            contrib += estimate_direct(r, si, scene.infinite_lights[i], scene, sampler);
+            Spectrum c = estimate_direct(r, si, scene.infinite_lights[i], scene, sampler);
+            record_light(scene.infinite_lights[i]->group, c);
+            contrib += c;
         }
         return contrib;
     }
 
     /**
-     * @brief Estimates direct lighting contribution from a light source.
+     * @brief Light sampling part of \ref estimate_direct, MIS weighted against BRDF sampling.
      * @param r The ray representing the pixel.
      * @param si Surface interaction data.
      * @param light The light source.
      * @param scene The scene to render.
      * @param sampler The sampler used for sampling.
-     * @return The estimated direct lighting contribution.
+     * @return The light sampling contribution.
      */
-    Spectrum estimate_direct(Ray& r, SurfaceInteraction& si,
+    Spectrum estimate_direct_light(Ray& r, SurfaceInteraction& si,
         const std::shared_ptr<Light>& light, Scene& scene,
         Sampler& sampler)
     {
@@ -207,11 +331,12 @@ public:
         
         si.pos -= r.d * surface_offset_eps;
 
-        Light::Sample ls = light->sample(si, sampler);
+        vec3 wi = si.to_local(-r.d);
+
+        Light::Sample ls = light->sample(si, wi, sampler);
         bool ls_valid = ls.pdf > 0.0 && ls.emission != Spectrum(0.0);
      
         vec3 wo = si.to_local(-ls.direction);
-        vec3 wi = si.to_local(-r.d);
 
         Ray rs(si.pos,-ls.direction);
         
@@ -221,13 +346,14 @@ public:
                 return contrib;
             }
 
-            Spectrum brdf_contrib = si.brdf->eval(wi, wo, sampler);
+            Brdf::Eval be = scene.materials.evaluate(si.material, wi, wo, sampler);
+            Spectrum brdf_contrib = be.value;
             
             #if defined(USE_MIS)
             if (light->is_dirac()) {
                 contrib += brdf_contrib * ls.emission / ls.pdf;
             } else {
-                Float brdf_pdf = si.brdf->pdf(wi, wo);
+                Float brdf_pdf = be.pdf;
                 assert(brdf_pdf == brdf_pdf);
                 Float weight = power_heuristic(ls.pdf, brdf_pdf);
                 assert(weight == weight);
@@ -241,10 +367,103 @@ public:
             #endif
         }
 
+        return contrib;
+    }
+
+    /**
+     * @brief Light sampling of one light chosen uniformly, the BRDF sampling
+     * part of MIS is left to the caller (see \ref emission_brdf_sampling).
+     * @param r The ray representing the pixel.
+     * @param si Surface interaction data.
+     * @param scene The scene to render.
+     * @param sampler The sampler used for sampling.
+     * @return The light sampling contribution.
+     */
+    Spectrum uniform_sample_one_light_only(Ray& r, SurfaceInteraction& si,
+        Scene& scene, Sampler& sampler)
+    {
+        int n_light = scene.lights.size() + scene.infinite_lights.size();
+
+        if (n_light == 0)
+            return Spectrum(0.);
+
+        int light_idx = std::min((int)(sampler.next_float() * n_light), n_light - 1);
+
+        const std::shared_ptr<Light>& light = light_idx < scene.lights.size()
+            ? scene.lights[light_idx]
+            : scene.infinite_lights[n_light - light_idx - 1];
+
+        Spectrum contrib = estimate_direct_light(r, si, light, scene, sampler) * Float(n_light);
+        record_light(light->group, contrib);
+        return contrib;
+    }
+
+    /**
+     * @brief Emission found by a BRDF sampled ray, MIS weighted against
+     * \ref uniform_sample_one_light_only.
+     * @param r The BRDF sampled ray, leaving si.
+     * @param si Surface interaction the ray leaves.
+     * @param wi Incident direction at si in the local frame.
+     * @param brdf_pdf Density of the BRDF sample.
+     * @param intersection True if r hit something.
+     * @param si_ Surface interaction hit by r.
+     * @param scene The scene to render.
+     * @return The weighted emission.
+     */
+    Spectrum emission_brdf_sampling(const Ray& r, SurfaceInteraction& si, const vec3& wi,
+        const Float& brdf_pdf, bool intersection, const SurfaceInteraction& si_,
+        Scene& scene)
+    {
+        Spectrum contrib = vec3(0.0);
+        Float n_light = scene.lights.size() + scene.infinite_lights.size();
+
+        if (!intersection) {
+            for (const auto& light : scene.infinite_lights) {
+                Float light_pdf = light->pdf(si, wi, -r.d) / n_light;
+                Spectrum c = power_heuristic(brdf_pdf, light_pdf) * light->eval(r.d);
+                record_light(light->group, c);
+                contrib += c;
+            }
+            return contrib;
+        }
+
+        if (!si_.brdf || !si_.brdf->is_emissive())
+            return contrib;
+
+        for (const auto& light : scene.lights) {
+            if (light->geometry_id() == si_.geom_id) {
+                Float light_pdf = light->pdf(si, si_) / n_light;
+                contrib = power_heuristic(brdf_pdf, light_pdf) * si_.brdf->emission();
+                record_light(light->group, contrib);
+                return contrib;
+            }
+        }
+
+        // Emissive geometry that is not a light, only reached by BRDF sampling and in no light group
+        return si_.brdf->emission();
+    }
+
+    /**
+     * @brief Estimates direct lighting contribution from a light source.
+     * @param r The ray representing the pixel.
+     * @param si Surface interaction data.
+     * @param light The light source.
+     * @param scene The scene to render.
+     * @param sampler The sampler used for sampling.
+     * @return The estimated direct lighting contribution.
+     */
+    Spectrum estimate_direct(Ray& r, SurfaceInteraction& si,
+        const std::shared_ptr<Light>& light, Scene& scene,
+        Sampler& sampler)
+    {
+        Spectrum contrib = estimate_direct_light(r, si, light, scene, sampler);
+
         #if defined(USE_MIS)
+        vec3 wi = si.to_local(-r.d);
+
         // Brdf sampling
         if (!light->is_dirac()) {
-            Brdf::Sample bs = si.brdf->sample(wi, sampler);
+            Brdf::Sample bs = scene.materials.sample(si.material, wi, sampler);
 
             if (!valid_local_dir(wi) || !valid_local_dir(bs.wo)) {
                 return contrib;
@@ -252,11 +471,6 @@ public:
 
             Float weight = 1.0f;
 
-            Float light_pdf = light->pdf(si.pos, -si.to_world(bs.wo));
-            if (light_pdf <= 0) {
-                return contrib;
-            }
-
             Ray r_ = Ray(si.pos - r.d * surface_offset_eps, si.to_world(bs.wo));
             SurfaceInteraction si_;
             bool intersection = scene.intersect(r_, si_); 
@@ -271,8 +485,14 @@ public:
                 return contrib;
             }
 
+            // Area lights need the hit point to know their density
+            Float light_pdf = intersection ? light->pdf(si, si_) : light->pdf(si, wi, -si.to_world(bs.wo));
+            if (light_pdf <= 0) {
+                return contrib;
+            }
+
             Spectrum emission = light->eval(si.to_world(bs.wo)); // No difference in light eval between lights at infinity and area lights
-            Float brdf_pdf = si.brdf->pdf(wi, bs.wo);
+            Float brdf_pdf = bs.pdf;
             assert(light_pdf != 0 || brdf_pdf != 0);
             weight = power_heuristic(brdf_pdf, light_pdf);
             assert(weight == weight);
@@ -284,6 +504,91 @@ public:
     }
 
     uint32_t n_sample;
+    std::vector<std::string> aovs; /**< AOVs requested in the scene file, see \ref init_aovs. */
+
+protected:
+    /**
+     * @brief Index of each AOV in the sensor, -1 when it is not requested.
+     */
+    struct AovSlots {
+        int albedo = -1;
+        int normal = -1;
+        int depth = -1;
+        int position = -1;
+        int id = -1;
+        std::vector<int> light_groups; /**< One AOV per light group. */
+        std::vector<int> geometry_groups; /**< Light group of each geometry, -1 when it is not a light. */
+    };
+
+    /**
+     * @brief AOVs of the camera sample traced by the calling thread.
+     */
+    static AovRecord& aov_record()
+    {
+        static thread_local AovRecord record;
+        return record;
+    }
+
+    /**
+     * @brief Writes the AOVs of the first surface hit by the camera ray.
+     */
+    void record_hit(const SurfaceInteraction& si)
+    {
+        if (slots.normal < 0 && slots.depth < 0 && slots.position < 0 && slots.id < 0)
+            return;
+
+        AovRecord& aov = aov_record();
+        if (slots.normal >= 0)
+            aov.values[slots.normal] = si.nor;
+        if (slots.depth >= 0)
+            aov.values[slots.depth] = Spectrum(glm::length(si.pos - aov.origin));
+        if (slots.position >= 0)
+            aov.values[slots.position] = si.pos;
+        if (slots.id >= 0)
+            aov.values[slots.id] = Spectrum(Float(si.geom_id + 1));
+    }
+
+    /**
+     * @brief Writes the directional albedo of the first surface, read from the table of its BRDF.
+     * Nothing is sampled, the AOV leaves the random sequence of the image unchanged.
+     * @param wi Incident direction in the local frame.
+     */
+    void record_albedo(const SurfaceInteraction& si, const vec3& wi)
+    {
+        if (slots.albedo >= 0)
+            aov_record().values[slots.albedo] = si.brdf->directional_albedo_spectrum(wi);
+    }
+
+    /**
+     * @brief Adds a contribution of a light to its group, weighted by the path throughput.
+     */
+    void record_light(const int& group, const Spectrum& contrib)
+    {
+        if (group < 0 || group >= (int)slots.light_groups.size())
+            return;
+
+        AovRecord& aov = aov_record();
+        aov.values[slots.light_groups[group]] += aov.throughput * contrib;
+    }
+
+    /**
+     * @brief Sets the path throughput applied by \ref record_light.
+     */
+    void record_throughput(const Spectrum& throughput)
+    {
+        if (!slots.light_groups.empty())
+            aov_record().throughput = throughput;
+    }
+
+    /**
+     * @brief Group of the light on the emissive geometry hit, -1 when it is not a light.
+     */
+    int light_group(const SurfaceInteraction& si) const
+    {
+        return si.geom_id < slots.geometry_groups.size() ? slots.geometry_groups[si.geom_id] : -1;
+    }
+
+    AovSlots slots; /**< AOVs written by the integrator, set by \ref init_aovs. */
 };
 
 class BrdfIntegrator : public Integrator {
@@ -309,6 +614,9 @@ public:
                 return render_pixel_rec(r, scene, sampler, depth);
             }
 
+            if (depth == 0)
+                record_hit(si);
+
             if (depth >= max_depth || si.brdf->is_emissive())
                 return si.brdf->emission();
 
@@ -318,26 +626,21 @@ public:
                 return s;
             }
 
-            Brdf::Sample bs = si.brdf->sample(wi, sampler);
+            if (depth == 0)
+                record_albedo(si, wi);
+
+            Brdf::Sample bs = scene.materials.sample(si.material, wi, sampler);
 
             if (!valid_local_dir(bs.wo)) {
                 return s;
             }
 
-            #if !defined(SAMPLE_OPTIM)
-            Float pdf = si.brdf->pdf(wi, bs.wo);
-            Spectrum brdf_cos_weighted = si.brdf->eval(wi, bs.wo, sampler);
-            assert(brdf_cos_weighted.x == brdf_cos_weighted.x);
-            #endif
+            // The sample weight is the BRDF over its density, no evaluation of the sampled direction
 
             Ray r_ = Ray(si.pos - r.d * surface_offset_eps, si.to_world(bs.wo));
             Spectrum indirect = render_pixel_rec(r_, scene, sampler, depth + 1);
             
-            #if !defined(SAMPLE_OPTIM)
-            s += brdf_cos_weighted * indirect / pdf;
-            #else
             s += bs.value * indirect;
-            #endif
 
             assert(s.x >= 0);
             assert(s.x == s.x);
@@ -388,13 +691,20 @@ public:
                 return render_pixel(r, scene, sampler);
             }
 
-            if (si.brdf->is_emissive())
+            record_hit(si);
+            if (si.brdf->is_emissive()) {
+                record_light(light_group(si), si.brdf->emission());
                 return si.brdf->emission();
+            }
+
+            record_albedo(si, si.to_local(-r.d));
 
             s += sample_all_lights ? uniform_sample_all_light(r, si, scene, sampler) : uniform_sample_one_light(r, si, scene, sampler);
         } else {
-            for (const auto& light : scene.infinite_lights)
+            for (const auto& light : scene.infinite_lights) {
+                record_light(light->group, light->eval(r.d));
                 s += light->eval(r.d);
+            }
         }
 
         return s;
@@ -425,57 +735,73 @@ public:
         Spectrum throughput(1.);
         Spectrum s(0.);
 
-        SurfaceInteraction prev_si;
+        SurfaceInteraction si;
+        bool intersection = scene.intersect(r, si);
 
         for (int d = 0; d < max_depth; d++) {
             
-            SurfaceInteraction si;
-            if (scene.intersect(r, si)) {
-
+            if (intersection) {
 
                 if (!si.brdf) {
                     r = Ray(si.pos + r.d * surface_offset_eps, r.d);
+                    intersection = scene.intersect(r, si);
                     d--;
                     continue;
                 }
 
                 if (d == 0 /* || specularBounce*/) {
+                    record_hit(si);
+                    record_light(light_group(si), si.brdf->emission());
                     s += throughput * si.brdf->emission();
                 }
                 
-                // Compute Light contrib
+                // Compute Light contrib, the BRDF sampling part of MIS is done with the next bounce
+                record_throughput(throughput);
+                #if defined(USE_MIS)
+                s += throughput * uniform_sample_one_light_only(r, si, scene, sampler);
+                #else
                 s += throughput * uniform_sample_one_light(r, si, scene, sampler);
+                #endif
 
                 // Compute BRDF  contrib
                 vec3 wi = si.to_local(-r.d);
-                Brdf::Sample bs = si.brdf->sample(wi, sampler); // TODO: use uniform_sample_one_light's brdf sample
+                if (d == 0)
+                    record_albedo(si, wi);
+                Brdf::Sample bs = scene.materials.sample(si.material, wi, sampler);
 
                 if (!valid_local_dir(bs.wo) || !valid_local_dir(wi)) {
                     break;
                 }
 
-                #if !defined(SAMPLE_OPTIM)
-                Float wo_pdf = si.brdf->pdf(wi, bs.wo);
-                Spectrum brdf_cos_weighted = si.brdf->eval(wi, bs.wo, sampler);
-                throughput *= brdf_cos_weighted / wo_pdf;
-                assert(throughput == throughput);
-                #else
+                // The sample carries the BRDF weight and the density for the MIS, the direction is not evaluated again
+                Float wo_pdf = bs.pdf;
                 throughput *= bs.value;
-                #endif
+                assert(throughput == throughput);
+                record_throughput(throughput);
 
                 // offset si.pos for next bounce
                 vec3 p = si.pos - r.d * surface_offset_eps;
                 r = Ray(p, si.to_world(bs.wo));
 
+                // The next vertex is also the BRDF sample of the MIS
+                SurfaceInteraction si_;
+                intersection = scene.intersect(r, si_);
+
+                #if defined(USE_MIS)
+                s += throughput * emission_brdf_sampling(r, si, wi, wo_pdf, intersection, si_, scene);
+                #endif
+
+                si = si_;
+
             } else {
                 if (d == 0) {
-                    for (const auto& light : scene.infinite_lights)
+                    for (const auto& light : scene.infinite_lights) {
+                        record_light(light->group, light->eval(r.d));
                         s += throughput * light->eval(r.d);
+                    }
                 }
                 break;
             }
-
-            prev_si = si;
         }
 
         return s;
@@ -507,6 +833,8 @@ public:
         Spectrum s(0.);
 
         if (scene.intersect(r, si)) {
+            record_hit(si);
+
             Ray rs;
             rs.o = si.pos - 0.001f * r.d;
 
@@ -554,14 +882,21 @@ public:
                 return render_pixel(r, scene, sampler);
             }
 
-            if (si.brdf->is_emissive())
+            record_hit(si);
+            if (si.brdf->is_emissive()) {
+                record_light(light_group(si), si.brdf->emission());
                 return si.brdf->emission();
+            }
+
+            record_albedo(si, si.to_local(-r.d));
 
             s += uniform_sample_one_light(r, si, scene, sampler);
         }
         else {
-            for (const auto& light : scene.infinite_lights)
+            for (const auto& light : scene.infinite_lights) {
+                record_light(light->group, light->eval(r.d));
                 s += light->eval(r.d);
+            }
         }
 
         return s;
@@ -90,6 +90,28 @@ static void json_set_brdf(const json& j, std::shared_ptr<Brdf>* ptr,
     *ptr = ref[brdf_name];
 }
 
+/**
+ * @brief Set a list of BRDFs from a JSON array of names.
+ * the map of BRDFs have to be defined beforehand
+ */
+static void json_set_brdfs(const json& j, std::vector<std::shared_ptr<Brdf>>* ptr,
+    std::map<std::string, std::shared_ptr<Brdf>>& ref)
+{
+    ptr->clear();
+    for (const auto& brdf_name : j)
+        ptr->push_back(ref[brdf_name]);
+}
+
+/**
+ * @brief Set an array of floats from JSON.
+ */
+static void json_set_array(const json& j, std::vector<float>* ptr)
+{
+    ptr->clear();
+    for (const auto& v : j)
+        ptr->push_back(v);
+}
+
 static void json_set_texture(const json& j, Texture<Spectrum>* ptr, const std::string& dir)
 {
     std::string texture_path = dir + std::string(j);
@@ -115,6 +137,9 @@ static void set_params(const json& j, const Params& params, const std::string& d
             case Params::Type::FLOAT:
                 json_set_float(j[params.names[i]], (float*)params.ptrs[i]);
                 break;
+            case Params::Type::FLOATS:
+                json_set_array(j[params.names[i]], (std::vector<float>*)params.ptrs[i]);
+                break;
             case Params::Type::INT:
                 json_set_int(j[params.names[i]], (int*)params.ptrs[i]);
                 break;
@@ -131,6 +156,13 @@ static void set_params(const json& j, const Params& params, const std::string& d
                 json_set_brdf(j[params.names[i]],
                     (std::shared_ptr<Brdf>*)params.ptrs[i], brdf_ref);
                 break;
+            case Params::Type::BRDFS:
+                json_set_brdfs(j[params.names[i]],
+                    (std::vector<std::shared_ptr<Brdf>>*)params.ptrs[i], brdf_ref);
+                break;
+            case Params::Type::SH:
+                json_set_array(j[params.names[i]], (std::vector<float>*)params.ptrs[i]);
+                break;
             case Params::Type::TEXTURE:
                 json_set_texture(j[params.names[i]],
                     (Texture<Spectrum>*)params.ptrs[i], dir);
@@ -182,6 +214,9 @@ static bool generate_from_json(const std::string& path, const std::string& str,
     if (json_scn.contains("max_sample")) {
         ren.max_sample = (int)json_scn["max_sample"];
     }
+    ren.output_interval = json_scn.value("output_interval", 0);
+    ren.checkpoint_interval = json_scn.value("checkpoint_interval", 0);
+    ren.stream_tile_size = json_scn.value("stream_tile_size", 0);
 
     // Parse Integrator
     if (json_scn.contains("integrator")) {
@@ -193,6 +228,8 @@ static bool generate_from_json(const std::string& path, const std::string& str,
 
         // Set parameters and initialize the integrator
         set_params(json_integrator, integrator->params, dir, brdf_ref);
+        if (json_integrator.contains("aovs"))
+            integrator->aovs = json_integrator["aovs"].get<std::vector<std::string>>();
         integrator->init();
 
         // Set the integrator in the renderer
@@ -211,7 +248,32 @@ static bool generate_from_json(const std::string& path, const std::string& str,
 
         // Set parameters and initialize the sensor
         set_params(json_sensor, sensor->params, dir, brdf_ref);
-        sensor->init();
+        sensor->compression = json_sensor.value("compression", sensor->compression);
+
+        // Optional crop window, [x0, y0, x1, y1] in pixels or in [0, 1] of the image
+        if (json_sensor.contains("crop")) {
+            std::vector<int> c = json_sensor["crop"];
+            if (c.size() == 4)
+                sensor->set_crop(c[0], c[1], c[2], c[3]);
+        } else if (json_sensor.contains("crop_ndc")) {
+            std::vector<Float> c = json_sensor["crop_ndc"];
+            if (c.size() == 4)
+                sensor->set_crop_ndc(c[0], c[1], c[2], c[3]);
+        }
+
+        // Optional reconstruction filter, initialized by the sensor
+        if (json_sensor.contains("filter")) {
+            json json_filter = json_sensor["filter"];
+            std::shared_ptr<Filter> filter = Factory<Filter>::create(json_filter["type"]);
+            if (!filter)
+                return false;
+            set_params(json_filter, filter->params, dir, brdf_ref);
+            sensor->filter = filter;
+        }
+
+        // A streamed render allocates the sensor for each band of tiles
+        if (ren.stream_tile_size <= 0)
+            sensor->init();
 
         ren.sensor = sensor;
     } else {
@@ -305,11 +367,19 @@ static bool generate_from_json(const std::string& path, const std::string& str,
             set_params(json_geometry, geometry->params, dir, brdf_ref);
             geometry->init();
 
+            // Emitters read the light params, like "group", from the geometry
             if (geometry->brdf->is_emissive() && geometry->type == "Sphere") {
                 std::shared_ptr<SphereLight> sphere_light = std::make_shared<SphereLight>();
                 sphere_light->sphere = std::dynamic_pointer_cast<Sphere>(geometry);
+                set_params(json_geometry, sphere_light->params, dir, brdf_ref);
                 sphere_light->init();
                 scn.lights.push_back(sphere_light);
+            } else if (geometry->brdf->is_emissive() && geometry->type == "Mesh") {
+                std::shared_ptr<MeshLight> mesh_light = std::make_shared<MeshLight>();
+                mesh_light->mesh = std::dynamic_pointer_cast<Mesh>(geometry);
+                set_params(json_geometry, mesh_light->params, dir, brdf_ref);
+                mesh_light->init();
+                scn.lights.push_back(mesh_light);
             }
 
             // Add the geometry to the scene
@@ -322,6 +392,24 @@ static bool generate_from_json(const std::string& path, const std::string& str,
     // Initialize the scene's acceleration structure
     scn.init_rtc();
 
+    // Parse Denoiser, it is guided by AOVs
+    if (json_scn.contains("denoiser")) {
+        json json_denoiser = json_scn["denoiser"];
+        std::shared_ptr<AtrousDenoiser> denoiser = std::make_shared<AtrousDenoiser>();
+        set_params(json_denoiser, denoiser->params, dir, brdf_ref);
+        denoiser->init();
+        ren.denoiser = denoiser;
+
+        if (ren.integrator)
+            for (const std::string& aov : { "albedo", "normal", "depth" })
+                if (std::find(ren.integrator->aovs.begin(), ren.integrator->aovs.end(), aov) == ren.integrator->aovs.end())
+                    ren.integrator->aovs.push_back(aov);
+    }
+
+    // AOVs need the sensor, and the lights for the light groups
+    if (ren.integrator && ren.sensor)
+        ren.integrator->init_aovs(*ren.sensor, scn);
+
     return true;
 }
 
@@ -4,24 +4,336 @@
 #include <lt/texture.h>
 #include <tiny_exr/tinyexr.h>
 
+#include <condition_variable>
+#include <cstring>
+#include <deque>
 #include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <thread>
 
 namespace LT_NAMESPACE {
 
-static int save_sensor_exr(const Sensor& sen, const std::string& filename)
+/**
+ * @brief Named attribute of the header of an EXR file, stored as the bytes of the EXR type.
+ */
+struct ExrAttribute {
+    std::string name;
+    std::string type; /**< EXR type name, "int", "float" or "string". */
+    std::vector<unsigned char> value;
+
+    static ExrAttribute from_int(const std::string& name, const int& v)
+    {
+        const unsigned char* b = reinterpret_cast<const unsigned char*>(&v);
+        return { name, "int", std::vector<unsigned char>(b, b + sizeof(int)) };
+    }
+
+    static ExrAttribute from_float(const std::string& name, const float& v)
+    {
+        const unsigned char* b = reinterpret_cast<const unsigned char*>(&v);
+        return { name, "float", std::vector<unsigned char>(b, b + sizeof(float)) };
+    }
+
+    static ExrAttribute from_string(const std::string& name, const std::string& v)
+    {
+        return { name, "string", std::vector<unsigned char>(v.begin(), v.end()) };
+    }
+};
+
+/**
+ * @brief Copy of a sensor as planar EXR channels, owned by the writer so the sensor can keep rendering.
+ *
+ * Each layer is a part of a multi-part file, or a channel prefix "layer." of a
+ * single-part file. The default layer holds the value array as R, G, B.
+ */
+struct ExrSnapshot {
+    struct Channel {
+        std::string name; /**< Full name of the channel, with the layer prefix. */
+        std::vector<float> data;
+        bool half; /**< Stored in half precision in the file. */
+    };
+
+    struct Layer {
+        std::string name; /**< Name of the part in a multi-part file. */
+        std::vector<Channel> channels;
+    };
+
+    std::string filename;
+    int w = 0;
+    int h = 0;
+    EXRBox2i data_window = {}; /**< Pixels of the image held by the snapshot, the crop window. */
+    EXRBox2i display_window = {}; /**< Whole image. */
+    int compression = TINYEXR_COMPRESSIONTYPE_ZIP; /**< TINYEXR_COMPRESSIONTYPE_*. */
+    bool multipart = false;
+    std::vector<Layer> layers;
+    std::vector<ExrAttribute> attributes;
+};
+
+/**
+ * @brief TINYEXR_COMPRESSIONTYPE_* of a name of the sensor "compression" parameter, ZIP if unknown.
+ */
+static int exr_compression(const std::string& name)
+{
+    if (name == "none")
+        return TINYEXR_COMPRESSIONTYPE_NONE;
+    if (name == "rle")
+        return TINYEXR_COMPRESSIONTYPE_RLE;
+    if (name == "zips")
+        return TINYEXR_COMPRESSIONTYPE_ZIPS;
+    if (name == "piz")
+        return TINYEXR_COMPRESSIONTYPE_PIZ;
+    if (name != "zip")
+        Log(logWarning) << "EXR compression " << name << " not supported by tinyexr, using zip";
+    return TINYEXR_COMPRESSIONTYPE_ZIP;
+}
+
+/**
+ * @brief Copies the value array, the AOVs and the variance of the sensor in a snapshot.
+ *
+ * Color layers follow \ref Sensor::half_output, the others stay in float. The
+ * header holds the mean number of samples per pixel as "spp" and the filter.
+ */
+static ExrSnapshot snapshot_sensor_exr(Sensor& sen, const std::string& filename)
+{
+    sen.resolve();
+
+    ExrSnapshot snap;
+    snap.filename = filename;
+    snap.w = sen.w;
+    snap.h = sen.h;
+    snap.data_window = { int(sen.crop_x), int(sen.crop_y), int(sen.crop_x + sen.w) - 1, int(sen.crop_y + sen.h) - 1 };
+    snap.display_window = { 0, 0, int(sen.full_w) - 1, int(sen.full_h) - 1 };
+    snap.compression = exr_compression(sen.compression);
+    snap.multipart = sen.multipart;
+
+    const size_t n_pixel = size_t(sen.w) * sen.h;
+    auto add_layer = [&](const std::string& name, const std::vector<std::string>& names, const std::vector<Spectrum>& values, bool color) {
+        ExrSnapshot::Layer layer { name.empty() ? "rgba" : name, {} };
+        for (size_t c = 0; c < names.size() && c < 3; c++) {
+            ExrSnapshot::Channel channel { name.empty() ? names[c] : name + "." + names[c], std::vector<float>(n_pixel), color && sen.half_output };
+            for (size_t i = 0; i < n_pixel; i++)
+                channel.data[i] = values[i][c];
+            layer.channels.push_back(std::move(channel));
+        }
+        snap.layers.push_back(std::move(layer));
+    };
+
+    add_layer("", { "R", "G", "B" }, sen.value, true);
+    for (uint32_t a = 0; a < sen.aovs.size(); a++) {
+        const SensorAov& aov = sen.aovs[a];
+        add_layer(aov.name, aov.channels, sen.resolve_aov(a), aov.channels[0] == "R");
+    }
+
+    // Variance of the mean of each pixel
+    if (const VarianceSensor* var_sen = dynamic_cast<const VarianceSensor*>(&sen)) {
+        std::vector<Spectrum> variance(n_pixel);
+        for (size_t i = 0; i < n_pixel; i++)
+            variance[i] = var_sen->variance_of_mean(i);
+        add_layer("variance", { "R", "G", "B" }, variance, false);
+    }
+
+    snap.attributes.push_back(ExrAttribute::from_float("spp", n_pixel > 0 ? float(double(sen.sum_counts) / n_pixel) : 0.f));
+    snap.attributes.push_back(ExrAttribute::from_string("filter", sen.filter->type));
+    return snap;
+}
+
+/**
+ * @brief Moves the scanline image encoded by tinyexr, whose data window is always at
+ * the origin, to the data window of a crop in the display window of the whole image.
+ *
+ * The windows of all the headers are replaced, and the row of each chunk is offset
+ * by the first row of the data window.
+ *
+ * @return False if the encoded image can not be parsed.
+ */
+static bool move_exr_data_window(unsigned char* memory, const size_t& size, const EXRBox2i& data_window, const EXRBox2i& display_window)
+{
+    if (data_window.min_x == 0 && data_window.min_y == 0 && display_window.max_x == data_window.max_x
+        && display_window.max_y == data_window.max_y)
+        return true;
+
+    auto read_int = [&](const size_t& pos) {
+        int32_t v;
+        std::memcpy(&v, memory + pos, sizeof(v));
+        return v;
+    };
+    auto write_box = [&](const size_t& pos, const EXRBox2i& box) {
+        const int32_t b[4] = { box.min_x, box.min_y, box.max_x, box.max_y };
+        std::memcpy(memory + pos, b, sizeof(b));
+    };
+
+    // Headers, a list of attributes ended by an empty name, multi-part files end with an empty header
+    if (size < 8)
+        return false;
+    const bool multipart = read_int(4) & 0x1000;
+    size_t pos = 8;
+    while (true) {
+        if (pos >= size)
+            return false;
+        if (memory[pos] == 0) {
+            pos++;
+            break;
+        }
+        while (pos < size && memory[pos] != 0) {
+            const char* name = (const char*)memory + pos;
+            const size_t name_end = pos + strnlen(name, size - pos);
+            const size_t type_end = name_end + 1 + strnlen((const char*)memory + name_end + 1, size - std::min(size, name_end + 1));
+            if (type_end + 5 > size)
+                return false;
+            const int32_t attribute_size = read_int(type_end + 1);
+            const size_t value = type_end + 5;
+            if (attribute_size < 0 || value + attribute_size > size)
+                return false;
+            if (attribute_size == 16 && std::strcmp(name, "dataWindow") == 0)
+                write_box(value, data_window);
+            else if (attribute_size == 16 && std::strcmp(name, "displayWindow") == 0)
+                write_box(value, display_window);
+            pos = value + attribute_size;
+        }
+        pos++;
+        if (!multipart)
+            break;
+    }
+
+    // The offset table of all the parts precedes the first chunk
+    if (pos + sizeof(uint64_t) > size)
+        return false;
+    uint64_t first;
+    std::memcpy(&first, memory + pos, sizeof(first));
+    if (first <= pos || first > size || (first - pos) % sizeof(uint64_t) != 0)
+        return false;
+    for (size_t entry = pos; entry < first; entry += sizeof(uint64_t)) {
+        uint64_t chunk;
+        std::memcpy(&chunk, memory + entry, sizeof(chunk));
+        // Multi-part chunks start with their part number
+        const size_t y = size_t(chunk) + (multipart ? 4 : 0);
+        if (chunk < first || y + 4 > size)
+            return false;
+        const int32_t row = read_int(y) + data_window.min_y;
+        std::memcpy(memory + y, &row, sizeof(row));
+    }
+    return true;
+}
+
+/**
+ * @brief Encodes and writes a snapshot, the directories of the file are created if needed.
+ */
+static int save_snapshot_exr(const ExrSnapshot& snap, const char** err)
 {
     namespace fs = std::filesystem;
-    fs::path p("./"+filename);
-    fs::path d = p.parent_path();
-    if (!fs::is_directory(d) || !fs::exists(d)) { // Check if src folder exists
-        fs::create_directories(d); // create src folder
+    fs::path d = fs::path(snap.filename).parent_path();
+    // Without throwing in the writer thread, opening the file reports the error
+    std::error_code ec;
+    if (!d.empty() && !fs::is_directory(d))
+        fs::create_directories(d, ec);
+
+    // Single-part files hold all the layers, tinyexr needs two parts or more for a multi-part file
+    const bool multipart = snap.multipart && snap.layers.size() > 1;
+    std::vector<std::vector<const ExrSnapshot::Channel*>> parts;
+    for (const ExrSnapshot::Layer& layer : snap.layers) {
+        if (parts.empty() || multipart)
+            parts.emplace_back();
+        for (const ExrSnapshot::Channel& channel : layer.channels)
+            parts.back().push_back(&channel);
     }
 
-    const char* err;
-    int ret = SaveEXR((float*)sen.value.data(), sen.w, sen.h, 3, 0,
-        filename.c_str(), &err);
+    // tinyexr keeps pointers to the EXR structs, they are sized before being filled
+    const size_t n_part = parts.size();
+    std::vector<EXRAttribute> attributes(snap.attributes.size());
+    for (size_t a = 0; a < snap.attributes.size(); a++) {
+        const ExrAttribute& attribute = snap.attributes[a];
+        strncpy(attributes[a].name, attribute.name.c_str(), 255);
+        attributes[a].name[255] = '\0';
+        strncpy(attributes[a].type, attribute.type.c_str(), 255);
+        attributes[a].type[255] = '\0';
+        attributes[a].value = const_cast<unsigned char*>(attribute.value.data());
+        attributes[a].size = int(attribute.value.size());
+    }
+
+    std::vector<std::vector<EXRChannelInfo>> infos(n_part);
+    std::vector<std::vector<int>> pixel_types(n_part);
+    std::vector<std::vector<int>> requested_pixel_types(n_part);
+    std::vector<std::vector<float*>> images(n_part);
+    std::vector<EXRHeader> headers(n_part);
+    std::vector<EXRImage> exr_images(n_part);
+    std::vector<EXRHeader*> header_ptrs(n_part);
+
+    for (size_t p = 0; p < n_part; p++) {
+        // Readers expect the channels sorted by name
+        std::vector<const ExrSnapshot::Channel*>& channels = parts[p];
+        std::sort(channels.begin(), channels.end(), [](const ExrSnapshot::Channel* c1, const ExrSnapshot::Channel* c2) { return c1->name < c2->name; });
+
+        infos[p].resize(channels.size());
+        pixel_types[p].assign(channels.size(), TINYEXR_PIXELTYPE_FLOAT);
+        requested_pixel_types[p].resize(channels.size());
+        images[p].resize(channels.size());
+        for (size_t c = 0; c < channels.size(); c++) {
+            strncpy(infos[p][c].name, channels[c]->name.c_str(), 255);
+            infos[p][c].name[255] = '\0';
+            requested_pixel_types[p][c] = channels[c]->half ? TINYEXR_PIXELTYPE_HALF : TINYEXR_PIXELTYPE_FLOAT;
+            images[p][c] = const_cast<float*>(channels[c]->data.data());
+        }
+
+        EXRHeader& header = headers[p];
+        InitEXRHeader(&header);
+        header.compression_type = snap.w < 16 && snap.h < 16 ? TINYEXR_COMPRESSIONTYPE_NONE : snap.compression;
+        header.num_channels = int(channels.size());
+        header.channels = infos[p].data();
+        header.pixel_types = pixel_types[p].data();
+        header.requested_pixel_types = requested_pixel_types[p].data();
+        header.data_window = snap.data_window;
+        header.display_window = snap.display_window;
+        header.num_custom_attributes = int(attributes.size());
+        header.custom_attributes = attributes.data();
+        if (multipart)
+            EXRSetNameAttr(&header, snap.layers[p].name.c_str());
+        header_ptrs[p] = &header;
+
+        EXRImage& image = exr_images[p];
+        InitEXRImage(&image);
+        image.num_channels = int(channels.size());
+        image.images = reinterpret_cast<unsigned char**>(images[p].data());
+        image.width = snap.w;
+        image.height = snap.h;
+    }
+
+    unsigned char* memory = nullptr;
+    size_t size = multipart
+        ? SaveEXRMultipartImageToMemory(exr_images.data(), const_cast<const EXRHeader**>(header_ptrs.data()), unsigned(n_part), &memory, err)
+        : SaveEXRImageToMemory(exr_images.data(), headers.data(), &memory, err);
+    if (size == 0)
+        return TINYEXR_ERROR_SERIALIZATION_FAILED;
+
+    bool moved = move_exr_data_window(memory, size, snap.data_window, snap.display_window);
+    std::ofstream file(snap.filename, std::ios::binary | std::ios::trunc);
+    if (moved && file)
+        file.write((const char*)memory, size);
+    free(memory);
+    if (!moved || !file) {
+        // Freed by FreeEXRErrorMessage like the messages of tinyexr
+        const std::string message = moved ? "Cannot write a file: " + snap.filename : "Invalid EXR image encoded by tinyexr";
+        char* copy = (char*)malloc(message.size() + 1);
+        std::memcpy(copy, message.c_str(), message.size() + 1);
+        *err = copy;
+        return moved ? TINYEXR_ERROR_CANT_WRITE_FILE : TINYEXR_ERROR_SERIALIZATION_FAILED;
+    }
+    return TINYEXR_SUCCESS;
+}
+
+/**
+ * @brief Writes the value array, the AOVs and the variance of the sensor in an EXR file.
+ * @param attributes Attributes added to the header, such as the render time.
+ */
+static int save_sensor_exr(Sensor& sen, const std::string& filename, const std::vector<ExrAttribute>& attributes = {})
+{
+    ExrSnapshot snap = snapshot_sensor_exr(sen, filename);
+    snap.attributes.insert(snap.attributes.end(), attributes.begin(), attributes.end());
+
+    const char* err = nullptr;
+    int ret = save_snapshot_exr(snap, &err);
     if (ret != TINYEXR_SUCCESS) {
         Log(logError) << "Save EXR err : " << err;
+        FreeEXRErrorMessage(err);
         return ret;
     }
 
@@ -30,6 +342,363 @@ static int save_sensor_exr(const Sensor& sen, const std::string& filename)
     return 0;
 };
 
+/**
+ * @brief Writes EXR files on a background thread, so that progressive outputs do not stall the render.
+ *
+ * \ref write copies the sensor and returns, the copy is compressed and written
+ * by the thread. Files are written in order; when \ref max_pending copies wait,
+ * \ref write blocks until the oldest one is written.
+ */
+class ExrWriter {
+public:
+    ExrWriter()
+        : stop(false)
+        , busy(false)
+        , failed(false)
+        , thread([this] { run(); })
+    {
+    }
+
+    ~ExrWriter()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+        }
+        cv.notify_all();
+        thread.join();
+    }
+
+    /**
+     * @brief Queues a copy of the sensor for writing.
+     * @param attributes Attributes added to the header, such as the render time.
+     */
+    void write(Sensor& sen, const std::string& filename, const std::vector<ExrAttribute>& attributes = {})
+    {
+        ExrSnapshot snap = snapshot_sensor_exr(sen, filename);
+        snap.attributes.insert(snap.attributes.end(), attributes.begin(), attributes.end());
+
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [this] { return queue.size() < max_pending; });
+        queue.push_back(std::move(snap));
+        cv.notify_all();
+    }
+
+    /**
+     * @brief Blocks until all the queued files are written.
+     * @return False if a file queued since the previous wait could not be written.
+     */
+    bool wait()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [this] { return queue.empty() && !busy; });
+        bool ok = !failed;
+        failed = false;
+        return ok;
+    }
+
+    static constexpr size_t max_pending = 2; /**< Copies of the sensor waiting to be written, bounds the memory. */
+
+private:
+    void run()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            cv.wait(lock, [this] { return stop || !queue.empty(); });
+            if (queue.empty())
+                return;
+
+            ExrSnapshot snap = std::move(queue.front());
+            queue.pop_front();
+            busy = true;
+            cv.notify_all();
+            lock.unlock();
+
+            const char* err = nullptr;
+            bool saved = save_snapshot_exr(snap, &err) == TINYEXR_SUCCESS;
+            if (!saved) {
+                Log(logError) << "Save EXR err : " << err;
+                FreeEXRErrorMessage(err);
+            } else {
+                Log(logInfo) << "Saved exr file. [ " << snap.filename << "]";
+            }
+
+            lock.lock();
+            failed = failed || !saved;
+            busy = false;
+            cv.notify_all();
+        }
+    }
+
+    std::mutex mutex;
+    std::condition_variable cv; /**< Signals new snapshots, written ones, and the stop. */
+    std::deque<ExrSnapshot> queue;
+    bool stop;
+    bool busy; /**< A snapshot was taken out of the queue and is being written. */
+    bool failed; /**< A snapshot could not be written since the last \ref wait. */
+    std::thread thread; /**< Declared last, it starts once the other members are initialized. */
+};
+
+/**
+ * @brief Half precision bits of a float, rounded to the nearest even.
+ */
+static uint16_t exr_half(const float& f)
+{
+    uint32_t x;
+    std::memcpy(&x, &f, sizeof(x));
+    const uint32_t sign = (x >> 16) & 0x8000;
+    const uint32_t biased = (x >> 23) & 0xff;
+    uint32_t mantissa = x & 0x7fffff;
+    const int e = int(biased) - 127 + 15;
+
+    if (biased == 0xff)
+        return sign | 0x7c00 | (mantissa ? 0x200 : 0);
+    if (e >= 31)
+        return sign | 0x7c00;
+    if (e <= 0) {
+        // Denormals, or zero below half of the smallest one
+        if (e < -10)
+            return sign;
+        mantissa |= 0x800000;
+        const int shift = 14 - e;
+        uint32_t h = mantissa >> shift;
+        const uint32_t rest = mantissa & ((1u << shift) - 1);
+        const uint32_t middle = 1u << (shift - 1);
+        if (rest > middle || (rest == middle && (h & 1)))
+            h++;
+        return sign | h;
+    }
+
+    // A carry of the rounding goes to the exponent, up to infinity
+    uint32_t h = (uint32_t(e) << 10) | (mantissa >> 13);
+    const uint32_t rest = mantissa & 0x1fff;
+    if (rest > 0x1000 || (rest == 0x1000 && (h & 1)))
+        h++;
+    return sign | h;
+}
+
+/**
+ * @brief Tiled EXR file written one tile at a time, so that the image is never held whole in memory.
+ *
+ * The header is written with the channels of the first tile, each tile is then
+ * appended as soon as it is complete, and \ref close fills the offset table.
+ * Tiles are not compressed, tinyexr only encodes whole images, and the layers
+ * are channel prefixes of a single part. Tiles should be written row by row, the
+ * order declared in the header.
+ */
+class ExrTileStream {
+public:
+    /**
+     * @param data_window Pixels of the image written, the tiles start at its top left corner.
+     * @param display_window Whole image.
+     * @param tile_size Width and height of the tiles, the last ones of a row or column are cut by the data window.
+     * @param attributes Attributes added to the header, such as the number of passes.
+     */
+    ExrTileStream(const std::string& filename, const EXRBox2i& data_window, const EXRBox2i& display_window, const int& tile_size,
+        const std::vector<ExrAttribute>& attributes = {})
+        : filename(filename)
+        , data_window(data_window)
+        , display_window(display_window)
+        , tile_size(tile_size)
+        , n_tile_x((data_window.max_x - data_window.min_x + tile_size) / tile_size)
+        , n_tile_y((data_window.max_y - data_window.min_y + tile_size) / tile_size)
+        , attributes(attributes)
+        , offsets(size_t(n_tile_x) * n_tile_y, 0)
+        , table(0)
+    {
+    }
+
+    ~ExrTileStream() { close(); }
+
+    /**
+     * @brief Appends the tile whose top left pixel of the image is (x0, y0).
+     * @param snap Pixels of a window of the image holding the tile, the first one gives the channels of the file.
+     * @return False if the file could not be written, or the snapshot does not hold the tile.
+     */
+    bool write_tile(const ExrSnapshot& snap, const int& x0, const int& y0)
+    {
+        const int tx = (x0 - data_window.min_x) / tile_size;
+        const int ty = (y0 - data_window.min_y) / tile_size;
+        const int w = std::min(tile_size, data_window.max_x + 1 - x0);
+        const int h = std::min(tile_size, data_window.max_y + 1 - y0);
+        if (tx < 0 || ty < 0 || tx >= n_tile_x || ty >= n_tile_y || x0 != data_window.min_x + tx * tile_size
+            || y0 != data_window.min_y + ty * tile_size || x0 < snap.data_window.min_x || y0 < snap.data_window.min_y
+            || x0 + w - 1 > snap.data_window.max_x || y0 + h - 1 > snap.data_window.max_y)
+            return false;
+
+        if (!file.is_open() && !open(snap))
+            return false;
+
+        // Channels of the snapshot in the order of the header
+        std::vector<const ExrSnapshot::Channel*> snap_channels;
+        for (const Channel& channel : channels) {
+            const ExrSnapshot::Channel* found = nullptr;
+            for (const ExrSnapshot::Layer& layer : snap.layers)
+                for (const ExrSnapshot::Channel& c : layer.channels)
+                    if (c.name == channel.name)
+                        found = &c;
+            if (!found)
+                return false;
+            snap_channels.push_back(found);
+        }
+
+        // Scanlines of the tile, each holding the channels one after the other
+        std::vector<unsigned char> data;
+        data.reserve(size_t(w) * h * pixel_size);
+        for (int y = y0; y < y0 + h; y++) {
+            const size_t row = size_t(y - snap.data_window.min_y) * snap.w + (x0 - snap.data_window.min_x);
+            for (size_t c = 0; c < channels.size(); c++) {
+                const float* src = snap_channels[c]->data.data() + row;
+                for (int x = 0; x < w; x++) {
+                    if (channels[c].half) {
+                        uint16_t v = exr_half(src[x]);
+                        append(data, &v, sizeof(v));
+                    } else {
+                        append(data, &src[x], sizeof(float));
+                    }
+                }
+            }
+        }
+
+        int32_t chunk[5] = { tx, ty, 0, 0, int32_t(data.size()) };
+        offsets[size_t(ty) * n_tile_x + tx] = uint64_t(file.tellp());
+        file.write((const char*)chunk, sizeof(chunk));
+        file.write((const char*)data.data(), data.size());
+        return bool(file);
+    }
+
+    /**
+     * @brief Writes the offset table and closes the file, the tiles that were not written are missing from it.
+     * @return False if the file could not be written.
+     */
+    bool close()
+    {
+        if (!file.is_open())
+            return false;
+
+        file.seekp(table);
+        file.write((const char*)offsets.data(), sizeof(uint64_t) * offsets.size());
+        bool ok = bool(file);
+        file.close();
+        if (ok)
+            Log(logInfo) << "Saved exr file. [ " << filename << "]";
+        return ok;
+    }
+
+    /**
+     * @brief Number of tiles of the file.
+     */
+    int tile_count() const { return n_tile_x * n_tile_y; }
+
+private:
+    struct Channel {
+        std::string name;
+        bool half;
+    };
+
+    static void append(std::vector<unsigned char>& out, const void* data, const size_t& size)
+    {
+        const unsigned char* b = reinterpret_cast<const unsigned char*>(data);
+        out.insert(out.end(), b, b + size);
+    }
+
+    static void append_attribute(std::vector<unsigned char>& out, const std::string& name, const std::string& type, const std::vector<unsigned char>& value)
+    {
+        out.insert(out.end(), name.begin(), name.end());
+        out.push_back(0);
+        out.insert(out.end(), type.begin(), type.end());
+        out.push_back(0);
+        int32_t size = int32_t(value.size());
+        append(out, &size, sizeof(size));
+        out.insert(out.end(), value.begin(), value.end());
+    }
+
+    /**
+     * @brief Creates the file and writes the header, the offset table is reserved with zeros.
+     */
+    bool open(const ExrSnapshot& snap)
+    {
+        for (const ExrSnapshot::Layer& layer : snap.layers)
+            for (const ExrSnapshot::Channel& channel : layer.channels)
+                channels.push_back({ channel.name, channel.half });
+
+        // Readers expect the channels sorted by name
+        std::sort(channels.begin(), channels.end(), [](const Channel& c1, const Channel& c2) { return c1.name < c2.name; });
+        pixel_size = 0;
+        for (const Channel& channel : channels)
+            pixel_size += channel.half ? 2 : 4;
+
+        namespace fs = std::filesystem;
+        fs::path d = fs::path(filename).parent_path();
+        std::error_code ec;
+        if (!d.empty() && !fs::is_directory(d))
+            fs::create_directories(d, ec);
+        file.open(filename, std::ios::binary | std::ios::trunc);
+        if (!file)
+            return false;
+
+        std::vector<unsigned char> header;
+        const int32_t magic = 20000630;
+        const int32_t version = 2 | 0x200;
+        append(header, &magic, sizeof(magic));
+        append(header, &version, sizeof(version));
+
+        // Attributes in the order of the OpenEXR library, the custom ones last
+        std::vector<unsigned char> chlist;
+        for (const Channel& channel : channels) {
+            chlist.insert(chlist.end(), channel.name.begin(), channel.name.end());
+            chlist.push_back(0);
+            int32_t info[4] = { channel.half ? TINYEXR_PIXELTYPE_HALF : TINYEXR_PIXELTYPE_FLOAT, 0, 1, 1 };
+            append(chlist, info, sizeof(info));
+        }
+        chlist.push_back(0);
+
+        auto bytes = [](const void* data, const size_t& size) {
+            const unsigned char* b = reinterpret_cast<const unsigned char*>(data);
+            return std::vector<unsigned char>(b, b + size);
+        };
+        const int32_t dw[4] = { data_window.min_x, data_window.min_y, data_window.max_x, data_window.max_y };
+        const int32_t dsw[4] = { display_window.min_x, display_window.min_y, display_window.max_x, display_window.max_y };
+        const float aspect = 1.f;
+        const float center[2] = { 0.f, 0.f };
+        const float window_width = 1.f;
+        const uint32_t tiles[2] = { uint32_t(tile_size), uint32_t(tile_size) };
+        std::vector<unsigned char> tiledesc = bytes(tiles, sizeof(tiles));
+        tiledesc.push_back(0); // ONE_LEVEL, ROUND_DOWN
+
+        append_attribute(header, "channels", "chlist", chlist);
+        append_attribute(header, "compression", "compression", { TINYEXR_COMPRESSIONTYPE_NONE });
+        append_attribute(header, "dataWindow", "box2i", bytes(dw, sizeof(dw)));
+        append_attribute(header, "displayWindow", "box2i", bytes(dsw, sizeof(dsw)));
+        append_attribute(header, "lineOrder", "lineOrder", { 0 }); // INCREASING_Y, tinyexr misreads RANDOM_Y tiles
+        append_attribute(header, "pixelAspectRatio", "float", bytes(&aspect, sizeof(aspect)));
+        append_attribute(header, "screenWindowCenter", "v2f", bytes(center, sizeof(center)));
+        append_attribute(header, "screenWindowWidth", "float", bytes(&window_width, sizeof(window_width)));
+        append_attribute(header, "tiles", "tiledesc", tiledesc);
+        for (const ExrAttribute& attribute : attributes)
+            append_attribute(header, attribute.name, attribute.type, attribute.value);
+        header.push_back(0);
+
+        file.write((const char*)header.data(), header.size());
+        table = file.tellp();
+        file.write((const char*)offsets.data(), sizeof(uint64_t) * offsets.size());
+        return bool(file);
+    }
+
+    std::string filename;
+    EXRBox2i data_window;
+    EXRBox2i display_window;
+    int tile_size;
+    int n_tile_x;
+    int n_tile_y;
+    std::vector<ExrAttribute> attributes;
+    std::vector<Channel> channels; /**< Channels of the file sorted by name, set by the first tile. */
+    size_t pixel_size = 0; /**< Bytes of a pixel over all the channels. */
+    std::vector<uint64_t> offsets; /**< Position of each tile in the file, one per tile and not per pixel. */
+    std::streampos table; /**< Position of the offset table in the file. */
+    std::ofstream file;
+};
+
 static int load_texture_exr(const std::string& filename, Texture<Spectrum>& t)
 {
     float* out;
@@ -8,6 +8,7 @@ namespace LT_NAMESPACE {
         static Factory<Light>::CreatorRegistry registry{
             { "DirectionnalLight", std::make_shared<DirectionnalLight> },
             { "SphereLight", std::make_shared<SphereLight> },
+            { "MeshLight", std::make_shared<MeshLight> },
             { "EnvironmentLight", std::make_shared<EnvironmentLight> }
         };
         return registry;
@@ -40,27 +41,44 @@ namespace LT_NAMESPACE {
         return 0.;
     }
 
+    /**
+     * @brief Lat-long texture coordinates of a direction toward the envmap.
+     */
+    static inline vec2 latlong_uv(const vec3& direction)
+    {
+        Float phi = math::atan2(direction.z, direction.x);
+        phi = (phi < 0. ? 2 * pi + phi : phi);
+        return vec2(phi / (2 * pi), math::acos(glm::clamp(direction.y, -1.f, 1.f)) / pi);
+    }
+
+    /**
+     * @brief Swap between the envmap frame (y up) and the octahedral frame (z up).
+     */
+    static inline vec3 env_to_octahedral_frame(const vec3& w)
+    {
+        return vec3(w.x, w.z, w.y);
+    }
+
     void EnvironmentLight::init()
     {
         dtheta = pi / (Float)envmap.h;
         dphi = 2. * pi / (Float)envmap.w;
 
-        compute_density();
+        if (octahedral)
+            compute_octahedral_density();
+        else
+            compute_density();
         c = std::vector<float>(
             cumulative_density.data,
             cumulative_density.data + cumulative_density.w * cumulative_density.h);
         c.insert(c.begin(), 0.);
+
+        if (product_sampling)
+            compute_product_regions();
     }
 
     Light::Sample EnvironmentLight::sample(const SurfaceInteraction& si, Sampler& sampler)
     {
-        Sample s;
-#if 0
-        s.direction =-square_to_uniform_sphere(sampler.next_float(), sampler.next_float());
-        s.pdf = square_to_uniform_sphere_pdf();
-        Float solid_angle = 1.;
-#endif // 0
-#if 1
         Float u = sampler.next_float();
 
         // Binary search
@@ -72,6 +90,26 @@ namespace LT_NAMESPACE {
         // From inv_cumulative_density
         int id = inv_cumulative_density.data[int(u * inv_cumulative_density.h * inv_cumulative_density.w)];
 
+        return sample_texel(id, sampler);
+    }
+
+    Light::Sample EnvironmentLight::sample_texel(const int& id, Sampler& sampler)
+    {
+        Sample s;
+        s.expected_distance_to_intersection = std::numeric_limits<Float>::infinity();
+
+        if (octahedral) {
+            // Uniform sample inside the selected texel of the octahedral map
+            Float su = ((Float)(id % density.w) + sampler.next_float()) / (Float)density.w;
+            Float sv = ((Float)(id / density.w) + sampler.next_float()) / (Float)density.h;
+            vec3 w = square_to_octahedral(su, sv);
+
+            s.direction = -env_to_octahedral_frame(w);
+            s.pdf = density.data[id] * (Float)(density.w * density.h) * square_to_octahedral_pdf(w);
+            s.emission = octahedral_envmap.data[id] * intensity;
+            return s;
+        }
+
         int x = id % envmap.w;
         int y = id / envmap.w;
 
@@ -88,10 +126,38 @@ namespace LT_NAMESPACE {
         s.pdf = density.get(x, y) / solid_angle;
         //s.pdf = pdf(vec3(0.), s.direction);
         //s.pdf = density.data[id];
-#endif
         s.emission = eval(-s.direction);
-        s.expected_distance_to_intersection = std::numeric_limits<Float>::infinity();
-        
+
+        return s;
+    }
+
+    Light::Sample EnvironmentLight::sample(const SurfaceInteraction& si, const vec3& wi, Sampler& sampler)
+    {
+        if (!product_sampling || !si.brdf)
+            return sample(si, sampler);
+
+        const std::vector<Float>& cdf = product_cdf(si, wi);
+
+        // Nothing reflected toward wi, fall back on radiance sampling
+        if (cdf.back() <= 0.)
+            return sample(si, sampler);
+
+        int id;
+        if (sampler.next_float() < product_defensive_weight) {
+            Float u = sampler.next_float();
+            id = inv_cumulative_density.data[int(u * inv_cumulative_density.h * inv_cumulative_density.w)];
+        } else {
+            // Select a region according to radiance * brdf, then a texel according to radiance
+            int r = binary_search<Float>(cdf, sampler.next_float());
+
+            auto begin = region_texel_cdf.begin() + region_texel_offset[r];
+            auto end = region_texel_cdf.begin() + region_texel_offset[r + 1];
+            int t = std::min((int)(std::upper_bound(begin, end, sampler.next_float()) - begin), region_texel_offset[r + 1] - region_texel_offset[r] - 1);
+            id = region_texels[region_texel_offset[r] + t];
+        }
+
+        Sample s = sample_texel(id, sampler);
+        s.pdf *= product_factor(cdf, texel_region[id]);
         return s;
     }
 
@@ -103,11 +169,13 @@ namespace LT_NAMESPACE {
      */
     Spectrum EnvironmentLight::eval(const vec3& direction)
     {
-        Float phi = glm::atan(direction.z, direction.x);
-        phi = (phi < 0. ? 2 * pi + phi : phi);
-        Float u = phi / (2 * pi);
-        Float v = glm::acos(direction.y) / pi;
-        return envmap.eval(u, v) * intensity;
+        if (octahedral) {
+            vec2 uv = octahedral_to_square(env_to_octahedral_frame(direction));
+            return octahedral_envmap.eval(uv.x, uv.y) * intensity;
+        }
+
+        vec2 uv = latlong_uv(direction);
+        return envmap.eval(uv.x, uv.y) * intensity;
     }
 
     /**
@@ -120,12 +188,156 @@ namespace LT_NAMESPACE {
     Float EnvironmentLight::pdf(const vec3& p, const vec3& ld)
     {
         vec3 dir = -ld;
-        Float phi = glm::atan(dir.z, dir.x);
-        phi = (phi < 0. ? 2 * pi + phi : phi);
-        Float u = phi / (2 * pi);
-        Float v = glm::acos(dir.y) / pi;
+
+        if (octahedral) {
+            vec3 w = env_to_octahedral_frame(dir);
+            vec2 uv = octahedral_to_square(w);
+            return density.eval(uv.x, uv.y) * (Float)(density.w * density.h) * square_to_octahedral_pdf(w);
+        }
+
+        vec2 uv = latlong_uv(dir);
         Float solid_angle = std::sqrt(glm::clamp(1.0f - dir.y * dir.y, 0.000001f, 1.0f)) * dphi * dtheta;
-        return density.eval(u, v) / solid_angle;
+        return density.eval(uv.x, uv.y) / solid_angle;
+    }
+
+    Float EnvironmentLight::pdf(const SurfaceInteraction& si, const vec3& wi, const vec3& ld)
+    {
+        if (!product_sampling || !si.brdf)
+            return pdf(si.pos, ld);
+
+        const std::vector<Float>& cdf = product_cdf(si, wi);
+        if (cdf.back() <= 0.)
+            return pdf(si.pos, ld);
+
+        return pdf(si.pos, ld) * product_factor(cdf, texel_region[texel_index(-ld)]);
+    }
+
+    Float EnvironmentLight::product_factor(const std::vector<Float>& cdf, const int& region)
+    {
+        // p_product(w) = p_env(w) * P(region) / region_power[region]
+        Float region_weight = cdf[region + 1] - cdf[region];
+        Float product = region_power[region] > 0. ? region_weight / region_power[region] : 0.;
+        return product_defensive_weight + (1.f - product_defensive_weight) * product;
+    }
+
+    const std::vector<Float>& EnvironmentLight::product_cdf(const SurfaceInteraction& si, const vec3& wi)
+    {
+        // sample() and pdf() are called in sequence for the same shading point by
+        // estimate_direct, the region table is kept per thread to be computed once.
+        struct Cache {
+            const EnvironmentLight* light = nullptr;
+            const Brdf* brdf = nullptr;
+            vec3 pos;
+            vec3 wi;
+            std::vector<Float> cdf;
+            Sampler sampler;
+        };
+        static thread_local Cache cache;
+
+        if (cache.light == this && cache.brdf == si.brdf.get() && cache.pos == si.pos && cache.wi == wi)
+            return cache.cdf;
+
+        cache.light = this;
+        cache.brdf = si.brdf.get();
+        cache.pos = si.pos;
+        cache.wi = wi;
+
+        int n_region = region_power.size();
+        cache.cdf.resize(n_region + 1);
+        cache.cdf[0] = 0.;
+
+        // BRDF lobe evaluated toward the radiance weighted direction of each region
+        for (int r = 0; r < n_region; r++) {
+            Float weight = 0.;
+            vec3 wo = si.inv_tbn * region_direction[r];
+            if (region_power[r] > 0. && valid_local_dir(wo)) {
+                Spectrum f = si.brdf->eval(wi, wo, cache.sampler);
+                weight = region_power[r] * (f.r + f.g + f.b) * 0.333333f;
+            }
+            cache.cdf[r + 1] = cache.cdf[r] + std::max(weight, 0.f);
+        }
+
+        Float total = cache.cdf[n_region];
+        if (total > 0.) {
+            for (int r = 1; r <= n_region; r++)
+                cache.cdf[r] /= total;
+        }
+
+        return cache.cdf;
+    }
+
+    vec3 EnvironmentLight::texel_direction(const int& id)
+    {
+        Float u = ((Float)(id % density.w) + 0.5f) / (Float)density.w;
+        Float v = ((Float)(id / density.w) + 0.5f) / (Float)density.h;
+
+        if (octahedral)
+            return env_to_octahedral_frame(square_to_octahedral(u, v));
+
+        Float theta = pi * v;
+        Float phi = 2. * pi * u;
+        return vec3(sin(theta) * cos(phi), cos(theta), sin(theta) * sin(phi));
+    }
+
+    int EnvironmentLight::texel_index(const vec3& direction)
+    {
+        vec2 uv = octahedral ? octahedral_to_square(env_to_octahedral_frame(direction)) : latlong_uv(direction);
+        size_t x = std::min(size_t(uv.x * (Float)density.w), density.w - 1);
+        size_t y = std::min(size_t(uv.y * (Float)density.h), density.h - 1);
+        return y * density.w + x;
+    }
+
+    void EnvironmentLight::compute_product_regions()
+    {
+        // Regions are cells of a coarse octahedral map
+        int res = std::max(product_resolution, 1);
+        int n_region = res * res;
+        int n_texel = density.w * density.h;
+
+        region_power.assign(n_region, 0.);
+        region_direction.assign(n_region, vec3(0.));
+        texel_region.resize(n_texel);
+
+        std::vector<int> count(n_region, 0);
+        for (int n = 0; n < n_texel; n++) {
+            vec3 w = texel_direction(n);
+            vec2 uv = octahedral_to_square(env_to_octahedral_frame(w));
+            int x = std::min((int)(uv.x * res), res - 1);
+            int y = std::min((int)(uv.y * res), res - 1);
+            int r = y * res + x;
+
+            texel_region[n] = r;
+            region_power[r] += density.data[n];
+            region_direction[r] += density.data[n] * w;
+            count[r]++;
+        }
+
+        for (int r = 0; r < n_region; r++) {
+            if (glm::length(region_direction[r]) > 0.) {
+                region_direction[r] = glm::normalize(region_direction[r]);
+            } else {
+                Float u = ((Float)(r % res) + 0.5f) / (Float)res;
+                Float v = ((Float)(r / res) + 0.5f) / (Float)res;
+                region_direction[r] = env_to_octahedral_frame(square_to_octahedral(u, v));
+            }
+        }
+
+        // Texels grouped by region with their conditional cumulative density
+        region_texel_offset.assign(n_region + 1, 0);
+        for (int r = 0; r < n_region; r++)
+            region_texel_offset[r + 1] = region_texel_offset[r] + count[r];
+
+        region_texels.resize(n_texel);
+        region_texel_cdf.resize(n_texel);
+        std::vector<int> fill(region_texel_offset.begin(), region_texel_offset.end() - 1);
+        std::vector<Float> sum(n_region, 0.);
+        for (int n = 0; n < n_texel; n++) {
+            int r = texel_region[n];
+            sum[r] += density.data[n];
+            region_texels[fill[r]] = n;
+            region_texel_cdf[fill[r]] = region_power[r] > 0. ? sum[r] / region_power[r] : 1.;
+            fill[r]++;
+        }
     }
 
     void EnvironmentLight::compute_density()
@@ -146,29 +358,77 @@ namespace LT_NAMESPACE {
             }
         }
 
+        compute_cumulative_density();
+    }
+
+    void EnvironmentLight::compute_octahedral_density()
+    {
+        size_t res = octahedral_resolution > 0
+            ? octahedral_resolution
+            : std::max((size_t)1, (size_t)std::sqrt((Float)(envmap.w * envmap.h)));
+
+        octahedral_envmap.w = res;
+        octahedral_envmap.h = res;
+        octahedral_envmap.initialize();
+
+        density.w = res;
+        density.h = res;
+        density.initialize();
+
+        // Resample the lat-long envmap, each texel is supersampled to limit aliasing
+        const int n_sub = 4;
+        for (int y = 0; y < res; y++) {
+            for (int x = 0; x < res; x++) {
+                Spectrum sum(0.);
+                for (int sy = 0; sy < n_sub; sy++) {
+                    for (int sx = 0; sx < n_sub; sx++) {
+                        Float u = ((Float)x + ((Float)sx + 0.5f) / (Float)n_sub) / (Float)res;
+                        Float v = ((Float)y + ((Float)sy + 0.5f) / (Float)n_sub) / (Float)res;
+                        vec2 uv = latlong_uv(env_to_octahedral_frame(square_to_octahedral(u, v)));
+                        sum += envmap.eval(uv.x, uv.y);
+                    }
+                }
+                Spectrum s = sum / (Float)(n_sub * n_sub);
+                octahedral_envmap.set(x, y, s);
+
+                // Density is proportional to radiance times texel solid angle
+                vec3 w = square_to_octahedral(((Float)x + 0.5f) / (Float)res, ((Float)y + 0.5f) / (Float)res);
+                Float mean = (s.r + s.g + s.b) * 0.333333f;
+                density.set(x, y, mean / square_to_octahedral_pdf(w));
+            }
+        }
+
+        compute_cumulative_density();
+    }
+
+    void EnvironmentLight::compute_cumulative_density()
+    {
+        const int n_texel = density.w * density.h;
+
         // Compute cumulative density
-        cumulative_density.w = envmap.w;
-        cumulative_density.h = envmap.h;
+        cumulative_density.w = density.w;
+        cumulative_density.h = density.h;
         cumulative_density.initialize();
         cumulative_density.data[0] = density.data[0];
-        for (int n = 1; n < envmap.w * envmap.h; n++) {
+        for (int n = 1; n < n_texel; n++) {
             cumulative_density.data[n] = cumulative_density.data[n - 1] + density.data[n];
         }
 
         // Normalize density
-        for (int n = 0; n < envmap.w * envmap.h; n++) {
-            density.data[n] /= cumulative_density.data[envmap.w * envmap.h - 1];
-            cumulative_density.data[n] /= cumulative_density.data[envmap.w * envmap.h - 1];
+        Float total = cumulative_density.data[n_texel - 1];
+        for (int n = 0; n < n_texel; n++) {
+            density.data[n] /= total;
+            cumulative_density.data[n] /= total;
         }
 
-        inv_cumulative_density.w = envmap.w;
-        inv_cumulative_density.h = envmap.h;
+        inv_cumulative_density.w = density.w;
+        inv_cumulative_density.h = density.h;
         inv_cumulative_density.initialize();
 
-        std::vector<Float> u = linspace<Float>(0.,1., envmap.w * envmap.h, true);
+        std::vector<Float> u = linspace<Float>(0.,1., n_texel, true);
         
-        for (int n = 0; n < envmap.w * envmap.h; n++) {
-            int idx = binary_search<Float>(cumulative_density.data, u[n], envmap.w* envmap.h);
+        for (int n = 0; n < n_texel; n++) {
+            int idx = binary_search<Float>(cumulative_density.data, u[n], n_texel);
             inv_cumulative_density.data[n] = idx;
         }
 
@@ -237,4 +497,150 @@ namespace LT_NAMESPACE {
     }
 
 
+    void MeshLight::init()
+    {
+        size_t n_triangle = mesh->triangle_indices.size();
+        triangle_area.resize(n_triangle);
+        triangle_normal.resize(n_triangle);
+        total_area = 0.;
+
+        for (size_t t = 0; t < n_triangle; t++) {
+            const glm::uvec3& idx = mesh->triangle_indices[t];
+            vec3 n = glm::cross(mesh->vertex[idx.y] - mesh->vertex[idx.x], mesh->vertex[idx.z] - mesh->vertex[idx.x]);
+            Float l = glm::length(n);
+            triangle_area[t] = 0.5f * l;
+            triangle_normal[t] = l > 0. ? n / l : vec3(0.);
+            total_area += triangle_area[t];
+        }
+
+        if (!triangle_table.build(triangle_area))
+            Log(logWarning) << "MeshLight : " << mesh->filename << " has no area";
+    }
+
+    bool MeshLight::use_spherical_sampling(const vec3& p, const int& t, vec3& a, vec3& b, vec3& c, Float& solid_angle)
+    {
+        const glm::uvec3& idx = mesh->triangle_indices[t];
+        a = mesh->vertex[idx.x] - p;
+        b = mesh->vertex[idx.y] - p;
+        c = mesh->vertex[idx.z] - p;
+        if (a == vec3(0.) || b == vec3(0.) || c == vec3(0.))
+            return false;
+        a = glm::normalize(a);
+        b = glm::normalize(b);
+        c = glm::normalize(c);
+        solid_angle = spherical_triangle_area(a, b, c);
+        return solid_angle >= min_spherical_sample_area && solid_angle <= max_spherical_sample_area;
+    }
+
+    Light::Sample MeshLight::sample(const SurfaceInteraction& si, Sampler& sampler)
+    {
+        Sample s;
+        s.pdf = 0.;
+        s.emission = Spectrum(0.);
+
+        if (triangle_table.prob.empty())
+            return s;
+
+        int t = triangle_table.sample(sampler.next_float());
+        const glm::uvec3& idx = mesh->triangle_indices[t];
+        const vec3& v0 = mesh->vertex[idx.x];
+        const vec3& n = triangle_normal[t];
+
+        vec3 a, b, c;
+        Float solid_angle;
+        Float u1 = sampler.next_float();
+        Float u2 = sampler.next_float();
+
+        vec3 direction;
+        Float distance;
+        if (use_spherical_sampling(si.pos, t, a, b, c, solid_angle)) {
+            Float pdf;
+            direction = square_to_spherical_triangle(a, b, c, u1, u2, pdf);
+            Float cos_light = glm::dot(direction, n);
+            if (pdf <= 0. || cos_light == 0.)
+                return s;
+            distance = glm::dot(v0 - si.pos, n) / cos_light;
+            s.pdf = triangle_table.pmf[t] * pdf;
+        } else {
+            // Uniform point on the triangle
+            Float su = std::sqrt(u1);
+            vec3 point = v0 * (1.f - su) + mesh->vertex[idx.y] * (su * (1.f - u2)) + mesh->vertex[idx.z] * (su * u2);
+            direction = point - si.pos;
+            distance = glm::length(direction);
+            if (distance <= 0.)
+                return s;
+            direction /= distance;
+            Float cos_light = std::abs(glm::dot(direction, n));
+            if (cos_light == 0.)
+                return s;
+            s.pdf = distance * distance / (total_area * cos_light);
+        }
+
+        s.direction = -direction;
+        s.expected_distance_to_intersection = distance;
+        s.emission = mesh->brdf->emission();
+        return s;
+    }
+
+    Spectrum MeshLight::eval(const vec3& direction) { return mesh->brdf->emission(); }
+
+    Float MeshLight::triangle_pdf(const vec3& p, const int& t, const vec3& hit)
+    {
+        vec3 a, b, c;
+        Float solid_angle;
+        if (use_spherical_sampling(p, t, a, b, c, solid_angle))
+            return triangle_table.pmf[t] / solid_angle;
+
+        vec3 direction = hit - p;
+        Float dist_sqr = glm::dot(direction, direction);
+        Float cos_light = std::abs(glm::dot(direction, triangle_normal[t])) / std::sqrt(dist_sqr);
+        if (cos_light == 0.)
+            return 0.;
+        return dist_sqr / (total_area * cos_light);
+    }
+
+    Float MeshLight::pdf(const SurfaceInteraction& si, const SurfaceInteraction& si_light)
+    {
+        if (triangle_table.prob.empty() || si_light.prim_id >= triangle_area.size())
+            return 0.;
+        return triangle_pdf(si.pos, si_light.prim_id, si_light.pos);
+    }
+
+    Float MeshLight::pdf(const vec3& p, const vec3& ld)
+    {
+        if (triangle_table.prob.empty())
+            return 0.;
+
+        // Closest triangle along -ld (Moller-Trumbore)
+        vec3 d = -ld;
+        Float t_min = std::numeric_limits<Float>::infinity();
+        int hit_triangle = -1;
+        for (size_t t = 0; t < triangle_area.size(); t++) {
+            const glm::uvec3& idx = mesh->triangle_indices[t];
+            vec3 e1 = mesh->vertex[idx.y] - mesh->vertex[idx.x];
+            vec3 e2 = mesh->vertex[idx.z] - mesh->vertex[idx.x];
+            vec3 pv = glm::cross(d, e2);
+            Float det = glm::dot(e1, pv);
+            if (det == 0.)
+                continue;
+            vec3 tv = p - mesh->vertex[idx.x];
+            Float u = glm::dot(tv, pv) / det;
+            if (u < 0. || u > 1.)
+                continue;
+            vec3 qv = glm::cross(tv, e1);
+            Float v = glm::dot(d, qv) / det;
+            if (v < 0. || u + v > 1.)
+                continue;
+            Float dist = glm::dot(e2, qv) / det;
+            if (dist > 0. && dist < t_min) {
+                t_min = dist;
+                hit_triangle = t;
+            }
+        }
+
+        if (hit_triangle < 0)
+            return 0.;
+        return triangle_pdf(p, hit_triangle, p + d * t_min);
+    }
+
 } // namespace LT_NAMESPACE
\ No newline at end of file
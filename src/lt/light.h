@@ -41,16 +41,55 @@ namespace LT_NAMESPACE {
             */
         Light(const std::string& type)
             : Serializable(type)
-        {}
+            , group(0)
+        {
+            params.add("group", Params::Type::INT, &group);
+        }
 
         virtual Sample sample(const SurfaceInteraction& si, Sampler& sampler) = 0;
 
         virtual Spectrum eval(const vec3& direction) = 0;
         virtual Float pdf(const vec3& p, const vec3& ld) = 0;
 
+        /**
+         * @brief Sample the light knowing the BRDF of the shading point.
+         * Lights that do not use the BRDF fall back on \ref sample(si, sampler).
+         * @param si Shading point, with its BRDF.
+         * @param wi Incident direction in the local frame of si.
+         * @param sampler The sampler object used for sampling.
+         */
+        virtual Sample sample(const SurfaceInteraction& si, const vec3& wi, Sampler& sampler)
+        {
+            return sample(si, sampler);
+        }
+
+        /**
+         * @brief Density of \ref sample(si, wi, sampler), needed for MIS.
+         * @param si Shading point, with its BRDF.
+         * @param wi Incident direction in the local frame of si.
+         * @param ld Direction toward the scene.
+         */
+        virtual Float pdf(const SurfaceInteraction& si, const vec3& wi, const vec3& ld)
+        {
+            return pdf(si.pos, ld);
+        }
+
+        /**
+         * @brief Density of sampling si_light, the point of this light hit by a ray leaving si.
+         * Area lights whose density depends on the hit point (e.g. the triangle) override it.
+         * @param si Shading point.
+         * @param si_light Intersection with the geometry of the light.
+         */
+        virtual Float pdf(const SurfaceInteraction& si, const SurfaceInteraction& si_light)
+        {
+            return pdf(si.pos, glm::normalize(si.pos - si_light.pos));
+        }
+
         virtual int geometry_id() { return RTC_INVALID_GEOMETRY_ID; }
 
         Flags flags;
+        int group; /**< Light group, its contributions also go to the matching AOV of the integrator. */
+
         inline bool is_dirac() {
             return static_cast<uint16_t>(flags) & static_cast<uint16_t>(Light::Flags::dirac);
         }
@@ -127,6 +166,11 @@ namespace LT_NAMESPACE {
     public:
         EnvironmentLight()
             : Light("EnvironmentLight")
+            , octahedral(false)
+            , octahedral_resolution(0)
+            , product_sampling(false)
+            , product_resolution(8)
+            , product_defensive_weight(0.25)
         {
             flags = Flags::infinite;
             link_params();
@@ -137,13 +181,42 @@ namespace LT_NAMESPACE {
         Spectrum eval(const vec3& direction);
         Float pdf(const vec3& p, const vec3& ld);
 
+        /**
+         * @brief Product sampling of the envmap and the BRDF of si.
+         * A region of a coarse octahedral grid is selected according to its
+         * power times the BRDF toward it, then a texel according to radiance.
+         */
+        Sample sample(const SurfaceInteraction& si, const vec3& wi, Sampler& sampler);
+        Float pdf(const SurfaceInteraction& si, const vec3& wi, const vec3& ld);
+
         void compute_density();
+        void compute_octahedral_density();
+        void compute_cumulative_density();
+        void compute_product_regions();
 
         void init();
 
         Texture<Spectrum> envmap;
         Float intensity;
 
+        /**
+         * @brief If true, the lat-long envmap is resampled at init in an
+         * octahedral map so that eval, pdf and sample only use arithmetic.
+         */
+        bool octahedral;
+        int octahedral_resolution; /**< Side of the octahedral map, 0 means same texel count as envmap. */
+        Texture<Spectrum> octahedral_envmap;
+
+        bool product_sampling; /**< Use the BRDF of the shading point when sampling. */
+        int product_resolution; /**< Side of the octahedral grid of regions. */
+        Float product_defensive_weight; /**< Probability to sample only by radiance. */
+        std::vector<Float> region_power; /**< Sum of the density of the texels of each region. */
+        std::vector<vec3> region_direction; /**< Density weighted mean direction of each region. */
+        std::vector<int> region_texel_offset; /**< First texel of each region in region_texels. */
+        std::vector<int> region_texels; /**< Texel ids grouped by region. */
+        std::vector<Float> region_texel_cdf; /**< Cumulative density of the texels inside their region. */
+        std::vector<int> texel_region; /**< Region of each texel. */
+
         Texture<Float> density;
         Texture<Float> cumulative_density;
         Texture<int> inv_cumulative_density;
@@ -156,8 +229,19 @@ namespace LT_NAMESPACE {
         {
             params.add("texture", Params::Type::TEXTURE, &envmap);
             params.add("intensity", Params::Type::FLOAT, &intensity);
+            params.add("octahedral", Params::Type::BOOL, &octahedral);
+            params.add("octahedral_resolution", Params::Type::INT, &octahedral_resolution);
+            params.add("product_sampling", Params::Type::BOOL, &product_sampling);
+            params.add("product_resolution", Params::Type::INT, &product_resolution);
+            params.add("product_defensive_weight", Params::Type::FLOAT, &product_defensive_weight);
         }
 
+        Sample sample_texel(const int& id, Sampler& sampler);
+        vec3 texel_direction(const int& id);
+        int texel_index(const vec3& direction);
+        Float product_factor(const std::vector<Float>& cdf, const int& region);
+        const std::vector<Float>& product_cdf(const SurfaceInteraction& si, const vec3& wi);
+
     };
 
     class SphereLight : public Light {
@@ -186,4 +270,57 @@ namespace LT_NAMESPACE {
         void link_params() { }
     };
 
+    /**
+     * @brief Area light made of the triangles of an emissive Mesh.
+     * A triangle is picked proportionally to its area with an alias table, then
+     * a point is sampled uniformly in the solid angle it subtends. Triangles that
+     * are too small or too large seen from the shading point are sampled by area.
+     */
+    class MeshLight : public Light {
+    public:
+        MeshLight()
+            : Light("MeshLight")
+        {
+            flags = (Flags)0;
+            link_params();
+        }
+
+        void init();
+
+        Sample sample(const SurfaceInteraction& si, Sampler& sampler);
+
+        Spectrum eval(const vec3& direction);
+
+        /**
+         * @brief Density without the hit triangle, found by intersecting all the triangles.
+         * Linear in the number of triangles, prefer \ref pdf(si, si_light).
+         */
+        Float pdf(const vec3& p, const vec3& ld);
+        Float pdf(const SurfaceInteraction& si, const SurfaceInteraction& si_light);
+
+        int geometry_id() override { return mesh->rtc_id; }
+
+        std::shared_ptr<Mesh> mesh;
+
+        static constexpr Float min_spherical_sample_area = 3e-4; /**< Below, the triangle is sampled by area. */
+        static constexpr Float max_spherical_sample_area = 6.22; /**< Above, the triangle is sampled by area. */
+
+    protected:
+        /**
+         * @brief All param are from Mesh and Mesh::brdf.
+         */
+        void link_params() { }
+
+        /**
+         * @brief Density of sampling the point hit on triangle t from p, in solid angle.
+         */
+        Float triangle_pdf(const vec3& p, const int& t, const vec3& hit);
+        bool use_spherical_sampling(const vec3& p, const int& t, vec3& a, vec3& b, vec3& c, Float& solid_angle);
+
+        AliasTable triangle_table;
+        std::vector<Float> triangle_area;
+        std::vector<vec3> triangle_normal; /**< Geometric normal of each triangle. */
+        Float total_area;
+    };
+
 } // namespace LT_NAMESPACE
\ No newline at end of file
@@ -2,6 +2,10 @@
 
 #include <lt/brdf_common.h>
 #include <lt/camera.h>
+#include <lt/checkpoint.h>
+#include <lt/denoiser.h>
+#include <lt/distributed.h>
+#include <lt/filter.h>
 #include <lt/geometry.h>
 #include <lt/integrator.h>
 #include <lt/io.h>
@@ -11,6 +15,7 @@
 #include <lt/sampler.h>
 #include <lt/scene.h>
 #include <lt/sensor.h>
+#include <lt/stream.h>
 
 namespace LT_NAMESPACE {
 
@@ -13,6 +13,8 @@
 
 #define LT_NAMESPACE lt
 
+#include "fastmath.h"
+
 namespace LT_NAMESPACE {
 
 using vec3 = glm::vec3;
@@ -110,17 +112,27 @@ inline std::vector<T> linspace(T start, T end, size_t size, bool centered = true
     return arr;
 }
 
+/**
+ * @brief Integer powers by multiplication, std::pow with a floating exponent goes through exp and log.
+ */
+inline Float pow3(const Float& x) { return x * x * x; }
+inline Float pow4(const Float& x) { Float x2 = x * x; return x2 * x2; }
+
 inline vec3 polar_to_card(Float theta, Float phi)
 {
-    return vec3(sin(theta) * cos(phi), sin(theta) * sin(phi), cos(theta));
+    Float sin_theta, cos_theta, sin_phi, cos_phi;
+    math::sincos(theta, sin_theta, cos_theta);
+    math::sincos(phi, sin_phi, cos_phi);
+    return vec3(sin_theta * cos_phi, sin_theta * sin_phi, cos_theta);
 }
 
 inline vec3 square_to_uniform_sphere(Float u1, Float u2)
 {
     Float z = 1. - 2. * u1;
     Float r = std::sqrt(std::max(0., 1. - z * z));
-    Float ph = 2. * pi * u2;
-    return vec3(r * cos(ph), r * sin(ph), z);
+    Float sin_ph, cos_ph;
+    math::sincos(2. * pi * u2, sin_ph, cos_ph);
+    return vec3(r * cos_ph, r * sin_ph, z);
 }
 
 inline Float square_to_uniform_sphere_pdf() { return 1. / (4. * pi); }
@@ -129,8 +141,9 @@ inline vec3 square_to_uniform_hemisphere(Float u1, Float u2)
 {
     Float z = u1;
     Float r = std::sqrt(std::max(0., 1. - z * z));
-    Float ph = 2. * pi * u2;
-    return vec3(r * cos(ph), r * sin(ph), z);
+    Float sin_ph, cos_ph;
+    math::sincos(2. * pi * u2, sin_ph, cos_ph);
+    return vec3(r * cos_ph, r * sin_ph, z);
 }
 
 inline Float square_to_uniform_hemisphere_pdf() { return 1. / (2. * pi); }
@@ -147,9 +160,10 @@ inline vec3 square_to_cosine_hemisphere(Float u1, Float u2)
 #endif
 #if 1
     Float r = std::sqrt(u1);
-    Float theta = 2. * pi * u2;
-    Float dx = r * std::cos(theta);
-    Float dy = r * std::sin(theta);
+    Float sin_theta, cos_theta;
+    math::sincos(2. * pi * u2, sin_theta, cos_theta);
+    Float dx = r * cos_theta;
+    Float dy = r * sin_theta;
     Float z = std::sqrt(glm::clamp(1.f - dx * dx - dy * dy,0.00001f,1.f));
     if (z != z)
         Log(logError) << "square_to_cosine_hemisphere : invalid sample generated";
@@ -162,6 +176,121 @@ inline Float square_to_cosine_hemisphere_pdf(const vec3& w)
     return glm::clamp(w.z,0.f,1.f) / pi;
 }
 
+/**
+ * @brief Octahedral map from the unit square to the unit sphere.
+ * Only arithmetic operations, no trigonometric call.
+ */
+inline vec3 square_to_octahedral(Float u1, Float u2)
+{
+    Float x = 2.f * u1 - 1.f;
+    Float y = 2.f * u2 - 1.f;
+    Float z = 1.f - std::abs(x) - std::abs(y);
+    if (z < 0.f) {
+        Float x_ = (1.f - std::abs(y)) * (x < 0.f ? -1.f : 1.f);
+        y = (1.f - std::abs(x)) * (y < 0.f ? -1.f : 1.f);
+        x = x_;
+    }
+    return glm::normalize(vec3(x, y, z));
+}
+
+/**
+ * @brief Inverse of \ref square_to_octahedral.
+ */
+inline vec2 octahedral_to_square(const vec3& w)
+{
+    Float l1 = std::abs(w.x) + std::abs(w.y) + std::abs(w.z);
+    Float x = w.x / l1;
+    Float y = w.y / l1;
+    if (w.z < 0.f) {
+        Float x_ = (1.f - std::abs(y)) * (x < 0.f ? -1.f : 1.f);
+        y = (1.f - std::abs(x)) * (y < 0.f ? -1.f : 1.f);
+        x = x_;
+    }
+    return vec2(0.5f * x + 0.5f, 0.5f * y + 0.5f);
+}
+
+/**
+ * @brief Solid angle density of a direction uniformly sampled in the square
+ * and mapped with \ref square_to_octahedral. (dA / dw = 1 / (4 |w|_1^3))
+ */
+inline Float square_to_octahedral_pdf(const vec3& w)
+{
+    Float l1 = std::abs(w.x) + std::abs(w.y) + std::abs(w.z);
+    return 0.25f / (l1 * l1 * l1);
+}
+
+/**
+ * @brief Solid angle of the spherical triangle (a, b, c), given as unit vectors.
+ * (Van Oosterom and Strackee formula)
+ */
+inline Float spherical_triangle_area(const vec3& a, const vec3& b, const vec3& c)
+{
+    return 2.f * std::atan2(std::abs(glm::dot(a, glm::cross(b, c))),
+        1.f + glm::dot(a, b) + glm::dot(a, c) + glm::dot(b, c));
+}
+
+/**
+ * @brief Angle between two unit vectors, accurate for small and large angles.
+ */
+inline Float angle_between(const vec3& v1, const vec3& v2)
+{
+    if (glm::dot(v1, v2) < 0.f)
+        return pi - 2.f * std::asin(glm::clamp(glm::length(v1 + v2) * 0.5f, -1.f, 1.f));
+    return 2.f * std::asin(glm::clamp(glm::length(v2 - v1) * 0.5f, -1.f, 1.f));
+}
+
+/**
+ * @brief Uniform sampling of the spherical triangle (a, b, c) given as unit vectors.
+ * (Arvo, "Stratified sampling of spherical triangles", 1995)
+ * @param pdf Set to one over the solid angle, 0 if the triangle is degenerate.
+ */
+inline vec3 square_to_spherical_triangle(const vec3& a, const vec3& b, const vec3& c, Float u1, Float u2, Float& pdf)
+{
+    pdf = 0.f;
+    vec3 n_ab = glm::cross(a, b);
+    vec3 n_bc = glm::cross(b, c);
+    vec3 n_ca = glm::cross(c, a);
+    if (glm::dot(n_ab, n_ab) == 0.f || glm::dot(n_bc, n_bc) == 0.f || glm::dot(n_ca, n_ca) == 0.f)
+        return vec3(0.);
+    n_ab = glm::normalize(n_ab);
+    n_bc = glm::normalize(n_bc);
+    n_ca = glm::normalize(n_ca);
+
+    Float alpha = angle_between(n_ab, -n_ca);
+    Float beta = angle_between(n_bc, -n_ab);
+    Float gamma = angle_between(n_ca, -n_bc);
+
+    // Pick the sub-triangle area, then the edge point c_ on (a, c)
+    Float area_pi = alpha + beta + gamma;
+    Float area = area_pi - pi;
+    if (area <= 0.f)
+        return vec3(0.);
+    pdf = 1.f / area;
+
+    Float sub_area_pi = pi + u1 * (area_pi - pi);
+    Float cos_alpha = std::cos(alpha);
+    Float sin_alpha = std::sin(alpha);
+    Float sin_phi = std::sin(sub_area_pi) * cos_alpha - std::cos(sub_area_pi) * sin_alpha;
+    Float cos_phi = std::cos(sub_area_pi) * cos_alpha + std::sin(sub_area_pi) * sin_alpha;
+
+    Float k1 = cos_phi + cos_alpha;
+    Float k2 = sin_phi - sin_alpha * glm::dot(a, b);
+    Float cos_b = (k2 + (k2 * cos_phi - k1 * sin_phi) * cos_alpha) / ((k2 * sin_phi + k1 * cos_phi) * sin_alpha);
+    cos_b = glm::clamp(cos_b, -1.f, 1.f);
+    Float sin_b = std::sqrt(std::max(0.f, 1.f - cos_b * cos_b));
+
+    vec3 c_perp = c - glm::dot(c, a) * a;
+    vec3 c_ = cos_b * a + sin_b * glm::normalize(c_perp);
+
+    // Sample along the arc (b, c_)
+    Float cos_theta = 1.f - u2 * (1.f - glm::dot(c_, b));
+    Float sin_theta = std::sqrt(std::max(0.f, 1.f - cos_theta * cos_theta));
+    vec3 c_perp_b = c_ - glm::dot(c_, b) * b;
+    if (glm::dot(c_perp_b, c_perp_b) == 0.f)
+        return b;
+    return glm::normalize(cos_theta * b + sin_theta * glm::normalize(c_perp_b));
+}
+
 inline void orthonormal_basis(const vec3& n, vec3& t, vec3& b)
 {
     if (n.z < -0.999999) {
@@ -204,14 +333,35 @@ inline Spectrum fresnelConductor(const Float& cosThetaI, const Spectrum& eta, co
     Spectrum term1 = a2pb2 + cosThetaI2;
     Spectrum term2 = 2.f * a * cosThetaI;
 
-    Spectrum Rs2 = (term1 - term2) / (term1 + term2);
-
     Spectrum term3 = a2pb2 * cosThetaI2 + sinThetaI4;
     Spectrum term4 = term2 * sinThetaI2;
 
-    Spectrum Rp2 = Rs2 * (term3 - term4) / (term3 + term4);
+    // 0.5 (Rs2 + Rp2) with Rs2 = (term1 - term2) / (term1 + term2) and Rp2 = Rs2 (term3 - term4) / (term3 + term4),
+    // reduced to a single division
+    return (term1 - term2) * term3 / ((term1 + term2) * (term3 + term4));
+}
 
-    return 0.5f * (Rp2 + Rs2);
+/**
+ * @brief Single channel of \ref fresnelConductor, for the batched kernels.
+ */
+inline Float fresnelConductor(const Float& cosThetaI, const Float& eta, const Float& k) {
+    Float cosThetaI2 = cosThetaI * cosThetaI,
+        sinThetaI2 = 1 - cosThetaI2,
+        sinThetaI4 = sinThetaI2 * sinThetaI2;
+
+    Float temp1 = eta * eta - k * k - sinThetaI2;
+    Float a2pb2 = std::sqrt(std::max(temp1 * temp1 + 4.f * k * k * eta * eta, 0.00001f));
+    Float a = std::sqrt(std::max(0.5f * (a2pb2 + temp1), 0.00001f));
+
+    Float term1 = a2pb2 + cosThetaI2;
+    Float term2 = 2.f * a * cosThetaI;
+
+    Float term3 = a2pb2 * cosThetaI2 + sinThetaI4;
+    Float term4 = term2 * sinThetaI2;
+
+    // 0.5 (Rs2 + Rp2) with Rs2 = (term1 - term2) / (term1 + term2) and Rp2 = Rs2 (term3 - term4) / (term3 + term4),
+    // reduced to a single division
+    return (term1 - term2) * term3 / ((term1 + term2) * (term3 + term4));
 }
 
 //template <class T>
@@ -267,31 +417,117 @@ int binary_search(const std::vector<T>& arr, const T& val) {
 
 
 
-inline double igf(double S, double Z)
-{
-    if (Z < 0.0)
+/**
+ * @brief Alias table for constant time sampling of a discrete distribution.
+ * (Vose, "A linear algorithm for generating random numbers with a given distribution", 1991)
+ */
+struct AliasTable {
+    std::vector<Float> prob; /**< Probability to keep the bin instead of its alias. */
+    std::vector<int> alias; /**< Alias of each bin. */
+    std::vector<Float> pmf; /**< Normalized weight of each bin. */
+
+    /**
+     * @brief Build the table from non negative weights.
+     * @return False if the weights sum to zero.
+     */
+    bool build(const std::vector<Float>& weights)
     {
-        return 0.0;
-    }
-    double Sc = (1.0 / S);
-    Sc *= pow(Z, S);
-    Sc *= exp(-Z);
+        size_t n = weights.size();
+        prob.assign(n, 0.);
+        alias.assign(n, 0);
+        pmf.assign(n, 0.);
+
+        double total = 0.;
+        for (const Float& w : weights)
+            total += w;
+        if (total <= 0.)
+            return false;
+
+        std::vector<double> scaled(n);
+        std::vector<int> small, large;
+        for (size_t i = 0; i < n; i++) {
+            pmf[i] = weights[i] / total;
+            scaled[i] = weights[i] / total * n;
+            if (scaled[i] < 1.)
+                small.push_back(i);
+            else
+                large.push_back(i);
+        }
 
-    double Sum = 1.0;
-    double Nom = 1.0;
-    double Denom = 1.0;
+        while (!small.empty() && !large.empty()) {
+            int s = small.back();
+            small.pop_back();
+            int l = large.back();
+            prob[s] = scaled[s];
+            alias[s] = l;
+            scaled[l] = (scaled[l] + scaled[s]) - 1.;
+            if (scaled[l] < 1.) {
+                large.pop_back();
+                small.push_back(l);
+            }
+        }
+        // Remaining bins are full up to rounding errors
+        for (int l : large) { prob[l] = 1.; alias[l] = l; }
+        for (int s : small) { prob[s] = 1.; alias[s] = s; }
+        return true;
+    }
 
-    for (int I = 0; I < 200; I++)
+    /**
+     * @brief Sample a bin with a single uniform number.
+     */
+    int sample(Float u) const
     {
-        Nom *= Z;
-        S++;
-        Denom *= S;
-        Sum += (Nom / Denom);
+        Float x = u * prob.size();
+        int i = std::min((int)x, (int)prob.size() - 1);
+        return (x - i) < prob[i] ? i : alias[i];
     }
+};
 
-    return Sum * Sc;
-}
+/**
+ * @brief Regularized upper incomplete gamma function Q(a, x), evaluated in log space
+ * with the series (x < a + 1) or the continued fraction (x >= a + 1) so it stays
+ * finite for the large degrees of freedom of histogram tests.
+ */
+inline double gamma_q(double a, double x)
+{
+    if (x <= 0.0)
+        return 1.0;
+
+    const double log_prefix = a * std::log(x) - x - std::lgamma(a);
+
+    if (x < a + 1.0) {
+        double term = 1.0 / a;
+        double sum = term;
+        for (int n = 1; n < 1000; n++) {
+            term *= x / (a + n);
+            sum += term;
+            if (std::abs(term) < std::abs(sum) * 1e-15)
+                break;
+        }
+        return std::max(0.0, 1.0 - sum * std::exp(log_prefix));
+    }
 
+    // Modified Lentz
+    const double tiny = 1e-300;
+    double b = x + 1.0 - a;
+    double c = 1.0 / tiny;
+    double d = 1.0 / b;
+    double h = d;
+    for (int n = 1; n < 1000; n++) {
+        double an = -n * (n - a);
+        b += 2.0;
+        d = an * d + b;
+        d = std::abs(d) < tiny ? tiny : d;
+        c = b + an / c;
+        c = std::abs(c) < tiny ? tiny : c;
+        d = 1.0 / d;
+        double delta = d * c;
+        h *= delta;
+        if (std::abs(delta - 1.0) < 1e-15)
+            break;
+    }
+    return std::exp(log_prefix) * h;
+}
 
 inline double approx_gamma(double Z)
 {
@@ -308,28 +544,16 @@ inline double approx_gamma(double Z)
 }
 
 
+/**
+ * @brief Probability that a chi-square variable with Dof degrees of freedom exceeds Cv.
+ */
 inline double chisqr(int Dof, double Cv)
 {
     if (Cv < 0 || Dof < 1)
     {
         return 0.0;
     }
-    double K = ((double)Dof) * 0.5;
-    double X = Cv * 0.5;
-    if (Dof == 2)
-    {
-        return exp(-1.0 * X);
-    }
-
-    double PValue = igf(K, X);
-    if (isnan(PValue) || isinf(PValue) || PValue <= 1e-8)
-    {
-        return 1e-14;
-    }
-
-    PValue /= tgamma(K); 
-
-    return (1.0 - PValue);
+    return gamma_q(0.5 * Dof, 0.5 * Cv);
 }
 
 } // namespace LT_NAMESPACE
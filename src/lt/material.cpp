@@ -0,0 +1,163 @@
+#include <lt/material.h>
+
+#include <algorithm>
+#include <typeinfo>
+
+namespace LT_NAMESPACE {
+
+void MaterialTable::update(const std::vector<std::shared_ptr<Geometry>>& geometries)
+{
+    bool changed = geometries.size() != geometry_brdf.size();
+    for (size_t i = 0; !changed && i < geometries.size(); i++)
+        changed = geometries[i]->brdf.get() != geometry_brdf[i];
+    // A replaced lobe or base leaves the pointer of its BRDF unchanged, the table would keep the old one
+    for (size_t id = 0; !changed && id < materials.size(); id++)
+        changed = !nested_unchanged(id);
+
+    if (!changed)
+        return;
+
+    materials.clear();
+    material_brdf.clear();
+    index.clear();
+    geometry_brdf.resize(geometries.size());
+    geometry_material.resize(geometries.size());
+
+    for (size_t i = 0; i < geometries.size(); i++) {
+        geometry_brdf[i] = geometries[i]->brdf.get();
+        geometry_material[i] = add(geometry_brdf[i]);
+    }
+}
+
+int MaterialTable::add(Brdf* brdf)
+{
+    if (!brdf)
+        return -1;
+
+    auto it = index.find(brdf);
+    if (it != index.end())
+        return it->second;
+
+    // Reserve the slot before the nested BRDFs
+    int id = materials.size();
+    materials.push_back(brdf);
+    material_brdf.push_back(brdf);
+    index[brdf] = id;
+
+    const std::type_info& type = typeid(*brdf);
+    if (type == typeid(Diffuse)) {
+        materials[id] = static_cast<Diffuse*>(brdf);
+    } else if (type == typeid(RoughGGX)) {
+        materials[id] = static_cast<RoughGGX*>(brdf);
+    } else if (type == typeid(DiffuseGGX)) {
+        materials[id] = static_cast<DiffuseGGX*>(brdf);
+    } else if (type == typeid(RoughBeckmann)) {
+        materials[id] = static_cast<RoughBeckmann*>(brdf);
+    } else if (type == typeid(Emissive)) {
+        materials[id] = static_cast<Emissive*>(brdf);
+    } else if (type == typeid(TabulatedBrdf)) {
+        materials[id] = static_cast<TabulatedBrdf*>(brdf);
+    } else if (type == typeid(Mix)) {
+        Mix* mix = static_cast<Mix*>(brdf);
+        MixNode node { mix, {} };
+        for (int k = 0; k < mix->lobe_count(); k++)
+            node.lobes.push_back(add(mix->lobe(k)));
+        if (std::find(node.lobes.begin(), node.lobes.end(), -1) == node.lobes.end())
+            materials[id] = node;
+    } else if (type == typeid(RoughMicrograin)) {
+        RoughMicrograin* micrograin = static_cast<RoughMicrograin*>(brdf);
+        int base = add(micrograin->base.get());
+        if (base >= 0)
+            materials[id] = MicrograinNode<RoughMicrograin> { micrograin, base };
+    } else if (type == typeid(DiffuseMicrograin)) {
+        DiffuseMicrograin* micrograin = static_cast<DiffuseMicrograin*>(brdf);
+        int base = add(micrograin->base.get());
+        if (base >= 0)
+            materials[id] = MicrograinNode<DiffuseMicrograin> { micrograin, base };
+    }
+
+    return id;
+}
+
+bool MaterialTable::nested_unchanged(const int& id) const
+{
+    return std::visit([&](auto&& m) -> bool {
+        using T = std::decay_t<decltype(m)>;
+        if constexpr (std::is_same_v<T, MixNode>) {
+            if (m.brdf->lobe_count() != int(m.lobes.size()))
+                return false;
+            for (int k = 0; k < int(m.lobes.size()); k++)
+                if (m.brdf->lobe(k) != material_brdf[m.lobes[k]])
+                    return false;
+            return true;
+        } else if constexpr (std::is_same_v<T, MicrograinNode<RoughMicrograin>>
+            || std::is_same_v<T, MicrograinNode<DiffuseMicrograin>>) {
+            return m.brdf->base.get() == material_brdf[m.base];
+        } else {
+            // Other BRDFs are leaves, or reach their nested BRDFs through virtual calls
+            return true;
+        }
+    }, materials[id]);
+}
+
+Brdf::Eval MaterialTable::evaluate(const int& id, const vec3& wi, const vec3& wo, Sampler& sampler)
+{
+    return std::visit([&](auto&& m) -> Brdf::Eval {
+        using T = std::decay_t<decltype(m)>;
+        if constexpr (std::is_same_v<T, MixNode>) {
+            return m.brdf->evaluate_lobes(wi, [&](const int& k) { return evaluate(m.lobes[k], wi, wo, sampler); });
+        } else if constexpr (std::is_same_v<T, MicrograinNode<RoughMicrograin>>) {
+            return m.brdf->evaluate(wi, wo, evaluate(m.base, wi, wo, sampler));
+        } else if constexpr (std::is_same_v<T, MicrograinNode<DiffuseMicrograin>>) {
+            return m.brdf->evaluate(wi, wo, sampler, evaluate(m.base, wi, wo, sampler));
+        } else if constexpr (std::is_same_v<T, Brdf*>) {
+            return m->evaluate(wi, wo, sampler);
+        } else {
+            // Qualified call, no virtual dispatch
+            using B = std::remove_pointer_t<T>;
+            return m->B::evaluate(wi, wo, sampler);
+        }
+    }, materials[id]);
+}
+
+Brdf::Sample MaterialTable::sample(const int& id, const vec3& wi, Sampler& sampler)
+{
+    return std::visit([&](auto&& m) -> Brdf::Sample {
+        using T = std::decay_t<decltype(m)>;
+        if constexpr (std::is_same_v<T, MixNode>) {
+            return m.brdf->sample_lobes(wi, sampler,
+                [&](const int& k) { return sample(m.lobes[k], wi, sampler); },
+                [&](const vec3& wo) { return evaluate(id, wi, wo, sampler); });
+        } else if constexpr (std::is_same_v<T, MicrograinNode<RoughMicrograin>>
+            || std::is_same_v<T, MicrograinNode<DiffuseMicrograin>>) {
+            return m.brdf->sample(wi, sampler,
+                [&] { return sample(m.base, wi, sampler); },
+                [&](const vec3& wo) { return evaluate(id, wi, wo, sampler); });
+        } else if constexpr (std::is_same_v<T, Brdf*>) {
+            return m->sample(wi, sampler);
+        } else {
+            using B = std::remove_pointer_t<T>;
+            return m->B::sample(wi, sampler);
+        }
+    }, materials[id]);
+}
+
+Float MaterialTable::pdf(const int& id, const vec3& wi, const vec3& wo)
+{
+    return std::visit([&](auto&& m) -> Float {
+        using T = std::decay_t<decltype(m)>;
+        if constexpr (std::is_same_v<T, MixNode>) {
+            return m.brdf->pdf_lobes(wi, [&](const int& k) { return pdf(m.lobes[k], wi, wo); });
+        } else if constexpr (std::is_same_v<T, MicrograinNode<RoughMicrograin>>
+            || std::is_same_v<T, MicrograinNode<DiffuseMicrograin>>) {
+            return m.brdf->pdf(wi, wo, pdf(m.base, wi, wo));
+        } else if constexpr (std::is_same_v<T, Brdf*>) {
+            return m->pdf(wi, wo);
+        } else {
+            using B = std::remove_pointer_t<T>;
+            return m->B::pdf(wi, wo);
+        }
+    }, materials[id]);
+}
+
+} // namespace LT_NAMESPACE
@@ -0,0 +1,85 @@
+/**
+ * @file
+ * @brief Definition of the MaterialTable class.
+ */
+
+#pragma once
+
+#include <lt/brdf_common.h>
+#include <lt/geometry.h>
+#include <lt/lt_common.h>
+
+#include <map>
+#include <variant>
+
+namespace LT_NAMESPACE {
+
+/**
+ * @brief Flattened view of the BRDFs of a scene, dispatched without virtual calls.
+ * The Brdf classes stay the authoring API: the table only stores pointers to
+ * them, so parameters edited after the build are seen by the renderer.
+ * Nested BRDFs (Mix, micrograin base) are resolved to indices in the table.
+ * Unknown Brdf types fall back on the virtual interface.
+ */
+class MaterialTable {
+public:
+    /**
+     * @brief Mix whose lobes are materials of the table.
+     */
+    struct MixNode {
+        Mix* brdf;
+        std::vector<int> lobes; /**< Material of each lobe, in the order of Mix::lobe. */
+    };
+
+    /**
+     * @brief Micrograin whose base BRDF is a material of the table.
+     */
+    template <class MICROGRAIN>
+    struct MicrograinNode {
+        MICROGRAIN* brdf;
+        int base;
+    };
+
+    using Material = std::variant<
+        Diffuse*,
+        RoughGGX*,
+        DiffuseGGX*,
+        RoughBeckmann*,
+        Emissive*,
+        TabulatedBrdf*,
+        MixNode,
+        MicrograinNode<RoughMicrograin>,
+        MicrograinNode<DiffuseMicrograin>,
+        Brdf*>;
+
+    /**
+     * @brief Rebuild the table if the BRDF of a geometry, or a lobe or base nested in it, changed since the last build.
+     * @param geometries Geometries of the scene, their index is the embree geometry id.
+     */
+    void update(const std::vector<std::shared_ptr<Geometry>>& geometries);
+
+    /**
+     * @brief Add a BRDF and its nested BRDFs to the table.
+     * @return Index of the material, -1 for a null BRDF.
+     */
+    int add(Brdf* brdf);
+
+    Brdf::Eval evaluate(const int& id, const vec3& wi, const vec3& wo, Sampler& sampler);
+    Brdf::Sample sample(const int& id, const vec3& wi, Sampler& sampler);
+    Float pdf(const int& id, const vec3& wi, const vec3& wo);
+
+    std::vector<Material> materials;
+    std::vector<int> geometry_material; /**< Material of each geometry. */
+
+private:
+    /**
+     * @brief The nested BRDFs of a material are still the ones of its indices.
+     */
+    bool nested_unchanged(const int& id) const;
+
+    std::vector<Brdf*> geometry_brdf; /**< BRDF of each geometry at the last build. */
+    std::vector<Brdf*> material_brdf; /**< BRDF of each material. */
+    std::map<Brdf*, int> index; /**< Material of each BRDF already added. */
+};
+
+} // namespace LT_NAMESPACE
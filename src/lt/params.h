@@ -18,6 +18,7 @@ struct Params {
     enum class Type {
         BOOL, /**< BOOL type parameter. */
         FLOAT, /**< Float type parameter. */
+        FLOATS, /**< List of float type parameter. */
         INT, /**< Int type parameter. */
         VEC3, /**< Vector3 type parameter. */
         MAT4, /**< Matrix 4x4 type parameter . */
@@ -25,6 +26,7 @@ struct Params {
         SH, /**< Spherical Harmonics type parameter. */
         PATH, /**< Path type parameter. */
         BRDF, /**< BRDF type parameter. */
+        BRDFS, /**< List of BRDF type parameter. */
         TEXTURE /**< Texture type parameter. */
     };
 
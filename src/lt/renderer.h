@@ -5,6 +5,7 @@
 
 #pragma once
 #include <lt/camera.h>
+#include <lt/denoiser.h>
 #include <lt/integrator.h>
 #include <lt/lt_common.h>
 #include <lt/sampler.h>
@@ -25,9 +26,13 @@ public:
     std::shared_ptr<Sensor> sensor; /**< Pointer to the sensor. */
     std::shared_ptr<Camera> camera; /**< Pointer to the camera. */
     std::shared_ptr<Integrator> integrator; /**< Pointer to the integrator. */
+    std::shared_ptr<AtrousDenoiser> denoiser; /**< Denoiser applied after the last pass, optional. */
     int max_sample;
+    int output_interval; /**< Passes between two progressive outputs, 0 to only write the final image. */
+    int checkpoint_interval; /**< Passes between two checkpoints, 0 to disable them, see \ref save_checkpoint. */
+    int stream_tile_size; /**< Size of the tiles of a streamed render, 0 to hold the whole sensor, see \ref render_streamed. */
 
-    Renderer() : max_sample(1) {}
+    Renderer() : max_sample(1), output_interval(0), checkpoint_interval(0), stream_tile_size(0) {}
 
     float render(Scene& scene)
     {
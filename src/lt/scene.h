@@ -8,6 +8,7 @@
 #include <lt/brdf_common.h>
 #include <lt/geometry.h>
 #include <lt/light.h>
+#include <lt/material.h>
 #include <lt/lt_common.h>
 #include <lt/surface_interaction.h>
 
@@ -46,9 +47,11 @@ public:
 
             si.t = rayhit.ray.tfar;
             si.brdf = geom->brdf;
+            si.material = materials.geometry_material[geom_id];
             si.pos = r.o + r.d * si.t;
             si.nor = geom->get_normal(rayhit, si.pos);
             si.geom_id = geom_id;
+            si.prim_id = rayhit.hit.primID;
             // si.nor = vec3(rayhit.hit.Ng_x, rayhit.hit.Ng_y, rayhit.hit.Ng_z);
 
             si.finalize();
@@ -165,6 +168,8 @@ public:
         rtcCommitScene(scene);
 
         rtcInitIntersectContext(&context);
+
+        materials.update(geometries);
     }
 
     RTCDevice device; /**< Embree RTC device. */
@@ -176,6 +181,7 @@ public:
     std::vector<std::shared_ptr<Light>>
         lights; /**< Vector of light in the scene. */
     std::vector<std::shared_ptr<Brdf>> brdfs; /**< Vector of BRDF in the scene. */
+    MaterialTable materials; /**< BRDFs of the geometries, for static dispatch. */
     std::vector<std::shared_ptr<Light>> infinite_lights;
 };
 
@@ -18,26 +18,57 @@ Factory<Sensor>::CreatorRegistry& Factory<Sensor>::registry()
 }
 
 void Sensor::init() {
-    value.resize(w * h);
-    acculumator.resize(w * h);
-    count.resize(w * h);
-    u = linspace<Float>(-1, 1, w);
-    v = linspace<Float>(1, -1, h);
+    w = crop_w > 0 ? crop_w : full_w;
+    h = crop_h > 0 ? crop_h : full_h;
+    value.clear();
+    pixels.assign(w * h, { Spectrum(0.), 0 });
+    aov_sums.assign(size_t(w) * h * aovs.size(), Spectrum(0.));
+    filter->init();
+    weights.assign(filter->importance_sampling ? 0 : w * h, 0.);
+    if (!filter->importance_sampling && filter->radius - 0.5f > max_halo)
+        Log(logWarning) << "Splatting radius " << filter->radius << " clipped to the tile halo of " << max_halo << " pixels";
+
+    // Coordinates of the pixels of the crop window in the image
+    std::vector<Float> full_u = linspace<Float>(-1, 1, full_w);
+    std::vector<Float> full_v = linspace<Float>(1, -1, full_h);
+    u.assign(full_u.begin() + crop_x, full_u.begin() + crop_x + w);
+    v.assign(full_v.begin() + crop_y, full_v.begin() + crop_y + h);
     sum_counts = 0;
+    resolved = true;
+}
+
+void Sensor::set_crop(const int& x0, const int& y0, const int& x1, const int& y1)
+{
+    int cx0 = glm::clamp(x0, 0, int(full_w));
+    int cy0 = glm::clamp(y0, 0, int(full_h));
+    int cx1 = glm::clamp(x1, cx0, int(full_w));
+    int cy1 = glm::clamp(y1, cy0, int(full_h));
+    if (cx1 == cx0 || cy1 == cy0) {
+        Log(logWarning) << "Empty crop window, the whole image is rendered";
+        cx0 = cy0 = 0;
+        cx1 = cy1 = 0;
+    }
+
+    crop_x = cx0;
+    crop_y = cy0;
+    crop_w = cx1 - cx0;
+    crop_h = cy1 - cy0;
 }
 
 /**
     * @brief Resets the sensor data.
     *
-    * This function resets the accumulator, value, and count arrays of the
+    * This function resets the accumulated pixels and the value array of the
     * sensor.
     */
 void Sensor::reset()
 {
-    memset(acculumator.data(), 0, sizeof(Spectrum) * acculumator.size());
-    memset(value.data(), 0, sizeof(Spectrum) * value.size());
-    memset(count.data(), 0, sizeof(uint16_t) * count.size());
+    std::fill(pixels.begin(), pixels.end(), SensorPixel { Spectrum(0.), 0 });
+    std::fill(value.begin(), value.end(), Spectrum(0.));
+    std::fill(weights.begin(), weights.end(), 0.);
+    std::fill(aov_sums.begin(), aov_sums.end(), Spectrum(0.));
     sum_counts = 0;
+    resolved = true;
 }
 
 /**
@@ -50,10 +81,12 @@ void Sensor::reset()
 void Sensor::add(const uint32_t& x, const uint32_t& y, Spectrum s)
 {
     uint32_t idx = y * w + x;
-    acculumator[idx] += s;
-    count[idx]++;
+    pixels[idx].sum += s;
+    pixels[idx].count++;
+    if (!weights.empty())
+        weights[idx] += 1.;
     sum_counts++;
-    set_value(idx,y);
+    resolved = false;
 }
 
 /**
@@ -65,14 +98,129 @@ void Sensor::add(const uint32_t& x, const uint32_t& y, Spectrum s)
     */
 void Sensor::set(const uint32_t& x, const uint32_t& y, Spectrum s)
 {
-    uint32_t idx = y * w + x;
-    acculumator[idx] = s;
-    count[idx] = 1;
-    set_value(idx,y);
+    pixels[y * w + x] = { s, 1 };
+    if (!weights.empty())
+        weights[y * w + x] = 1.;
+    resolved = false;
 }
 
 Spectrum Sensor::get(const uint32_t& x, const uint32_t& y) {
-    return value[y * w + x];
+    allocate_value();
+    uint32_t idx = y * w + x;
+    if (!resolved)
+        set_value(idx, y);
+    return value[idx];
+}
+
+void Sensor::init_tile(SensorTile& tile, const uint32_t& x0, const uint32_t& y0, const uint32_t& w, const uint32_t& h)
+{
+    tile.x0 = x0;
+    tile.y0 = y0;
+    tile.w = w;
+    tile.h = h;
+    tile.halo = halo();
+    tile.stride = w + 2 * tile.halo;
+
+    uint32_t size = tile.stride * (h + 2 * tile.halo);
+    tile.pixels.assign(size, { Spectrum(0.), 0 });
+    tile.accumulator_sqr.clear();
+    tile.weights.assign(weights.empty() ? 0 : size, 0.);
+    tile.n_aov = aovs.size();
+    tile.aovs.assign(size * tile.n_aov, Spectrum(0.));
+    tile.aov_averaged.resize(tile.n_aov);
+    for (uint32_t a = 0; a < tile.n_aov; a++)
+        tile.aov_averaged[a] = aovs[a].averaged;
+    tile.sum_counts = 0;
+}
+
+void Sensor::merge(const SensorTile& tile)
+{
+    for_each_tile_pixel(tile, [&](const uint32_t& t, const uint32_t& i) {
+        pixels[i].sum += tile.pixels[t].sum;
+        pixels[i].count += tile.pixels[t].count;
+    });
+    if (!tile.weights.empty())
+        for_each_tile_pixel(tile, [&](const uint32_t& t, const uint32_t& i) { weights[i] += tile.weights[t]; });
+    if (tile.n_aov > 0)
+        for_each_tile_pixel(tile, [&](const uint32_t& t, const uint32_t& i) {
+            for (uint32_t a = 0; a < tile.n_aov; a++) {
+                if (aovs[a].averaged)
+                    aov_sums[i * tile.n_aov + a] += tile.aovs[t * tile.n_aov + a];
+                else if (tile.pixels[t].count > 0)
+                    aov_sums[i * tile.n_aov + a] = tile.aovs[t * tile.n_aov + a];
+            }
+        });
+    resolved = false;
+}
+
+uint32_t Sensor::add_aov(const std::string& name, const std::vector<std::string>& channels, const bool& averaged)
+{
+    for (uint32_t a = 0; a < aovs.size(); a++)
+        if (aovs[a].name == name)
+            return a;
+
+    // Interleave the new AOV after the others of each pixel
+    uint32_t n = aovs.size();
+    std::vector<Spectrum> sums(size_t(w) * h * (n + 1), Spectrum(0.));
+    for (size_t i = 0; i < size_t(w) * h && n > 0; i++)
+        std::copy_n(&aov_sums[i * n], n, &sums[i * (n + 1)]);
+    aov_sums = std::move(sums);
+
+    aovs.push_back({ name, channels, averaged });
+    return n;
+}
+
+std::vector<Spectrum> Sensor::resolve_aov(const uint32_t& aov) const
+{
+    std::vector<Spectrum> res(size_t(w) * h, Spectrum(0.));
+    for (size_t i = 0; i < res.size(); i++)
+        if (pixels[i].count > 0)
+            res[i] = aov_sums[i * aovs.size() + aov] / (aovs[aov].averaged ? (Float)pixels[i].count : Float(1));
+    return res;
+}
+
+void SensorTile::splat(const uint32_t& x, const uint32_t& y, const vec2& p, const Spectrum& s, const Filter& filter)
+{
+    pixels[index(x, y)].count++;
+    sum_counts++;
+
+    // Position of the sample in pixels, rows go down
+    Float fx = x + 0.5f + p.x;
+    Float fy = y + 0.5f - p.y;
+
+    int x_min = std::max(int(std::ceil(fx - 0.5f - filter.radius)), int(x0) - halo);
+    int y_min = std::max(int(std::ceil(fy - 0.5f - filter.radius)), int(y0) - halo);
+    int x_max = std::min(int(std::floor(fx - 0.5f + filter.radius)), int(x0 + w) + halo - 1);
+    int y_max = std::min(int(std::floor(fy - 0.5f + filter.radius)), int(y0 + h) + halo - 1);
+
+    for (int j = y_min; j <= y_max; j++) {
+        Float f_y = filter.eval_1d(fy - (j + 0.5f));
+        for (int i = x_min; i <= x_max; i++) {
+            Float f = f_y * filter.eval_1d(i + 0.5f - fx);
+            uint32_t k = index(i, j);
+            Spectrum fs = f * s;
+            pixels[k].sum += fs;
+            weights[k] += f;
+            // Second moments of the weighted mean, for the variance
+            if (!accumulator_sqr.empty()) {
+                accumulator_sqr[k] += fs * fs;
+                accumulator_cross[k] += f * fs;
+                weights_sqr[k] += f * f;
+            }
+        }
+    }
+}
+
+void Sensor::resolve()
+{
+    allocate_value();
+    if (resolved)
+        return;
+    resolved = true;
+
+    for (uint32_t y = 0; y < h; y++)
+        for (uint32_t x = 0; x < w; x++)
+            set_value(y * w + x, y);
 }
 
 /**
@@ -82,16 +230,71 @@ Spectrum Sensor::get(const uint32_t& x, const uint32_t& y) {
     * @param y The y-coordinate of the pixel.
     * @return The number of samples at the specified pixel.
     */
-uint16_t Sensor::n_sample(const uint32_t& x, const uint32_t& y)
+uint32_t Sensor::n_sample(const uint32_t& x, const uint32_t& y)
 {
-    return count[y * w + x];
+    return pixels[y * w + x].count;
+}
+
+Spectrum Sensor::mean(const uint32_t& idx) const
+{
+    const SensorPixel& pixel = pixels[idx];
+    if (!weights.empty())
+        return weights[idx] != 0. ? pixel.sum / weights[idx] : Spectrum(0.);
+    return pixel.count > 0 ? pixel.sum / (Float)pixel.count : Spectrum(0.);
 }
 
 void Sensor::set_value(const uint32_t& idx, const uint32_t& x){
-    value[idx] = acculumator[idx] / (Float)count[idx];
+    value[idx] = mean(idx);
     assert(value[idx] == value[idx]);
 }
 
+void Sensor::save_state(std::ostream& out) const
+{
+    uint32_t header[6] = { w, h, crop_x, crop_y, uint32_t(aovs.size()), uint32_t(!weights.empty()) };
+    out.write((const char*)header, sizeof(header));
+    out.write((const char*)&sum_counts, sizeof(sum_counts));
+    out.write((const char*)pixels.data(), sizeof(SensorPixel) * pixels.size());
+    out.write((const char*)weights.data(), sizeof(Float) * weights.size());
+    out.write((const char*)aov_sums.data(), sizeof(Spectrum) * aov_sums.size());
+}
+
+bool Sensor::add_state(std::istream& in)
+{
+    uint32_t header[6];
+    uint64_t in_sum_counts;
+    in.read((char*)header, sizeof(header));
+    in.read((char*)&in_sum_counts, sizeof(in_sum_counts));
+    if (!in || header[0] != w || header[1] != h || header[2] != crop_x || header[3] != crop_y || header[4] != aovs.size()
+        || header[5] != uint32_t(!weights.empty()))
+        return false;
+
+    // Read whole before being added, a truncated stream adds nothing to the pixels
+    std::vector<SensorPixel> in_pixels(pixels.size());
+    std::vector<Float> in_weights(weights.size());
+    std::vector<Spectrum> in_aov_sums(aov_sums.size());
+    in.read((char*)in_pixels.data(), sizeof(SensorPixel) * in_pixels.size());
+    in.read((char*)in_weights.data(), sizeof(Float) * in_weights.size());
+    in.read((char*)in_aov_sums.data(), sizeof(Spectrum) * in_aov_sums.size());
+    if (!in)
+        return false;
+
+    for (size_t i = 0; i < pixels.size(); i++) {
+        pixels[i].sum += in_pixels[i].sum;
+        pixels[i].count += in_pixels[i].count;
+    }
+    for (size_t i = 0; i < weights.size(); i++)
+        weights[i] += in_weights[i];
+    for (size_t i = 0; i < aov_sums.size(); i++) {
+        if (aovs[i % aovs.size()].averaged)
+            aov_sums[i] += in_aov_sums[i];
+        else if (in_pixels[i / aovs.size()].count > 0)
+            aov_sums[i] = in_aov_sums[i];
+    }
+    sum_counts += in_sum_counts;
+    resolved = false;
+    return true;
+}
+
 
 
 void HemisphereSensor::init() {
@@ -109,8 +312,8 @@ void HemisphereSensor::init() {
 }
 
 void HemisphereSensor::set_value(const uint32_t& idx, const uint32_t& y) {
-    Float norm = sum_counts * solid_angle[y];
-    value[idx] = acculumator[idx] / norm;
+    Float norm = Float(sum_counts) * solid_angle[y];
+    value[idx] = norm > 0. ? pixels[idx].sum / norm : Spectrum(0.);
 }
 
 }
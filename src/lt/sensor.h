@@ -7,12 +7,107 @@
 #include <lt/lt_common.h>
 #include <lt/serialize.h>
 #include <lt/factory.h>
+#include <lt/filter.h>
 #include <atomic>
-
-#include <atomic>
+#include <iostream>
 
 namespace LT_NAMESPACE {
 
+/**
+ * @brief Accumulated samples of a pixel, the sum and the count are interleaved
+ * so a sample touches a single 16 bytes cell.
+ */
+struct SensorPixel {
+    Spectrum sum; /**< Sum of the samples. */
+    uint32_t count; /**< Number of samples. */
+};
+
+/**
+ * @brief Samples of a rectangle of the sensor, accumulated by a single thread.
+ *
+ * A tile is filled with \ref Sensor::init_tile, receives the samples of its
+ * rectangle with \ref add or \ref splat, and is merged once in the sensor with
+ * \ref Sensor::merge. Splatted samples also reach a halo of pixels around the
+ * rectangle, tiles only overlap through their halos.
+ */
+struct SensorTile {
+    /**
+     * @brief Adds a sample to its pixel.
+     *
+     * @param x The x-coordinate of the sample on the sensor.
+     * @param y The y-coordinate of the sample on the sensor.
+     * @param s The spectrum of the sample.
+     * @param weight The weight of the filter importance sampling.
+     */
+    void add(const uint32_t& x, const uint32_t& y, const Spectrum& s, const Float& weight = 1.)
+    {
+        uint32_t idx = index(x, y);
+        Spectrum ws = weight * s;
+        pixels[idx].sum += ws;
+        pixels[idx].count++;
+        if (!accumulator_sqr.empty())
+            accumulator_sqr[idx] += ws * ws;
+        sum_counts++;
+    }
+
+    /**
+     * @brief Adds a sample to all the pixels under the filter, in the tile and its halo.
+     *
+     * @param x The x-coordinate of the pixel of the sample on the sensor.
+     * @param y The y-coordinate of the pixel of the sample on the sensor.
+     * @param p The offset of the sample from the pixel center, y pointing up like the camera.
+     * @param s The spectrum of the sample.
+     * @param filter The reconstruction filter.
+     */
+    void splat(const uint32_t& x, const uint32_t& y, const vec2& p, const Spectrum& s, const Filter& filter);
+
+    /**
+     * @brief Adds the AOVs of a sample to its pixel, they are averaged over the samples of the pixel.
+     * AOVs that are not averaged, like ids, keep the value of the last sample of the pixel.
+     *
+     * @param values One value per AOV of the sensor.
+     */
+    void add_aovs(const uint32_t& x, const uint32_t& y, const std::vector<Spectrum>& values)
+    {
+        Spectrum* dst = &aovs[index(x, y) * n_aov];
+        for (uint32_t a = 0; a < n_aov; a++)
+            dst[a] = aov_averaged[a] ? dst[a] + values[a] : values[a];
+    }
+
+    /**
+     * @brief Index of a pixel of the sensor in the tile buffers, halo included.
+     */
+    uint32_t index(const int& x, const int& y) const
+    {
+        return (y - int(y0) + halo) * stride + (x - int(x0) + halo);
+    }
+
+    uint32_t x0; /**< First column of the tile on the sensor. */
+    uint32_t y0; /**< First row of the tile on the sensor. */
+    uint32_t w; /**< Width of the tile. */
+    uint32_t h; /**< Height of the tile. */
+    int halo; /**< Pixels around the tile reached by splatting. */
+    uint32_t stride; /**< Row length of the buffers, w + 2 halo. */
+    std::vector<SensorPixel> pixels; /**< Samples of each pixel. */
+    std::vector<Spectrum> accumulator_sqr; /**< Sum of the squared weighted samples, only for sensors that need it. */
+    std::vector<Spectrum> accumulator_cross; /**< Sum of the samples times their squared filter weight, with accumulator_sqr when splatting. */
+    std::vector<Float> weights; /**< Sum of the filter weights, only when splatting. */
+    std::vector<Float> weights_sqr; /**< Sum of the squared filter weights, with accumulator_sqr when splatting. */
+    std::vector<Spectrum> aovs; /**< Sum of the AOVs, n_aov values per pixel. */
+    std::vector<bool> aov_averaged; /**< Whether each AOV is summed, or keeps the last sample. */
+    uint32_t n_aov; /**< Number of AOVs of the sensor. */
+    uint64_t sum_counts; /**< Number of samples added to the tile. */
+};
+
+/**
+ * @brief Arbitrary output variable, an extra layer of the sensor written during the same passes.
+ */
+struct SensorAov {
+    std::string name; /**< Name of the layer. */
+    std::vector<std::string> channels; /**< Names of the channels in the layer, 1 to 3. */
+    bool averaged; /**< Averaged over the samples of the pixel, or the value of one sample, for ids. */
+};
+
 /**
  * @brief Class for handling sensor data.
  *
@@ -29,6 +124,18 @@ public:
         : Serializable(type)
         , w(w)
         , h(h)
+        , full_w(w)
+        , full_h(h)
+        , crop_x(0)
+        , crop_y(0)
+        , crop_w(0)
+        , crop_h(0)
+        , half_output(false)
+        , compression("zip")
+        , multipart(false)
+        , filter(std::make_shared<BoxFilter>())
+        , sum_counts(0)
+        , resolved(true)
     {
         link_params();
     }
@@ -42,16 +149,48 @@ public:
         : Serializable("Sensor")
         , w(w)
         , h(h)
+        , full_w(w)
+        , full_h(h)
+        , crop_x(0)
+        , crop_y(0)
+        , crop_w(0)
+        , crop_h(0)
+        , half_output(false)
+        , compression("zip")
+        , multipart(false)
+        , filter(std::make_shared<BoxFilter>())
+        , sum_counts(0)
+        , resolved(true)
     {
         link_params();
     }
 
-    void init();
+    /**
+     * @brief Allocates the accumulators, for the crop window only if there is one.
+     *
+     * The accumulators start empty, a sensor can be initialized again after a change of its crop window.
+     */
+    virtual void init();
+
+    /**
+     * @brief Restricts the sensor to the pixels [x0, x1) x [y0, y1) of the image, clamped to it.
+     *
+     * Only the crop window is rendered and stored. Takes effect at the next \ref init.
+     */
+    void set_crop(const int& x0, const int& y0, const int& x1, const int& y1);
+
+    /**
+     * @brief Restricts the sensor to a window in normalized coordinates, [0, 1]^2 from the top left corner of the image.
+     */
+    void set_crop_ndc(const Float& x0, const Float& y0, const Float& x1, const Float& y1)
+    {
+        set_crop(int(std::ceil(x0 * full_w)), int(std::ceil(y0 * full_h)), int(std::ceil(x1 * full_w)), int(std::ceil(y1 * full_h)));
+    }
 
     /**
      * @brief Resets the sensor data.
      *
-     * This function resets the accumulator, value, and count arrays of the
+     * This function resets the accumulated pixels and the value array of the
      * sensor.
      */
     virtual void reset();
@@ -74,8 +213,60 @@ public:
      */
     virtual void set(const uint32_t& x, const uint32_t& y, Spectrum s);
 
+    /**
+     * @brief Gets the value of a pixel, resolved from the accumulator if samples were added since the last \ref resolve.
+     */
     virtual Spectrum get(const uint32_t& x, const uint32_t& y);
 
+    /**
+     * @brief Prepares a tile covering [x0, x0 + w) x [y0, y0 + h), with no samples.
+     *
+     * The buffers of the tile are reused, so a thread can keep one tile for a whole pass.
+     */
+    virtual void init_tile(SensorTile& tile, const uint32_t& x0, const uint32_t& y0, const uint32_t& w, const uint32_t& h);
+
+    /**
+     * @brief Adds the samples of a tile to the sensor, the halo is clipped to the sensor.
+     *
+     * Tiles whose halos do not overlap can be merged concurrently. The number of samples
+     * of the tile is not added to \ref sum_counts, the caller reduces them at the end of the pass.
+     */
+    virtual void merge(const SensorTile& tile);
+
+    /**
+     * @brief Adds an AOV to the sensor, or finds the one with the same name.
+     *
+     * @param name Name of the layer.
+     * @param channels Names of the channels, the first channels of the Spectrum are stored.
+     * @param averaged False for values that can not be blended, like ids, one sample is kept per pixel.
+     * @return Index of the AOV in the samples given to \ref SensorTile::add_aovs.
+     */
+    uint32_t add_aov(const std::string& name, const std::vector<std::string>& channels, const bool& averaged = true);
+
+    /**
+     * @brief Mean of an AOV over the samples of each pixel, or the kept sample when it is not averaged.
+     */
+    std::vector<Spectrum> resolve_aov(const uint32_t& aov) const;
+
+    /**
+     * @brief Pixels around a tile reached by splatting, 0 with filter importance sampling.
+     */
+    int halo() const
+    {
+        if (filter->importance_sampling)
+            return 0;
+        return std::min(int(std::ceil(filter->radius - 0.5f)), max_halo);
+    }
+
+    /**
+     * @brief Computes the value array from the accumulator, if samples were added since the last resolve.
+     *
+     * The value array is only allocated by the first resolve, so a film that is
+     * never read during rendering holds the accumulator alone. Must be called
+     * before reading or writing \ref value directly.
+     */
+    void resolve();
+
     /**
      * @brief Gets the number of samples at a specific pixel.
      *
@@ -83,26 +274,99 @@ public:
      * @param y The y-coordinate of the pixel.
      * @return The number of samples at the specified pixel.
      */
-    uint16_t n_sample(const uint32_t& x, const uint32_t& y);
+    uint32_t n_sample(const uint32_t& x, const uint32_t& y);
+
+    /**
+     * @brief Mean of the samples of a pixel, normalized by the filter weights when splatting.
+     */
+    Spectrum mean(const uint32_t& idx) const;
 
     virtual void set_value(const uint32_t& idx, const uint32_t& x);
 
-    uint32_t w; /**< Width of the sensor. */
-    uint32_t h; /**< Height of the sensor. */
-    std::vector<Spectrum> acculumator; /**< Accumulator array for sensor samples. */
-    std::vector<Spectrum> value; /**< Value array for sensor samples. (accumulator[i] / count[i]) */
-    std::vector<uint16_t> count; /**< Count array for the number of samples at each pixel. */
-    std::atomic<uint32_t> sum_counts;
+    /**
+     * @brief Writes the accumulators of the sensor in a binary stream, see \ref load_state.
+     */
+    virtual void save_state(std::ostream& out) const;
+
+    /**
+     * @brief Replaces the accumulators by the ones written by \ref save_state.
+     * @return False if the stream is truncated, or was written by a sensor of another size or with other AOVs.
+     */
+    bool load_state(std::istream& in)
+    {
+        reset();
+        return add_state(in);
+    }
+
+    /**
+     * @brief Adds accumulators written by \ref save_state to the ones of the sensor.
+     *
+     * Sums and counts are added, so sensors that rendered disjoint samples
+     * combine into the sensor that rendered all of them.
+     * @return False if the stream is truncated, or was written by a sensor of another size or with other AOVs.
+     */
+    virtual bool add_state(std::istream& in);
+
+    uint32_t w; /**< Width of the sensor, the one of the crop window if there is one. */
+    uint32_t h; /**< Height of the sensor, the one of the crop window if there is one. */
+    uint32_t full_w; /**< Width of the image the crop window is taken from. */
+    uint32_t full_h; /**< Height of the image the crop window is taken from. */
+    uint32_t crop_x; /**< Column of the image of the first pixel of the sensor. */
+    uint32_t crop_y; /**< Row of the image of the first pixel of the sensor. */
+    uint32_t crop_w; /**< Width of the crop window, 0 for the whole image. */
+    uint32_t crop_h; /**< Height of the crop window, 0 for the whole image. */
+    bool half_output; /**< Write the value array in half precision. */
+    std::string compression; /**< Compression of the EXR files: none, rle, zips, zip or piz. */
+    bool multipart; /**< Write each layer as a part of the EXR files, instead of channel prefixes. */
+    std::shared_ptr<Filter> filter; /**< Reconstruction filter of the pixels. */
+    std::vector<SensorPixel> pixels; /**< Accumulated samples of each pixel. */
+    std::vector<Float> weights; /**< Sum of the filter weights of each pixel, only when splatting. */
+    std::vector<SensorAov> aovs; /**< AOVs registered by the integrator, see \ref add_aov. */
+    std::vector<Spectrum> aov_sums; /**< Sum of the AOVs, aovs.size() values per pixel. */
+    std::vector<Spectrum> value; /**< Value array for sensor samples. (pixels[i].sum / pixels[i].count), see \ref resolve. */
+    uint64_t sum_counts; /**< Number of samples added to the sensor, 64 bits as it exceeds 2^32 at 8K from 128 spp. */
     std::vector<Float> u; /**< Vector representing the u-coordinates of the sensor pixels. */
     std::vector<Float> v; /**< Vector representing the v-coordinates of the sensor pixels. */
 
+    static constexpr int max_halo = 8; /**< Halo of the tiles, at most half the integrator blocks so that every other block never overlaps. */
+
 
 protected:
     void link_params()
     {
-        params.add("width", Params::Type::INT, &w);
-        params.add("height", Params::Type::INT, &h);
+        params.add("width", Params::Type::INT, &full_w);
+        params.add("height", Params::Type::INT, &full_h);
+        params.add("half", Params::Type::BOOL, &half_output);
+        params.add("multipart", Params::Type::BOOL, &multipart);
+    }
+
+    /**
+     * @brief Calls f(tile index, sensor index) for the pixels of the tile and its halo inside the sensor.
+     */
+    template <class F>
+    void for_each_tile_pixel(const SensorTile& tile, F f) const
+    {
+        int x_min = std::max(int(tile.x0) - tile.halo, 0);
+        int y_min = std::max(int(tile.y0) - tile.halo, 0);
+        int x_max = std::min(int(tile.x0 + tile.w) + tile.halo, int(w));
+        int y_max = std::min(int(tile.y0 + tile.h) + tile.halo, int(h));
+        for (int y = y_min; y < y_max; y++)
+            for (int x = x_min; x < x_max; x++)
+                f(tile.index(x, y), y * w + x);
+    }
+
+    /**
+     * @brief Allocates the value array on first use, it then needs a full resolve.
+     */
+    void allocate_value()
+    {
+        if (value.size() != size_t(w) * h) {
+            value.assign(size_t(w) * h, Spectrum(0.));
+            resolved = false;
+        }
     }
+
+    std::atomic<bool> resolved; /**< The value array is up to date with the accumulator. */
 };
 
 class VarianceSensor : public Sensor
@@ -111,61 +375,146 @@ public:
 
     VarianceSensor()
         : Sensor("Variance")
+        , variance(true)
     {};
 
     VarianceSensor(const uint32_t& w, const uint32_t& h)
         : Sensor("Variance", w, h)
+        , variance(true)
     {};
 
-    void init() {
+    void init() override
+    {
         Sensor::init();
-        acculumator_sqr.resize(w * h);
+        acculumator_sqr.assign(size_t(w) * h, Spectrum(0.));
+        accumulator_cross.assign(weights.size(), Spectrum(0.));
+        weights_sqr.assign(weights.size(), 0.);
     }
     
     void reset() {
         Sensor::reset();
-        memset(acculumator_sqr.data(), 0, sizeof(Spectrum) * acculumator_sqr.size());
+        std::fill(acculumator_sqr.begin(), acculumator_sqr.end(), Spectrum(0.));
+        std::fill(accumulator_cross.begin(), accumulator_cross.end(), Spectrum(0.));
+        std::fill(weights_sqr.begin(), weights_sqr.end(), 0.);
     }
     
     void add(const uint32_t& x, const uint32_t& y, Spectrum s) 
     {
+        Sensor::add(x, y, s);
         uint32_t idx = y * w + x;
-        acculumator[idx] += s;
         acculumator_sqr[idx] += s*s;
-        count[idx]++;
-        sum_counts++;
-        set_value(idx, y);
+        if (!weights.empty()) {
+            accumulator_cross[idx] += s;
+            weights_sqr[idx] += 1.;
+        }
+    }
+
+    void init_tile(SensorTile& tile, const uint32_t& x0, const uint32_t& y0, const uint32_t& w, const uint32_t& h)
+    {
+        Sensor::init_tile(tile, x0, y0, w, h);
+        tile.accumulator_sqr.assign(tile.pixels.size(), Spectrum(0.));
+        tile.accumulator_cross.assign(tile.weights.size(), Spectrum(0.));
+        tile.weights_sqr.assign(tile.weights.size(), 0.);
+    }
+
+    void merge(const SensorTile& tile)
+    {
+        Sensor::merge(tile);
+        for_each_tile_pixel(tile, [&](const uint32_t& t, const uint32_t& i) { acculumator_sqr[i] += tile.accumulator_sqr[t]; });
+        if (!tile.weights_sqr.empty())
+            for_each_tile_pixel(tile, [&](const uint32_t& t, const uint32_t& i) {
+                accumulator_cross[i] += tile.accumulator_cross[t];
+                weights_sqr[i] += tile.weights_sqr[t];
+            });
     }
 
     void set(const uint32_t& x, const uint32_t& y, Spectrum s)
     {
+        Sensor::set(x, y, s);
         uint32_t idx = y * w + x;
-        acculumator[idx] = s;
         acculumator_sqr[idx] = s*s;
-        count[idx] = 1;
-        set_value(idx, y);
+        if (!weights.empty()) {
+            accumulator_cross[idx] = s;
+            weights_sqr[idx] = 1.;
+        }
+    }
+
+    /**
+     * @brief Variance of the mean of a pixel, 0 below 2 samples.
+     *
+     * The mean is a ratio of weighted sums, its variance is estimated from the squared
+     * weights. Without splatting the weights are 1 and it is the usual sample variance over n.
+     */
+    Spectrum variance_of_mean(const uint32_t& idx) const
+    {
+        const SensorPixel& pixel = pixels[idx];
+        if (pixel.count < 2)
+            return Spectrum(0.);
+
+        Float w_sum = weights.empty() ? Float(pixel.count) : weights[idx];
+        Float w_sqr = weights.empty() ? Float(pixel.count) : weights_sqr[idx];
+        Spectrum cross = weights.empty() ? pixel.sum : accumulator_cross[idx];
+        Float norm = w_sum * w_sum - w_sqr;
+        if (!(norm > 0.))
+            return Spectrum(0.);
+
+        Spectrum m = pixel.sum / w_sum;
+        return glm::max((acculumator_sqr[idx] - 2.f * m * cross + m * m * w_sqr) / norm, Spectrum(0.));
     }
 
     void set_value(const uint32_t& idx, const uint32_t& y)
     {
-        Spectrum mean = acculumator[idx] / (Float)count[idx];
-        value[idx] = acculumator_sqr[idx] / (Float)count[idx] - mean * mean;
-        value[idx] = value[idx] / ((Float)count[idx] - 1);
+        if (!variance) {
+            Sensor::set_value(idx, y);
+            return;
+        }
+
+        value[idx] = variance_of_mean(idx);
         assert(value[idx] == value[idx]);
     }
 
+    void save_state(std::ostream& out) const
+    {
+        Sensor::save_state(out);
+        out.write((const char*)acculumator_sqr.data(), sizeof(Spectrum) * acculumator_sqr.size());
+        out.write((const char*)accumulator_cross.data(), sizeof(Spectrum) * accumulator_cross.size());
+        out.write((const char*)weights_sqr.data(), sizeof(Float) * weights_sqr.size());
+    }
+
+    bool add_state(std::istream& in)
+    {
+        if (!Sensor::add_state(in))
+            return false;
+        std::vector<Spectrum> sqr(acculumator_sqr.size());
+        std::vector<Spectrum> cross(accumulator_cross.size());
+        std::vector<Float> w_sqr(weights_sqr.size());
+        in.read((char*)sqr.data(), sizeof(Spectrum) * sqr.size());
+        in.read((char*)cross.data(), sizeof(Spectrum) * cross.size());
+        in.read((char*)w_sqr.data(), sizeof(Float) * w_sqr.size());
+        if (!in)
+            return false;
+        for (size_t i = 0; i < sqr.size(); i++)
+            acculumator_sqr[i] += sqr[i];
+        for (size_t i = 0; i < cross.size(); i++)
+            accumulator_cross[i] += cross[i];
+        for (size_t i = 0; i < w_sqr.size(); i++)
+            weights_sqr[i] += w_sqr[i];
+        return true;
+    }
+
+    /**
+     * @brief Resolves the value array to the variance, or to the mean when mode is false.
+     */
     void use_variance(const bool& mode ) {
-        if (mode) {
-            for (int i = 0; i < acculumator.size(); i++)
-                set_value(i, 0);
-        }
-        else {
-            for (int i = 0; i < acculumator.size(); i++)
-                value[i] = acculumator[i] / (Float)count[i];
-        }
+        variance = mode;
+        resolved = false;
+        resolve();
     }
 
-    std::vector<Spectrum> acculumator_sqr;
+    std::vector<Spectrum> acculumator_sqr; /**< Sum of the squared weighted samples. */
+    std::vector<Spectrum> accumulator_cross; /**< Sum of the samples times their squared filter weight, only when splatting. */
+    std::vector<Float> weights_sqr; /**< Sum of the squared filter weights, only when splatting. */
+    bool variance; /**< The value array holds the variance instead of the mean. */
     
 
 };
@@ -187,7 +536,7 @@ public:
         init();
     };
 
-    void init();
+    void init() override;
     void set_value(const uint32_t& idx, const uint32_t& y);
 
     std::vector<Float> solid_angle; /**< Vector representing the u-coordinates of the sensor pixels. */
@@ -0,0 +1,69 @@
+#include <lt/stream.h>
+
+#include <omp.h>
+
+namespace LT_NAMESPACE {
+
+bool render_streamed(Renderer& ren, Scene& scene, const std::string& filename, const std::vector<ExrAttribute>& attributes, float& time,
+    const std::function<void(const double&, const float&)>& progress)
+{
+    Sensor& sensor = *ren.sensor;
+    const int tile_size = ren.stream_tile_size;
+
+    // Pixels of the image to render, tiles are cropped from the whole image so that their halo crosses the window
+    const int x_min = sensor.crop_x;
+    const int y_min = sensor.crop_y;
+    const int x_max = x_min + int(sensor.crop_w > 0 ? sensor.crop_w : sensor.full_w);
+    const int y_max = y_min + int(sensor.crop_h > 0 ? sensor.crop_h : sensor.full_h);
+    const int halo = sensor.halo();
+
+    ExrTileStream stream(filename, { x_min, y_min, x_max - 1, y_max - 1 }, { 0, 0, int(sensor.full_w) - 1, int(sensor.full_h) - 1 }, tile_size, attributes);
+    const int n_tile = stream.tile_count();
+    const int n_tile_x = (x_max - x_min + tile_size - 1) / tile_size;
+
+    // Several tiles are rendered at once so that the blocks of a pass keep all the threads
+    // busy, their sensor is the band of consecutive tiles of one row, or of whole rows
+    const int n_tile_band = std::max(1, omp_get_max_threads());
+
+    time = 0.;
+    int band = 0;
+    for (int first_tile = 0; first_tile < n_tile; band++) {
+        const int tx = first_tile % n_tile_x;
+        const int ty = first_tile / n_tile_x;
+        const int n_row = tx == 0 && n_tile_x <= n_tile_band ? std::min(n_tile_band / n_tile_x, n_tile / n_tile_x - ty) : 1;
+        const int n_col = n_row > 1 ? n_tile_x : std::min(n_tile_band, n_tile_x - tx);
+        const int band_tiles = n_row * n_col;
+
+        const int x0 = x_min + tx * tile_size;
+        const int y0 = y_min + ty * tile_size;
+        const int x1 = std::min(x0 + n_col * tile_size, x_max);
+        const int y1 = std::min(y0 + n_row * tile_size, y_max);
+
+        sensor.set_crop(x0 - halo, y0 - halo, x1 + halo, y1 + halo);
+        sensor.init();
+        ren.integrator->n_sample = band * ren.max_sample + 1;
+
+        for (int s = 0; s < ren.max_sample; s++) {
+            float t = ren.render(scene);
+            time += t;
+            if (progress)
+                progress((first_tile + double(band_tiles) * (s + 1) / ren.max_sample) / n_tile, t);
+        }
+
+        // The tiles of the band follow each other in the file
+        const ExrSnapshot snap = snapshot_sensor_exr(sensor, filename);
+        for (int tile = first_tile; tile < first_tile + band_tiles; tile++) {
+            const int tile_x0 = x_min + (tile % n_tile_x) * tile_size;
+            const int tile_y0 = y_min + (tile / n_tile_x) * tile_size;
+            if (!stream.write_tile(snap, tile_x0, tile_y0)) {
+                Log(logError) << "Could not write the tile " << tile << " of " << filename;
+                return false;
+            }
+        }
+        first_tile += band_tiles;
+    }
+
+    return stream.close();
+}
+
+} // namespace LT_NAMESPACE
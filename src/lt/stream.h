@@ -0,0 +1,38 @@
+/**
+ * @file
+ * @brief Renders streamed tile by tile to a tiled EXR file, for images too large to be held in memory.
+ */
+
+#pragma once
+
+#include <lt/io_exr.h>
+#include <lt/lt_common.h>
+#include <lt/renderer.h>
+
+#include <functional>
+
+namespace LT_NAMESPACE {
+
+/**
+ * @brief Renders the image by bands of tiles, each band with all its passes, and streams the tiles to an EXR file.
+ *
+ * The sensor is cropped to a band of tiles of \ref Renderer::stream_tile_size
+ * pixels at a time, as many tiles as OpenMP threads taken in row order,
+ * extended by the halo of the filter so that splatting from the neighbouring
+ * pixels is complete. The tiles of a band are rendered together by the passes,
+ * and the memory of the sensor is proportional to the number of threads times
+ * the tile size instead of the resolution. The image is the crop window of the
+ * sensor if there is one, the sensor is left holding the last band.
+ *
+ * The samplers of a band are seeded from its index, the noise differs from the
+ * one of a render of the whole sensor.
+ *
+ * @param attributes Attributes added to the header, such as the number of passes.
+ * @param time Render time of all the tiles, in ms.
+ * @param progress Called after each pass with the fraction of the render done and the time of the pass.
+ * @return False if the file could not be written.
+ */
+bool render_streamed(Renderer& ren, Scene& scene, const std::string& filename, const std::vector<ExrAttribute>& attributes, float& time,
+    const std::function<void(const double&, const float&)>& progress = {});
+
+} // namespace LT_NAMESPACE
@@ -24,6 +24,7 @@ public:
         , u(0.)
         , v(0.)
         , brdf(nullptr)
+        , material(-1)
     {
     }
 
@@ -41,6 +42,7 @@ public:
         , u(0.)
         , v(0.)
         , brdf(nullptr)
+        , material(-1)
     {
     }
     vec3 nor; /**< Normal at the intersection point. */
@@ -49,7 +51,9 @@ public:
     Float u;
     Float v;
     std::shared_ptr<Brdf> brdf; /**< Pointer to the surface BRDF. */
+    int material; /**< Index of the surface BRDF in the MaterialTable of the scene. */
     unsigned int geom_id;
+    unsigned int prim_id; /**< Primitive (triangle) hit inside the geometry. */
 
     glm::mat3 tbn; /**< Tangent-Bitangent-Normal matrix. */
     glm::mat3 inv_tbn; /**< Inverse Tangent-Bitangent-Normal matrix. */